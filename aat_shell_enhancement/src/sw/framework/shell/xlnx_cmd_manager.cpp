@@ -14,22 +14,2188 @@
  * limitations under the License.
  */
 
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "unistd.h"
 #include "xlnx_cmd_manager.h"
 #include "xlnx_shell.h"
 #include "xlnx_shell_cmds.h"
 
+//register map of the pricing engine kernel, generated by Vitis HLS with the kernel driver
+#if defined(__has_include)
+#if __has_include("xpricingenginetop_hw.h")
+#include "xpricingenginetop_hw.h"
+#define PE_HAVE_REGISTER_MAP
+#endif
+#endif
+
+
+
+using namespace XLNX;
+
+
+
+static const char* HELP_STRING  = "help";
+static const char* ALL_STRING   = "all";
+static const char* LINE_STRING  = "----------------------------------------------------------------------------------";
+
+
+
+
+
+
+//
+//Pricing engine object commands
+//
+//The status block of the pricing engine kernel is read in one pass, with the statistics snapshot
+//latched (PE_CAPTURE_SNAPSHOT in pricingengine.hpp) so every field comes from the same moment.
+//Words follow the order of pricingEngineRegStatus_t, 64-bit counters take two words, low word first.
+//
+//With XLNX_PE_DEVICE naming a mappable register resource of the card (e.g. a PCIe BAR resource
+//file) and XLNX_PE_OFFSET the byte offset of the kernel in it, the registers are read from the card.
+//Each register is addressed as xpricingenginetop_hw.h places it, so the shell has to be built with
+//the driver of the kernel on the card. A device that is named but can't be used fails the commands.
+//Without XLNX_PE_DEVICE a local simulated register backend stands in so the commands can be tried.
+//XLNX_PE_SOLVER=sbm selects the SBM layout, SQA is the default.
+//
+
+static const char* PE_OBJECT_STRING = "pricingengine";
+
+#define PE_SIM_CONTROL_OFFSET   (0x0010)    //the simulated backend packs regControl and regStatus...
+#define PE_SIM_STATUS_OFFSET    (0x0050)    //...one word after the other
+#define PE_CONTROL_WORDS        (16)
+#define PE_CONTROL_CAPTURE      (2)
+#define PE_CAPTURE_SNAPSHOT     (1u << 27)
+#define PE_STATUS_MAX_WORDS     (64)
+#define PE_ERROR_LENGTH         (256)
+
+#define PE_NUM_SPINS            (18)        //edges, the SBM ancilla is bit 18 of the solution
+#define PE_NUM_CURRENCIES       (5)
+#define PE_SBM_ANCILLA_BIT      (18)
+#define PE_NUM_TROTTERS         (4)
+#define PE_SQA_MARKER           (0xdeadbeef)
+#define PE_DEFAULT_CLOCK_MHZ    (300.0)
+#define PE_SHELL_COMMAND_ERROR  (-1)        //anything but XLNX_OK fails the command
+
+//Status word offsets shared by both solvers
+#define PE_ST_STATUS            (0)
+#define PE_ST_RX_RESPONSE       (1)
+#define PE_ST_PROCESS_RESPONSE  (3)
+#define PE_ST_TX_OPERATION      (5)
+#define PE_ST_STRATEGY_NONE     (7)
+#define PE_ST_STRATEGY_PEG      (8)
+#define PE_ST_STRATEGY_LIMIT    (9)
+#define PE_ST_STRATEGY_UNKNOWN  (10)
+#define PE_ST_RX_EVENT          (11)
+#define PE_ST_DEBUG             (13)
+#define PE_ST_TROTTER0          (14)        //reserved10..13, one trotter per word (SQA)
+#define PE_ST_RUN_COUNT         (18)        //reserved14
+#define PE_ST_MARKER            (19)        //reserved15
+#define PE_ST_CONFLATE_RESPONSE (20)
+#define PE_ST_SOLVE_PROBLEM     (22)
+#define PE_ST_SOLVE_RATE        (24)
+#define PE_ST_STALE_EDGE        (25)
+#define PE_ST_FIELD_DRIFT       (26)
+#define PE_ST_SUPPRESS_BASKET   (27)
+#define PE_ST_REPRICE_BASKET    (28)
+#define PE_ST_MEMO_HIT          (29)
+#define PE_ST_MEMO_REJECT       (30)
+#define PE_ST_ANNEAL_ITER       (31)
+#define PE_ST_LATENCY           (32)        //{min, max, mean} of update, solve, emit, total
+#define PE_ST_TRACE_COUNT       (44)
+#define PE_ST_TRACE_TRIGGER     (45)
+#define PE_ST_RECORD_DROP       (46)
+#define PE_ST_QUALITY_ALL_ZERO  (47)
+#define PE_ST_QUALITY_NO_CYCLE  (49)
+#define PE_ST_QUALITY_CYCLE     (51)
+#define PE_ST_QUALITY_PROFIT    (53)
+#define PE_ST_QUALITY_SPIN_FLIP (55)
+
+//...and the tail, SBM has the ancilla flip counter in front of it
+#define PE_ST_SBM_ANCILLA_FLIP  (57)
+#define PE_ST_TX_BASKET(sbm)        ((sbm) ? 59 : 57)
+#define PE_ST_SNAPSHOT_CYCLE(sbm)   ((sbm) ? 61 : 59)
+#define PE_STATUS_WORDS(sbm)        ((sbm) ? 63 : 61)
+
+#define PE_NUM_LATENCY_STAGES   (4)
+
+//same tables as exch2ising.hpp, spin i is the edge from [i][0] to [i][1], pair i / 2 is bid for even i
+static const int PE_EDGE_CURRENCY[PE_NUM_SPINS][2] =
+{
+    {1, 3}, {3, 1}, {0, 4}, {4, 0}, {3, 2}, {2, 3}, {1, 2}, {2, 1}, {0, 2},
+    {2, 0}, {3, 0}, {0, 3}, {1, 0}, {0, 1}, {1, 4}, {4, 1}, {4, 2}, {2, 4}
+};
+
+static const char* PE_CURRENCY_NAME[PE_NUM_CURRENCIES] = {"USD", "EUR", "JPY", "GBP", "CHF"};
+
+static const char* PE_LATENCY_STAGE_NAME[PE_NUM_LATENCY_STAGES] = {"update", "solve", "emit", "total"};
+
+
+
+typedef struct
+{
+    const char* pName;
+    bool (*pfnRead)(void* pContext, uint32_t offset, uint32_t* pWords, uint32_t numWords);
+    bool (*pfnWrite)(void* pContext, uint32_t offset, uint32_t value);
+    void* pContext;
+} PricingEngineRegisterBackend;
+
+
+
+typedef struct
+{
+    volatile uint32_t* pRegisters;
+    int fd;
+} PricingEngineCardBackend;
+
+
+
+//Byte offset of the capture word and of each status word, the high word of a 64-bit counter
+//sits right behind its low word
+typedef struct
+{
+    uint32_t capture;
+    uint32_t status[PE_STATUS_MAX_WORDS];
+    uint32_t length;                            //bytes to map, up to the last register used
+} PricingEngineRegisterMap;
+
+
+
+typedef struct
+{
+    uint32_t control[PE_CONTROL_WORDS];
+    uint32_t status[PE_STATUS_MAX_WORDS];
+    struct timespec start;
+    uint64_t solves;
+    uint32_t spins;
+    uint32_t seed;
+    bool bSBM;
+} PricingEngineSimBackend;
+
+
+
+typedef struct
+{
+    bool bInitialised;
+    bool bSBM;
+    PricingEngineRegisterBackend backend;
+    PricingEngineRegisterMap map;
+    PricingEngineCardBackend card;
+    PricingEngineSimBackend sim;
+    char error[PE_ERROR_LENGTH];                //why the configured device can't be used, empty if it can
+    uint32_t baseline[PE_STATUS_MAX_WORDS];     //block at the last resetstats, counters are shown relative to it
+} PricingEngineShellData;
+
+static PricingEngineShellData s_pricingEngineShellData;
+static std::mutex s_pricingEngineRegisterLock;
+
+
+
+
+
+
+
+static bool PricingEngineCardRead(void* pContext, uint32_t offset, uint32_t* pWords, uint32_t numWords)
+{
+    PricingEngineCardBackend* pCard = (PricingEngineCardBackend*)pContext;
+
+    for (uint32_t i = 0; i < numWords; i++)
+    {
+        pWords[i] = pCard->pRegisters[(offset / 4) + i];
+    }
+
+    return true;
+}
+
+
+
+static bool PricingEngineCardWrite(void* pContext, uint32_t offset, uint32_t value)
+{
+    PricingEngineCardBackend* pCard = (PricingEngineCardBackend*)pContext;
+
+    pCard->pRegisters[offset / 4] = value;
+
+    return true;
+}
+
+
+
+#ifdef PE_HAVE_REGISTER_MAP
+
+#define PE_CARD_FIELD(word, field)  {(word), XPRICINGENGINETOP_CONTROL_ADDR_REGSTATUS_##field##_DATA, \
+                                     XPRICINGENGINETOP_CONTROL_BITS_REGSTATUS_##field##_DATA}
+
+//the SBM kernel is the one with the ancilla flip counter
+#ifdef XPRICINGENGINETOP_CONTROL_ADDR_REGSTATUS_QUALITYANCILLAFLIP_DATA
+#define PE_CARD_SBM             (true)
+#else
+#define PE_CARD_SBM             (false)
+#endif
+
+typedef struct
+{
+    uint32_t word;
+    uint32_t address;
+    uint32_t bits;
+} PricingEngineCardField;
+
+static const PricingEngineCardField PE_CARD_STATUS_FIELDS[] =
+{
+    PE_CARD_FIELD(PE_ST_STATUS, STATUS),
+    PE_CARD_FIELD(PE_ST_RX_RESPONSE, RXRESPONSE),
+    PE_CARD_FIELD(PE_ST_PROCESS_RESPONSE, PROCESSRESPONSE),
+    PE_CARD_FIELD(PE_ST_TX_OPERATION, TXOPERATION),
+    PE_CARD_FIELD(PE_ST_STRATEGY_NONE, STRATEGYNONE),
+    PE_CARD_FIELD(PE_ST_STRATEGY_PEG, STRATEGYPEG),
+    PE_CARD_FIELD(PE_ST_STRATEGY_LIMIT, STRATEGYLIMIT),
+    PE_CARD_FIELD(PE_ST_STRATEGY_UNKNOWN, STRATEGYUNKNOWN),
+    PE_CARD_FIELD(PE_ST_RX_EVENT, RXEVENT),
+    PE_CARD_FIELD(PE_ST_DEBUG, DEBUG),
+    PE_CARD_FIELD(PE_ST_TROTTER0 + 0, RESERVED10),
+    PE_CARD_FIELD(PE_ST_TROTTER0 + 1, RESERVED11),
+    PE_CARD_FIELD(PE_ST_TROTTER0 + 2, RESERVED12),
+    PE_CARD_FIELD(PE_ST_TROTTER0 + 3, RESERVED13),
+    PE_CARD_FIELD(PE_ST_RUN_COUNT, RESERVED14),
+    PE_CARD_FIELD(PE_ST_MARKER, RESERVED15),
+    PE_CARD_FIELD(PE_ST_CONFLATE_RESPONSE, CONFLATERESPONSE),
+    PE_CARD_FIELD(PE_ST_SOLVE_PROBLEM, SOLVEPROBLEM),
+    PE_CARD_FIELD(PE_ST_SOLVE_RATE, SOLVERATE),
+    PE_CARD_FIELD(PE_ST_STALE_EDGE, STALEEDGE),
+    PE_CARD_FIELD(PE_ST_FIELD_DRIFT, FIELDDRIFT),
+    PE_CARD_FIELD(PE_ST_SUPPRESS_BASKET, SUPPRESSBASKET),
+    PE_CARD_FIELD(PE_ST_REPRICE_BASKET, REPRICEBASKET),
+    PE_CARD_FIELD(PE_ST_MEMO_HIT, MEMOHIT),
+    PE_CARD_FIELD(PE_ST_MEMO_REJECT, MEMOREJECT),
+    PE_CARD_FIELD(PE_ST_ANNEAL_ITER, ANNEALITER),
+    PE_CARD_FIELD(PE_ST_LATENCY + 0, LATENCYUPDATEMIN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 1, LATENCYUPDATEMAX),
+    PE_CARD_FIELD(PE_ST_LATENCY + 2, LATENCYUPDATEMEAN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 3, LATENCYSOLVEMIN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 4, LATENCYSOLVEMAX),
+    PE_CARD_FIELD(PE_ST_LATENCY + 5, LATENCYSOLVEMEAN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 6, LATENCYEMITMIN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 7, LATENCYEMITMAX),
+    PE_CARD_FIELD(PE_ST_LATENCY + 8, LATENCYEMITMEAN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 9, LATENCYTOTALMIN),
+    PE_CARD_FIELD(PE_ST_LATENCY + 10, LATENCYTOTALMAX),
+    PE_CARD_FIELD(PE_ST_LATENCY + 11, LATENCYTOTALMEAN),
+    PE_CARD_FIELD(PE_ST_TRACE_COUNT, TRACECOUNT),
+    PE_CARD_FIELD(PE_ST_TRACE_TRIGGER, TRACETRIGGER),
+    PE_CARD_FIELD(PE_ST_RECORD_DROP, RECORDDROP),
+    PE_CARD_FIELD(PE_ST_QUALITY_ALL_ZERO, QUALITYALLZERO),
+    PE_CARD_FIELD(PE_ST_QUALITY_NO_CYCLE, QUALITYNOCYCLE),
+    PE_CARD_FIELD(PE_ST_QUALITY_CYCLE, QUALITYCYCLE),
+    PE_CARD_FIELD(PE_ST_QUALITY_PROFIT, QUALITYPROFITABLE),
+    PE_CARD_FIELD(PE_ST_QUALITY_SPIN_FLIP, QUALITYSPINFLIP),
+#ifdef XPRICINGENGINETOP_CONTROL_ADDR_REGSTATUS_QUALITYANCILLAFLIP_DATA
+    PE_CARD_FIELD(PE_ST_SBM_ANCILLA_FLIP, QUALITYANCILLAFLIP),
+#endif
+    PE_CARD_FIELD(PE_ST_TX_BASKET(PE_CARD_SBM), TXBASKET),
+    PE_CARD_FIELD(PE_ST_SNAPSHOT_CYCLE(PE_CARD_SBM), SNAPSHOTCYCLE),
+};
+
+#endif
+
+
+
+//Vitis gives each field of the DISAGGREGATEd regControl and regStatus its own slot in the control
+//bundle, padded and interleaved with regCapture, regStrategies, regCosts and regLatency, so the
+//offsets come from the generated header rather than from the struct layout. regTrace lives in the
+//separate trace bundle and is not part of this map
+static bool PricingEngineCardMap(PricingEngineRegisterMap* pMap, bool bSBM, char* pError, size_t errorLength)
+{
+#ifdef PE_HAVE_REGISTER_MAP
+    uint32_t end;
+    uint32_t size;
+    uint32_t pageSize = (uint32_t)sysconf(_SC_PAGESIZE);
+
+
+    if (bSBM != PE_CARD_SBM)
+    {
+        snprintf(pError, errorLength, "XLNX_PE_SOLVER asks for %s but the shell was built with the %s register map",
+                 bSBM ? "SBM" : "SQA", PE_CARD_SBM ? "SBM" : "SQA");
+        return false;
+    }
+
+    memset(pMap, 0, sizeof(*pMap));
+
+    pMap->capture = XPRICINGENGINETOP_CONTROL_ADDR_REGCONTROL_CAPTURE_DATA;
+    end = pMap->capture + 4;
+
+    for (uint32_t i = 0; i < sizeof(PE_CARD_STATUS_FIELDS) / sizeof(PE_CARD_STATUS_FIELDS[0]); i++)
+    {
+        const PricingEngineCardField* pField = &PE_CARD_STATUS_FIELDS[i];
+
+        size = ((pField->bits + 31) / 32) * 4;
+
+        pMap->status[pField->word] = pField->address;
+        if (size > 4)
+        {
+            pMap->status[pField->word + 1] = pField->address + 4;
+        }
+
+        if (pField->address + size > end)
+        {
+            end = pField->address + size;
+        }
+    }
+
+    pMap->length = ((end + pageSize - 1) / pageSize) * pageSize;
+
+    return true;
+#else
+    snprintf(pError, errorLength, "the shell was built without xpricingenginetop_hw.h, the card register map is unknown");
+    return false;
+#endif
+}
+
+
+
+static bool PricingEngineCardOpen(PricingEngineCardBackend* pCard, const char* pDevice, uint32_t length, char* pError, size_t errorLength)
+{
+    const char* pOffset = getenv("XLNX_PE_OFFSET");
+    off_t offset = 0;
+    void* pMap;
+
+
+    if (pOffset != nullptr)
+    {
+        offset = (off_t)strtoull(pOffset, NULL, 0);
+    }
+
+    pCard->fd = open(pDevice, O_RDWR | O_SYNC);
+    if (pCard->fd < 0)
+    {
+        snprintf(pError, errorLength, "cannot open XLNX_PE_DEVICE '%s': %s", pDevice, strerror(errno));
+        return false;
+    }
+
+    pMap = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, pCard->fd, offset);
+    if (pMap == MAP_FAILED)
+    {
+        snprintf(pError, errorLength, "cannot map %u bytes of '%s' at offset 0x%llx: %s", length, pDevice,
+                 (unsigned long long)offset, strerror(errno));
+        close(pCard->fd);
+        return false;
+    }
+
+    pCard->pRegisters = (volatile uint32_t*)pMap;
+
+    return true;
+}
+
+
+
+//Stands in for a configured device that can't be used, every access fails
+static bool PricingEngineUnavailableRead(void* pContext, uint32_t offset, uint32_t* pWords, uint32_t numWords)
+{
+    return false;
+}
+
+
+
+static bool PricingEngineUnavailableWrite(void* pContext, uint32_t offset, uint32_t value)
+{
+    return false;
+}
+
+
+
+
+
+
+
+static uint32_t PricingEngineSimRandom(PricingEngineSimBackend* pSim)
+{
+    pSim->seed = (pSim->seed * 1103515245u) + 12345u;
+    return (pSim->seed >> 16) & 0x7fff;
+}
+
+
+
+static void PricingEngineSimSet64(PricingEngineSimBackend* pSim, uint32_t word, uint64_t value)
+{
+    pSim->status[word]     = (uint32_t)value;
+    pSim->status[word + 1] = (uint32_t)(value >> 32);
+}
+
+
+
+static uint64_t PricingEngineSimGet64(PricingEngineSimBackend* pSim, uint32_t word)
+{
+    return ((uint64_t)pSim->status[word + 1] << 32) | pSim->status[word];
+}
+
+
+
+//Models a kernel seeing 1M responses/s and solving 50k times/s at 300 MHz, the solutions cycle
+//through a few known arbitrage loops with the odd broken one
+static void PricingEngineSimAdvance(PricingEngineSimBackend* pSim)
+{
+    static const uint32_t SIM_CYCLES[] =
+    {
+        (1u << 13) | (1u << 0) | (1u << 10),    //USD -> EUR -> GBP -> USD
+        (1u << 8) | (1u << 5) | (1u << 10),     //USD -> JPY -> GBP -> USD
+        (1u << 2) | (1u << 15) | (1u << 12),    //USD -> CHF -> EUR -> USD
+        (1u << 13) | (1u << 6),                 //USD -> EUR -> JPY, not closed
+        0
+    };
+    struct timespec now;
+    uint64_t elapsedNs;
+    uint64_t solves;
+    uint32_t spins = pSim->spins;
+    uint32_t lastSpins;
+    uint32_t word;
+
+
+    //a latched snapshot holds the whole block, as on the card
+    if (pSim->control[PE_CONTROL_CAPTURE] & PE_CAPTURE_SNAPSHOT)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsedNs = ((uint64_t)(now.tv_sec - pSim->start.tv_sec) * 1000000000ull) + now.tv_nsec - pSim->start.tv_nsec;
+
+    PricingEngineSimSet64(pSim, PE_ST_RX_RESPONSE, elapsedNs / 1000);
+    PricingEngineSimSet64(pSim, PE_ST_PROCESS_RESPONSE, elapsedNs / 1000);
+    PricingEngineSimSet64(pSim, PE_ST_CONFLATE_RESPONSE, elapsedNs / 4000);
+    PricingEngineSimSet64(pSim, PE_ST_RX_EVENT, 0);
+    PricingEngineSimSet64(pSim, PE_ST_SNAPSHOT_CYCLE(pSim->bSBM), (elapsedNs * 3) / 10);
+    pSim->status[PE_ST_SOLVE_RATE] = 50000;
+
+    //only the last few solves are played out, the counters of the rest are scaled up
+    solves = elapsedNs / 20000;
+    if (solves > pSim->solves + 64)
+    {
+        uint64_t skipped = solves - pSim->solves - 64;
+
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_CYCLE, PricingEngineSimGet64(pSim, PE_ST_QUALITY_CYCLE) + (skipped * 3) / 5);
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_PROFIT, PricingEngineSimGet64(pSim, PE_ST_QUALITY_PROFIT) + (skipped * 2) / 5);
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_NO_CYCLE, PricingEngineSimGet64(pSim, PE_ST_QUALITY_NO_CYCLE) + skipped / 5);
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_ALL_ZERO, PricingEngineSimGet64(pSim, PE_ST_QUALITY_ALL_ZERO) + skipped / 5);
+        PricingEngineSimSet64(pSim, PE_ST_TX_BASKET(pSim->bSBM), PricingEngineSimGet64(pSim, PE_ST_TX_BASKET(pSim->bSBM)) + (skipped * 2) / 5);
+        PricingEngineSimSet64(pSim, PE_ST_TX_OPERATION, PricingEngineSimGet64(pSim, PE_ST_TX_OPERATION) + (skipped * 6) / 5);
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_SPIN_FLIP, PricingEngineSimGet64(pSim, PE_ST_QUALITY_SPIN_FLIP) + (skipped * 4));
+        if (pSim->bSBM)
+        {
+            PricingEngineSimSet64(pSim, PE_ST_SBM_ANCILLA_FLIP, PricingEngineSimGet64(pSim, PE_ST_SBM_ANCILLA_FLIP) + skipped / 3);
+        }
+        pSim->solves = solves - 64;
+    }
+
+    for (; pSim->solves < solves; pSim->solves++)
+    {
+        uint32_t pick = PricingEngineSimRandom(pSim) % (sizeof(SIM_CYCLES) / sizeof(SIM_CYCLES[0]));
+
+        lastSpins = spins;
+        spins = SIM_CYCLES[pick];
+
+        if (spins == 0)
+        {
+            word = PE_ST_QUALITY_ALL_ZERO;
+        }
+        else if (pick == 3)
+        {
+            word = PE_ST_QUALITY_NO_CYCLE;
+        }
+        else
+        {
+            word = PE_ST_QUALITY_CYCLE;
+        }
+        PricingEngineSimSet64(pSim, word, PricingEngineSimGet64(pSim, word) + 1);
+
+        if (pick < 2)
+        {
+            PricingEngineSimSet64(pSim, PE_ST_QUALITY_PROFIT, PricingEngineSimGet64(pSim, PE_ST_QUALITY_PROFIT) + 1);
+            PricingEngineSimSet64(pSim, PE_ST_TX_BASKET(pSim->bSBM), PricingEngineSimGet64(pSim, PE_ST_TX_BASKET(pSim->bSBM)) + 1);
+            PricingEngineSimSet64(pSim, PE_ST_TX_OPERATION, PricingEngineSimGet64(pSim, PE_ST_TX_OPERATION) + 3);
+        }
+
+        PricingEngineSimSet64(pSim, PE_ST_QUALITY_SPIN_FLIP,
+                              PricingEngineSimGet64(pSim, PE_ST_QUALITY_SPIN_FLIP) + __builtin_popcount(spins ^ lastSpins));
+
+        pSim->status[PE_ST_ANNEAL_ITER] = 8 + (PricingEngineSimRandom(pSim) % 24);
+        pSim->status[PE_ST_DEBUG] = PricingEngineSimRandom(pSim) % pSim->status[PE_ST_ANNEAL_ITER];
+        pSim->spins = spins;
+
+        if (pSim->bSBM)
+        {
+            //the ancilla reads out at -1 now and then and the edges are flipped back
+            if ((PricingEngineSimRandom(pSim) % 3) == 0)
+            {
+                PricingEngineSimSet64(pSim, PE_ST_SBM_ANCILLA_FLIP, PricingEngineSimGet64(pSim, PE_ST_SBM_ANCILLA_FLIP) + 1);
+            }
+            pSim->status[PE_ST_STRATEGY_UNKNOWN] = spins | (1u << PE_SBM_ANCILLA_BIT);
+            pSim->status[PE_ST_STRATEGY_LIMIT] = (uint32_t)PricingEngineSimGet64(pSim, PE_ST_SBM_ANCILLA_FLIP);
+        }
+        else
+        {
+            //trotters agree on the solution but for a spin or so
+            for (int m = 0; m < PE_NUM_TROTTERS; m++)
+            {
+                pSim->status[PE_ST_TROTTER0 + m] = spins;
+                if ((PricingEngineSimRandom(pSim) % 4) == 0)
+                {
+                    pSim->status[PE_ST_TROTTER0 + m] ^= (1u << (PricingEngineSimRandom(pSim) % PE_NUM_SPINS));
+                }
+            }
+            pSim->status[PE_ST_TROTTER0 + 1] = spins;
+            pSim->status[PE_ST_RUN_COUNT] = (uint32_t)pSim->solves;
+            pSim->status[PE_ST_MARKER] = PE_SQA_MARKER;
+        }
+    }
+
+    PricingEngineSimSet64(pSim, PE_ST_SOLVE_PROBLEM, solves);
+
+    //{min, max, mean} cycles of update, solve, emit and total
+    for (int stage = 0; stage < PE_NUM_LATENCY_STAGES; stage++)
+    {
+        static const uint32_t SIM_LATENCY[PE_NUM_LATENCY_STAGES][3] =
+        {
+            {40, 310, 72}, {900, 5200, 1850}, {3, 18, 4}, {950, 5500, 1930}
+        };
+
+        for (int k = 0; k < 3; k++)
+        {
+            pSim->status[PE_ST_LATENCY + (stage * 3) + k] = SIM_LATENCY[stage][k];
+        }
+    }
+}
+
+
+
+static bool PricingEngineSimRead(void* pContext, uint32_t offset, uint32_t* pWords, uint32_t numWords)
+{
+    PricingEngineSimBackend* pSim = (PricingEngineSimBackend*)pContext;
+    uint32_t word;
+
+    if (offset >= PE_SIM_STATUS_OFFSET)
+    {
+        PricingEngineSimAdvance(pSim);
+    }
+
+    for (uint32_t i = 0; i < numWords; i++)
+    {
+        word = ((offset - PE_SIM_CONTROL_OFFSET) / 4) + i;
+
+        if (word < PE_CONTROL_WORDS)
+        {
+            pWords[i] = pSim->control[word];
+        }
+        else if (word - PE_CONTROL_WORDS < PE_STATUS_MAX_WORDS)
+        {
+            pWords[i] = pSim->status[word - PE_CONTROL_WORDS];
+        }
+        else
+        {
+            pWords[i] = 0;
+        }
+    }
+
+    return true;
+}
+
+
+
+static bool PricingEngineSimWrite(void* pContext, uint32_t offset, uint32_t value)
+{
+    PricingEngineSimBackend* pSim = (PricingEngineSimBackend*)pContext;
+    uint32_t word = (offset - PE_SIM_CONTROL_OFFSET) / 4;
+
+    //the block is brought up to date as the latch closes, the status block is read only
+    if (word == PE_CONTROL_CAPTURE)
+    {
+        PricingEngineSimAdvance(pSim);
+    }
+
+    if (word < PE_CONTROL_WORDS)
+    {
+        pSim->control[word] = value;
+    }
+
+    return true;
+}
+
+
+
+
+
+
+
+//The simulated backend only stands in when no device is configured, a device that is named but
+//can't be opened, mapped or addressed leaves the reason in error and fails every access
+static PricingEngineShellData* PricingEngineShellGetData(void* pObjectData)
+{
+    PricingEngineShellData* pData = (PricingEngineShellData*)pObjectData;
+    const char* pSolver = getenv("XLNX_PE_SOLVER");
+    const char* pDevice = getenv("XLNX_PE_DEVICE");
+
+
+    if (!pData->bInitialised)
+    {
+        memset(pData, 0, sizeof(*pData));
+
+        pData->bSBM = (pSolver != nullptr) && (strcmp(pSolver, "sbm") == 0);
+
+        if (pDevice == nullptr)
+        {
+            pData->sim.bSBM = pData->bSBM;
+            pData->sim.seed = 1;
+            clock_gettime(CLOCK_MONOTONIC, &pData->sim.start);
+
+            pData->map.capture = PE_SIM_CONTROL_OFFSET + (PE_CONTROL_CAPTURE * 4);
+            for (uint32_t i = 0; i < PE_STATUS_MAX_WORDS; i++)
+            {
+                pData->map.status[i] = PE_SIM_STATUS_OFFSET + (i * 4);
+            }
+
+            pData->backend.pName    = "simulated";
+            pData->backend.pfnRead  = PricingEngineSimRead;
+            pData->backend.pfnWrite = PricingEngineSimWrite;
+            pData->backend.pContext = &pData->sim;
+        }
+        else if (PricingEngineCardMap(&pData->map, pData->bSBM, pData->error, sizeof(pData->error)) &&
+                 PricingEngineCardOpen(&pData->card, pDevice, pData->map.length, pData->error, sizeof(pData->error)))
+        {
+            pData->backend.pName    = "card";
+            pData->backend.pfnRead  = PricingEngineCardRead;
+            pData->backend.pfnWrite = PricingEngineCardWrite;
+            pData->backend.pContext = &pData->card;
+        }
+        else
+        {
+            pData->backend.pName    = "unavailable";
+            pData->backend.pfnRead  = PricingEngineUnavailableRead;
+            pData->backend.pfnWrite = PricingEngineUnavailableWrite;
+            pData->backend.pContext = nullptr;
+        }
+
+        pData->bInitialised = true;
+    }
+
+    return pData;
+}
+
+
+
+static void PricingEnginePrintReadError(Shell* pShell, PricingEngineShellData* pData)
+{
+    if (pData->error[0] != '\0')
+    {
+        pShell->printf("Failed to read the pricing engine status block: %s\n", pData->error);
+    }
+    else
+    {
+        pShell->printf("Failed to read the pricing engine status block\n");
+    }
+}
+
+
+
+//Sets or clears the snapshot bit and nothing else of the capture word.
+//
+//The capture word also holds the capture, trace arm and freeze bits, which other host agents (the
+//application, a second shell) write without taking our lock. The word is re-read right before every
+//write so their bits are carried over as they are now, not as they were when the latch was taken.
+//A register write cannot be made atomic against another agent though: a write of theirs landing
+//between this read and write is still lost, the window is one register access wide.
+static bool PricingEngineSetSnapshot(PricingEngineShellData* pData, bool bLatch)
+{
+    PricingEngineRegisterBackend* pBackend = &pData->backend;
+    uint32_t capture = 0;
+    bool bOKToContinue;
+
+
+    bOKToContinue = pBackend->pfnRead(pBackend->pContext, pData->map.capture, &capture, 1);
+
+    if (bOKToContinue)
+    {
+        capture = bLatch ? (capture | PE_CAPTURE_SNAPSHOT) : (capture & ~PE_CAPTURE_SNAPSHOT);
+        bOKToContinue = pBackend->pfnWrite(pBackend->pContext, pData->map.capture, capture);
+    }
+
+    return bOKToContinue;
+}
+
+
+
+//Latches the snapshot, reads a span of the status block word by word through the register map and
+//releases the latch again.
+//A latch the host already holds is read through and left in place. The shell and the sampler
+//thread share the registers, the lock keeps their latches apart
+static bool PricingEngineReadStatusWords(PricingEngineShellData* pData, uint32_t firstWord, uint32_t numWords, uint32_t* pWords)
+{
+    PricingEngineRegisterBackend* pBackend = &pData->backend;
+    std::lock_guard<std::mutex> lock(s_pricingEngineRegisterLock);
+    uint32_t capture = 0;
+    bool bHeld;
+    bool bOKToContinue;
+
+
+    bOKToContinue = pBackend->pfnRead(pBackend->pContext, pData->map.capture, &capture, 1);
+    bHeld = ((capture & PE_CAPTURE_SNAPSHOT) != 0);
+
+    if (bOKToContinue && !bHeld)
+    {
+        bOKToContinue = PricingEngineSetSnapshot(pData, true);
+    }
+
+    if (bOKToContinue)
+    {
+        for (uint32_t i = 0; (i < numWords) && bOKToContinue; i++)
+        {
+            bOKToContinue = pBackend->pfnRead(pBackend->pContext, pData->map.status[firstWord + i], &pWords[i], 1);
+        }
+
+        if (!bHeld)
+        {
+            PricingEngineSetSnapshot(pData, false);
+        }
+    }
+
+    return bOKToContinue;
+}
+
+
+
+static bool PricingEngineReadStatusBlock(PricingEngineShellData* pData, uint32_t* pWords)
+{
+    return PricingEngineReadStatusWords(pData, 0, PE_STATUS_WORDS(pData->bSBM), pWords);
+}
+
+
+
+static uint64_t PricingEngineGet64(uint32_t* pWords, uint32_t word)
+{
+    return ((uint64_t)pWords[word + 1] << 32) | pWords[word];
+}
+
+
+
+//Counter since the last resetstats
+static uint64_t PricingEngineCounter(PricingEngineShellData* pData, uint32_t* pWords, uint32_t word, bool b64)
+{
+    if (b64)
+    {
+        return PricingEngineGet64(pWords, word) - PricingEngineGet64(pData->baseline, word);
+    }
+
+    return (uint32_t)(pWords[word] - pData->baseline[word]);
+}
+
+
+
+//Renders the selected edges as a currency cycle, e.g. "USD -> EUR -> GBP -> USD", edges that do not
+//close into a single loop are listed as they are
+static void PricingEngineFormatCycle(uint32_t spins, char* pBuffer, size_t length)
+{
+    int used = 0;
+    int numEdges = __builtin_popcount(spins & ((1u << PE_NUM_SPINS) - 1));
+    int edge = -1;
+    int start;
+    int current;
+    int walked = 0;
+    uint32_t visited = 0;
+
+
+    pBuffer[0] = '\0';
+
+    if (numEdges == 0)
+    {
+        snprintf(pBuffer, length, "(no edge selected)");
+        return;
+    }
+
+    for (int i = 0; i < PE_NUM_SPINS; i++)
+    {
+        if (spins & (1u << i))
+        {
+            edge = i;
+            break;
+        }
+    }
+
+    start = PE_EDGE_CURRENCY[edge][0];
+    current = start;
+    used += snprintf(pBuffer + used, length - used, "%s", PE_CURRENCY_NAME[start]);
+
+    while (walked < numEdges)
+    {
+        edge = -1;
+
+        for (int i = 0; i < PE_NUM_SPINS; i++)
+        {
+            if ((spins & (1u << i)) && !(visited & (1u << i)) && (PE_EDGE_CURRENCY[i][0] == current))
+            {
+                edge = i;
+                break;
+            }
+        }
+
+        if (edge < 0)
+        {
+            break;
+        }
+
+        visited |= (1u << edge);
+        current = PE_EDGE_CURRENCY[edge][1];
+        used += snprintf(pBuffer + used, length - used, " -> %s", PE_CURRENCY_NAME[current]);
+        walked++;
+
+        if (current == start)
+        {
+            break;
+        }
+    }
+
+    if ((walked != numEdges) || (current != start))
+    {
+        used = 0;
+        used += snprintf(pBuffer + used, length - used, "(not a cycle)");
+
+        for (int i = 0; i < PE_NUM_SPINS; i++)
+        {
+            if (spins & (1u << i))
+            {
+                used += snprintf(pBuffer + used, length - used, " %s->%s", PE_CURRENCY_NAME[PE_EDGE_CURRENCY[i][0]], PE_CURRENCY_NAME[PE_EDGE_CURRENCY[i][1]]);
+            }
+        }
+    }
+}
+
+
+
+//Pair and side of every selected edge, e.g. "EURGBP bid"
+static void PricingEnginePrintLegs(Shell* pShell, uint32_t spins)
+{
+    for (int i = 0; i < PE_NUM_SPINS; i++)
+    {
+        if (spins & (1u << i))
+        {
+            int pair = i / 2;
+
+            pShell->printf("    %s%s %s\n", PE_CURRENCY_NAME[PE_EDGE_CURRENCY[pair * 2][0]], PE_CURRENCY_NAME[PE_EDGE_CURRENCY[pair * 2][1]],
+                           (i & 1) ? "ask" : "bid");
+        }
+    }
+}
+
+
+
+static void PricingEngineFormatSpins(uint32_t spins, int numSpins, char* pBuffer)
+{
+    for (int i = 0; i < numSpins; i++)
+    {
+        pBuffer[i] = (spins & (1u << i)) ? '1' : '0';
+    }
+    pBuffer[numSpins] = '\0';
+}
+
+
+
+static uint32_t PricingEngineSolutionSpins(PricingEngineShellData* pData, uint32_t* pWords)
+{
+    //SQA writes back trotter 1, SBM the readout with the ancilla in bit 18
+    if (pData->bSBM)
+    {
+        return pWords[PE_ST_STRATEGY_UNKNOWN] & ((1u << PE_NUM_SPINS) - 1);
+    }
+
+    return pWords[PE_ST_TROTTER0 + 1] & ((1u << PE_NUM_SPINS) - 1);
+}
+
+
+
+
+
+
+
+static int PricingEngineSolverStatusCommandHandler(Shell* pShell, int argc, char* argv[], void* pObjectData)
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(pObjectData);
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    uint32_t spins;
+    char cycle[256];
+    char bits[PE_NUM_SPINS + 2];
+
+
+    if (!PricingEngineReadStatusBlock(pData, words))
+    {
+        PricingEnginePrintReadError(pShell, pData);
+        return PE_SHELL_COMMAND_ERROR;
+    }
+
+    spins = PricingEngineSolutionSpins(pData, words);
+    PricingEngineFormatCycle(spins, cycle, sizeof(cycle));
+    PricingEngineFormatSpins(pData->bSBM ? words[PE_ST_STRATEGY_UNKNOWN] : spins, pData->bSBM ? (PE_NUM_SPINS + 1) : PE_NUM_SPINS, bits);
+
+    pShell->printf("Solver           : %s (%s registers)\n", pData->bSBM ? "SBM" : "SQA", pData->backend.pName);
+    pShell->printf("Snapshot cycle   : %llu\n", (unsigned long long)PricingEngineGet64(words, PE_ST_SNAPSHOT_CYCLE(pData->bSBM)));
+    pShell->printf("Responses        : rx %llu, processed %llu, conflated %llu\n",
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_RX_RESPONSE, true),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_PROCESS_RESPONSE, true),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_CONFLATE_RESPONSE, true));
+    pShell->printf("Clock ticks      : %llu\n", (unsigned long long)PricingEngineCounter(pData, words, PE_ST_RX_EVENT, true));
+    pShell->printf("Solves           : %llu (%u per rate window)\n",
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_SOLVE_PROBLEM, true), words[PE_ST_SOLVE_RATE]);
+    pShell->printf("Last solve       : %u %s, settled after %u\n", words[PE_ST_ANNEAL_ITER], pData->bSBM ? "steps" : "iterations", words[PE_ST_DEBUG]);
+    pShell->printf("Memo             : hit %llu, reject %llu\n",
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_MEMO_HIT, false),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_MEMO_REJECT, false));
+    pShell->printf("Baskets          : sent %llu, suppressed %llu, repriced %llu, orders %llu\n",
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_TX_BASKET(pData->bSBM), true),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_SUPPRESS_BASKET, false),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_REPRICE_BASKET, false),
+                   (unsigned long long)PricingEngineCounter(pData, words, PE_ST_TX_OPERATION, true));
+    pShell->printf("Stale edges      : %u\n", words[PE_ST_STALE_EDGE]);
+    pShell->printf("Solution spins   : %s\n", bits);
+    pShell->printf("Solution         : %s\n", cycle);
+    PricingEnginePrintLegs(pShell, spins);
+
+    return XLNX_OK;
+}
+
+
+
+static int PricingEngineTrottersCommandHandler(Shell* pShell, int argc, char* argv[], void* pObjectData)
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(pObjectData);
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    uint32_t trotter;
+    uint32_t disagree = 0;
+    char cycle[256];
+    char bits[PE_NUM_SPINS + 1];
+
+
+    if (pData->bSBM)
+    {
+        pShell->printf("SBM has no trotters, see \"%s solverstatus\" for its solution\n", PE_OBJECT_STRING);
+        return XLNX_OK;
+    }
+
+    if (!PricingEngineReadStatusBlock(pData, words))
+    {
+        PricingEnginePrintReadError(pShell, pData);
+        return PE_SHELL_COMMAND_ERROR;
+    }
+
+    if (words[PE_ST_MARKER] != PE_SQA_MARKER)
+    {
+        pShell->printf("No SQA run recorded yet\n");
+        return XLNX_OK;
+    }
+
+    pShell->printf("Run %u\n", words[PE_ST_RUN_COUNT]);
+
+    for (int m = 0; m < PE_NUM_TROTTERS; m++)
+    {
+        trotter = words[PE_ST_TROTTER0 + m] & ((1u << PE_NUM_SPINS) - 1);
+        disagree |= trotter ^ (words[PE_ST_TROTTER0] & ((1u << PE_NUM_SPINS) - 1));
+
+        PricingEngineFormatSpins(trotter, PE_NUM_SPINS, bits);
+        PricingEngineFormatCycle(trotter, cycle, sizeof(cycle));
+        pShell->printf("Trotter %d%s : %s  %s\n", m, (m == 1) ? "*" : " ", bits, cycle);
+    }
+
+    PricingEngineFormatSpins(disagree, PE_NUM_SPINS, bits);
+    pShell->printf("Disagree   : %s  (%d spins)\n", bits, __builtin_popcount(disagree));
+    pShell->printf("* written back as the solution unless an anytime solve kept a better readout\n");
+
+    return XLNX_OK;
+}
+
+
+
+static int PricingEngineLatencyCommandHandler(Shell* pShell, int argc, char* argv[], void* pObjectData)
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(pObjectData);
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    double clockMHz = PE_DEFAULT_CLOCK_MHZ;
+    uint32_t* pStage;
+
+
+    if (argc > 1)
+    {
+        clockMHz = strtod(argv[1], NULL);
+        if (clockMHz <= 0.0)
+        {
+            pShell->printf("Invalid clock '%s'\n", argv[1]);
+            return PE_SHELL_COMMAND_ERROR;
+        }
+    }
+
+    if (!PricingEngineReadStatusBlock(pData, words))
+    {
+        PricingEnginePrintReadError(pShell, pData);
+        return PE_SHELL_COMMAND_ERROR;
+    }
+
+    pShell->printf("+-%.8s-+-%.12s-+-%.12s-+-%.12s-+-%.12s-+\n", LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING);
+    pShell->printf("| %-8s | %12s | %12s | %12s | %12s |\n", "Stage", "Min (cyc)", "Mean (cyc)", "Max (cyc)", "Mean (ns)");
+    pShell->printf("+-%.8s-+-%.12s-+-%.12s-+-%.12s-+-%.12s-+\n", LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING);
+
+    for (int stage = 0; stage < PE_NUM_LATENCY_STAGES; stage++)
+    {
+        pStage = &words[PE_ST_LATENCY + (stage * 3)];
+
+        pShell->printf("| %-8s | %12u | %12u | %12u | %12.1f |\n", PE_LATENCY_STAGE_NAME[stage], pStage[0], pStage[2], pStage[1],
+                       (pStage[2] * 1000.0) / clockMHz);
+    }
+
+    pShell->printf("+-%.8s-+-%.12s-+-%.12s-+-%.12s-+-%.12s-+\n", LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING, LINE_STRING);
+    pShell->printf("Since the kernel started, resetstats does not clear the min/max\n");
+
+    return XLNX_OK;
+}
+
+
+
+static int PricingEngineQualityCommandHandler(Shell* pShell, int argc, char* argv[], void* pObjectData)
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(pObjectData);
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    uint64_t allZero, noCycle, cycle, profitable, spinFlip;
+    uint64_t solves;
+    double scale;
+
+
+    if (!PricingEngineReadStatusBlock(pData, words))
+    {
+        PricingEnginePrintReadError(pShell, pData);
+        return PE_SHELL_COMMAND_ERROR;
+    }
+
+    allZero     = PricingEngineCounter(pData, words, PE_ST_QUALITY_ALL_ZERO, true);
+    noCycle     = PricingEngineCounter(pData, words, PE_ST_QUALITY_NO_CYCLE, true);
+    cycle       = PricingEngineCounter(pData, words, PE_ST_QUALITY_CYCLE, true);
+    profitable  = PricingEngineCounter(pData, words, PE_ST_QUALITY_PROFIT, true);
+    spinFlip    = PricingEngineCounter(pData, words, PE_ST_QUALITY_SPIN_FLIP, true);
+    solves      = allZero + noCycle + cycle;
+    scale       = (solves != 0) ? (100.0 / solves) : 0.0;
+
+    pShell->printf("Solves           : %llu\n", (unsigned long long)solves);
+    pShell->printf("All zero         : %llu (%.1f%%)\n", (unsigned long long)allZero, allZero * scale);
+    pShell->printf("Not a cycle      : %llu (%.1f%%)\n", (unsigned long long)noCycle, noCycle * scale);
+    pShell->printf("Cycle            : %llu (%.1f%%)\n", (unsigned long long)cycle, cycle * scale);
+    pShell->printf("Profitable       : %llu (%.1f%%)\n", (unsigned long long)profitable, profitable * scale);
+    pShell->printf("Spins flipped    : %.2f per solve\n", (solves != 0) ? ((double)spinFlip / solves) : 0.0);
+
+    if (pData->bSBM)
+    {
+        uint64_t ancillaFlip = PricingEngineCounter(pData, words, PE_ST_SBM_ANCILLA_FLIP, true);
+
+        pShell->printf("Ancilla flipped  : %llu (%.1f%%)\n", (unsigned long long)ancillaFlip, ancillaFlip * scale);
+    }
+
+    return XLNX_OK;
+}
+
+
+
+//The kernel counters are free running, resetstats keeps the current block as the baseline the
+//other commands count from
+static int PricingEngineResetStatsCommandHandler(Shell* pShell, int argc, char* argv[], void* pObjectData)
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(pObjectData);
+
+
+    if (!PricingEngineReadStatusBlock(pData, pData->baseline))
+    {
+        PricingEnginePrintReadError(pShell, pData);
+        return PE_SHELL_COMMAND_ERROR;
+    }
+
+    pShell->printf("Statistics counted from snapshot cycle %llu\n", (unsigned long long)PricingEngineGet64(pData->baseline, PE_ST_SNAPSHOT_CYCLE(pData->bSBM)));
+
+    return XLNX_OK;
+}
+
+
+
+static CommandTableElement PE_SHELL_COMMANDS_TABLE[] =
+{
+    {"solverstatus",    PricingEngineSolverStatusCommandHandler,    "",         "Decoded solver counters and last solution"   },
+    {"trotters",        PricingEngineTrottersCommandHandler,        "",         "SQA trotter spins as currency cycles"        },
+    {"latency",         PricingEngineLatencyCommandHandler,         "[MHz]",    "Per stage latency, default 300 MHz"          },
+    {"quality",         PricingEngineQualityCommandHandler,         "",         "Solution quality rates"                      },
+    {"resetstats",      PricingEngineResetStatsCommandHandler,      "",         "Count statistics from now on"                },
+};
+
+static const uint32_t PE_NUM_SHELL_COMMANDS = sizeof(PE_SHELL_COMMANDS_TABLE) / sizeof(PE_SHELL_COMMANDS_TABLE[0]);
+
+
+
+//
+//Timing built-ins for scripts, all intervals are taken from CLOCK_MONOTONIC in ns
+//
+
+typedef struct
+{
+    const char* commandName;
+    const char* argsListString;
+    const char* descriptionString;
+} ScriptBuiltInElement;
+
+static const ScriptBuiltInElement SCRIPT_BUILT_INS_TABLE[] =
+{
+    {"date",        "",                     "Wall clock date and time"              },
+    {"sleep",       "<seconds>",            "Sleep for whole seconds"               },
+    {"usleep",      "<microseconds>",       "Sleep for microseconds"                },
+    {"nsleep",      "<nanoseconds>",        "Sleep for nanoseconds"                 },
+    {"timestamp",   "",                     "Monotonic time in ns"                  },
+    {"time",        "<command> [args]",     "Wall and CPU time of a command"        },
+    {"stopwatch",   "start|lap|stop",       "Time a sequence of commands"           },
+    {"sampler",     "start|stop|status",    "Sample registers to a file"            },
+    {"waituntil",   "<obj> <reg> <op> <val>",   "Wait for a register comparison"    },
+    {"repeat",      "<count> { ... }",      "Run a block of lines count times"      },
+};
+
+static const uint32_t NUM_SCRIPT_BUILT_INS = sizeof(SCRIPT_BUILT_INS_TABLE) / sizeof(SCRIPT_BUILT_INS_TABLE[0]);
+
+
+
+typedef struct
+{
+    bool bRunning;
+    uint64_t startNs;
+    uint64_t lapNs;
+    uint32_t numLaps;
+} Stopwatch;
+
+static Stopwatch s_stopwatch;
+
+
+
+static uint64_t MonotonicNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+
+
+static uint64_t CPUTimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+
+
+//Digits only, as sleep always required
+static bool ParseDecimal(const char* pString, uint64_t* pValue)
+{
+    char* pEnd;
+
+    if ((pString[0] < '0') || (pString[0] > '9'))
+    {
+        return false;
+    }
+
+    errno = 0;
+    *pValue = strtoull(pString, &pEnd, 10);
+
+    return (*pEnd == '\0') && (errno == 0);
+}
+
+
+
+//nanosleep is resumed with the time left when a signal cuts it short
+static void SleepNs(uint64_t ns)
+{
+    struct timespec request;
+    struct timespec remaining;
+
+    request.tv_sec  = ns / 1000000000ull;
+    request.tv_nsec = ns % 1000000000ull;
+
+    while (nanosleep(&request, &remaining) != 0 && errno == EINTR)
+    {
+        request = remaining;
+    }
+}
+
+
+
+static void PrintDuration(Shell* pShell, const char* pLabel, uint64_t ns)
+{
+    pShell->printf("%s%llu.%09llu s\n", pLabel, (unsigned long long)(ns / 1000000000ull), (unsigned long long)(ns % 1000000000ull));
+}
+
+
+
+static bool StopwatchCommand(Shell* pShell, int argc, char* argv[])
+{
+    uint64_t now = MonotonicNs();
+    bool bOK = true;
+
+
+    if ((argc > 1) && (strcmp(argv[1], "start") == 0))
+    {
+        s_stopwatch.bRunning = true;
+        s_stopwatch.startNs  = now;
+        s_stopwatch.lapNs    = now;
+        s_stopwatch.numLaps  = 0;
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "lap") == 0) && s_stopwatch.bRunning)
+    {
+        s_stopwatch.numLaps++;
+        pShell->printf("lap %u: ", s_stopwatch.numLaps);
+        PrintDuration(pShell, "", now - s_stopwatch.lapNs);
+        PrintDuration(pShell, "total: ", now - s_stopwatch.startNs);
+        s_stopwatch.lapNs = now;
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "stop") == 0) && s_stopwatch.bRunning)
+    {
+        PrintDuration(pShell, "stopwatch: ", now - s_stopwatch.startNs);
+        pShell->printf("laps: %u\n", s_stopwatch.numLaps);
+        s_stopwatch.bRunning = false;
+    }
+    else if (argc > 1 && (strcmp(argv[1], "lap") == 0 || strcmp(argv[1], "stop") == 0))
+    {
+        pShell->printf("stopwatch is not running\n");
+        bOK = false;
+    }
+    else
+    {
+        pShell->printf("usage: stopwatch start|lap|stop\n");
+        bOK = false;
+    }
+
+    return bOK;
+}
+
+
+
+
+
+
+
+//
+//Background register sampler
+//
+//A sampling thread reads the chosen pricing engine registers at a fixed period on absolute
+//deadlines, spinning instead of sleeping below SAMPLER_SPIN_NS, and writes timestamped samples to a
+//ring allocated at start. A writer thread drains the ring to the file so neither the sampling nor the
+//interactive shell waits on the disk. A full ring drops the sample and counts it.
+//
+//Binary files start with a SamplerFileHeader followed by the register names, then one record of
+//(timestamp, value...) uint64_t per sample. CSV files have a header line instead.
+//
+
+#define SAMPLER_MAX_REGISTERS   (16)
+#define SAMPLER_RING_DEPTH      (1u << 16)
+#define SAMPLER_SPIN_NS         (50000)
+#define SAMPLER_NAME_LENGTH     (24)
+#define SAMPLER_FILE_MAGIC      (0x454c504d41534550ull)    //"PESAMPLE"
+
+typedef struct
+{
+    const char* pName;
+    uint32_t word;
+    bool b64;
+} SamplerRegister;
+
+typedef struct
+{
+    uint64_t magic;
+    uint32_t numRegisters;
+    uint32_t reserved;
+    uint64_t periodNs;
+} SamplerFileHeader;
+
+typedef struct
+{
+    uint64_t timestampNs;
+    uint64_t values[SAMPLER_MAX_REGISTERS];
+} SamplerRecord;
+
+typedef struct
+{
+    std::atomic<bool> bRunning;
+    std::thread sampleThread;
+    std::thread writeThread;
+    FILE* pFile;
+    bool bCSV;
+    char fileName[256];
+    uint64_t periodNs;
+    SamplerRegister registers[SAMPLER_MAX_REGISTERS];
+    uint32_t numRegisters;
+    uint32_t firstWord;
+    uint32_t numWords;
+    SamplerRecord* pRing;
+    std::atomic<uint64_t> head;     //samples written by the sampling thread
+    std::atomic<uint64_t> tail;     //samples written to the file
+    std::atomic<uint64_t> dropped;  //ring full
+    std::atomic<uint64_t> late;     //deadline already passed when the sample was due
+    std::atomic<uint64_t> errors;   //register reads that failed
+    uint64_t startNs;
+} Sampler;
+
+static Sampler s_sampler;
+
+
+
+//Status registers a sample can hold, names as in pricingEngineRegStatus_t
+static bool SamplerLookupRegister(const char* pName, bool bSBM, SamplerRegister* pRegister)
+{
+    static const SamplerRegister SAMPLER_REGISTERS[] =
+    {
+        {"status",              PE_ST_STATUS,               false   },
+        {"rxResponse",          PE_ST_RX_RESPONSE,          true    },
+        {"processResponse",     PE_ST_PROCESS_RESPONSE,     true    },
+        {"txOperation",         PE_ST_TX_OPERATION,         true    },
+        {"rxEvent",             PE_ST_RX_EVENT,             true    },
+        {"conflateResponse",    PE_ST_CONFLATE_RESPONSE,    true    },
+        {"solveProblem",        PE_ST_SOLVE_PROBLEM,        true    },
+        {"solveRate",           PE_ST_SOLVE_RATE,           false   },
+        {"staleEdge",           PE_ST_STALE_EDGE,           false   },
+        {"suppressBasket",      PE_ST_SUPPRESS_BASKET,      false   },
+        {"repriceBasket",       PE_ST_REPRICE_BASKET,       false   },
+        {"memoHit",             PE_ST_MEMO_HIT,             false   },
+        {"memoReject",          PE_ST_MEMO_REJECT,          false   },
+        {"annealIter",          PE_ST_ANNEAL_ITER,          false   },
+        {"latencyUpdateMean",   PE_ST_LATENCY + 2,          false   },
+        {"latencySolveMean",    PE_ST_LATENCY + 5,          false   },
+        {"latencyEmitMean",     PE_ST_LATENCY + 8,          false   },
+        {"latencyTotalMin",     PE_ST_LATENCY + 9,          false   },
+        {"latencyTotalMax",     PE_ST_LATENCY + 10,         false   },
+        {"latencyTotalMean",    PE_ST_LATENCY + 11,         false   },
+        {"recordDrop",          PE_ST_RECORD_DROP,          false   },
+        {"qualityAllZero",      PE_ST_QUALITY_ALL_ZERO,     true    },
+        {"qualityNoCycle",      PE_ST_QUALITY_NO_CYCLE,     true    },
+        {"qualityCycle",        PE_ST_QUALITY_CYCLE,        true    },
+        {"qualityProfitable",   PE_ST_QUALITY_PROFIT,       true    },
+        {"qualitySpinFlip",     PE_ST_QUALITY_SPIN_FLIP,    true    },
+    };
+
+
+    for (uint32_t i = 0; i < sizeof(SAMPLER_REGISTERS) / sizeof(SAMPLER_REGISTERS[0]); i++)
+    {
+        if (strcmp(SAMPLER_REGISTERS[i].pName, pName) == 0)
+        {
+            *pRegister = SAMPLER_REGISTERS[i];
+            return true;
+        }
+    }
+
+    //the tail of the block moves with the solver
+    pRegister->pName = pName;
+    pRegister->b64 = true;
+
+    if (strcmp(pName, "txBasket") == 0)
+    {
+        pRegister->word = PE_ST_TX_BASKET(bSBM);
+        return true;
+    }
+
+    if (strcmp(pName, "snapshotCycle") == 0)
+    {
+        pRegister->word = PE_ST_SNAPSHOT_CYCLE(bSBM);
+        return true;
+    }
+
+    if (bSBM && (strcmp(pName, "qualityAncillaFlip") == 0))
+    {
+        pRegister->word = PE_ST_SBM_ANCILLA_FLIP;
+        return true;
+    }
+
+    return false;
+}
+
+
+
+static void SamplerSampleThread(Sampler* pSampler)
+{
+    PricingEngineShellData* pData = &s_pricingEngineShellData;
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    uint64_t deadline = MonotonicNs();
+    uint64_t head = 0;
+    uint64_t now;
+    SamplerRecord* pRecord;
+    SamplerRegister* pRegister;
+
+
+    while (pSampler->bRunning.load(std::memory_order_relaxed))
+    {
+        //absolute deadlines, a late sample does not shift the ones after it
+        now = MonotonicNs();
+        if (now > deadline)
+        {
+            pSampler->late.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if ((deadline - now) > SAMPLER_SPIN_NS)
+        {
+            struct timespec ts;
+
+            ts.tv_sec  = (deadline - SAMPLER_SPIN_NS) / 1000000000ull;
+            ts.tv_nsec = (deadline - SAMPLER_SPIN_NS) % 1000000000ull;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        while (MonotonicNs() < deadline)
+        {
+            //spin out the last stretch
+        }
+        deadline += pSampler->periodNs;
+
+        now = MonotonicNs();
+        if (!PricingEngineReadStatusWords(pData, pSampler->firstWord, pSampler->numWords, &words[pSampler->firstWord]))
+        {
+            pSampler->errors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        if ((head - pSampler->tail.load(std::memory_order_acquire)) >= SAMPLER_RING_DEPTH)
+        {
+            pSampler->dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        pRecord = &pSampler->pRing[head % SAMPLER_RING_DEPTH];
+        pRecord->timestampNs = now - pSampler->startNs;
+
+        for (uint32_t i = 0; i < pSampler->numRegisters; i++)
+        {
+            pRegister = &pSampler->registers[i];
+            pRecord->values[i] = pRegister->b64 ? PricingEngineGet64(words, pRegister->word) : words[pRegister->word];
+        }
+
+        head++;
+        pSampler->head.store(head, std::memory_order_release);
+    }
+}
+
+
+
+static void SamplerWriteRecord(Sampler* pSampler, SamplerRecord* pRecord)
+{
+    if (pSampler->bCSV)
+    {
+        fprintf(pSampler->pFile, "%llu", (unsigned long long)pRecord->timestampNs);
+
+        for (uint32_t i = 0; i < pSampler->numRegisters; i++)
+        {
+            fprintf(pSampler->pFile, ",%llu", (unsigned long long)pRecord->values[i]);
+        }
+
+        fprintf(pSampler->pFile, "\n");
+    }
+    else
+    {
+        fwrite(&pRecord->timestampNs, sizeof(uint64_t), 1, pSampler->pFile);
+        fwrite(pRecord->values, sizeof(uint64_t), pSampler->numRegisters, pSampler->pFile);
+    }
+}
+
+
+
+//Drains the ring until the sampler has stopped and the ring is empty
+static void SamplerWriteThread(Sampler* pSampler)
+{
+    uint64_t tail = 0;
+    uint64_t head;
+    bool bRunning;
+
+
+    do
+    {
+        bRunning = pSampler->bRunning.load(std::memory_order_acquire);
+        head = pSampler->head.load(std::memory_order_acquire);
+
+        while (tail < head)
+        {
+            SamplerWriteRecord(pSampler, &pSampler->pRing[tail % SAMPLER_RING_DEPTH]);
+            tail++;
+            pSampler->tail.store(tail, std::memory_order_release);
+        }
+
+        if (bRunning)
+        {
+            SleepNs(1000000);
+        }
+    } while (bRunning || (tail < pSampler->head.load(std::memory_order_acquire)));
+
+    fflush(pSampler->pFile);
+}
+
+
+
+static void SamplerPrintStatus(Shell* pShell, Sampler* pSampler)
+{
+    uint64_t head = pSampler->head.load(std::memory_order_acquire);
+    uint64_t elapsedNs = MonotonicNs() - pSampler->startNs;
+
+    pShell->printf("file     : %s (%s)\n", pSampler->fileName, pSampler->bCSV ? "csv" : "binary");
+    pShell->printf("period   : %llu ns, %u registers\n", (unsigned long long)pSampler->periodNs, pSampler->numRegisters);
+    pShell->printf("samples  : %llu (%.1f/s), written %llu\n", (unsigned long long)head, (elapsedNs != 0) ? ((head * 1e9) / elapsedNs) : 0.0,
+                   (unsigned long long)pSampler->tail.load(std::memory_order_acquire));
+    pShell->printf("dropped  : %llu, late %llu, read errors %llu\n", (unsigned long long)pSampler->dropped.load(),
+                   (unsigned long long)pSampler->late.load(), (unsigned long long)pSampler->errors.load());
+}
+
+
+
+//Threads still running at exit would terminate the process from their destructors
+static void SamplerShutdown(void)
+{
+    Sampler* pSampler = &s_sampler;
+
+    if (pSampler->bRunning.load())
+    {
+        pSampler->bRunning.store(false);
+        pSampler->sampleThread.join();
+        pSampler->writeThread.join();
+        fclose(pSampler->pFile);
+        pSampler->pFile = nullptr;
+    }
+}
+
+
+
+static bool SamplerStart(Shell* pShell, int argc, char* argv[])
+{
+    Sampler* pSampler = &s_sampler;
+    PricingEngineShellData* pData = PricingEngineShellGetData(&s_pricingEngineShellData);
+    uint64_t periodUs;
+    uint32_t lastWord = 0;
+    size_t nameLength;
+    SamplerFileHeader header;
+    char name[SAMPLER_NAME_LENGTH];
+
+
+    if (pSampler->bRunning.load())
+    {
+        pShell->printf("sampler is already running, stop it first\n");
+        return false;
+    }
+
+    if (pData->error[0] != '\0')
+    {
+        pShell->printf("cannot sample the pricing engine: %s\n", pData->error);
+        return false;
+    }
+
+    if ((argc < 5) || !ParseDecimal(argv[2], &periodUs) || (periodUs == 0))
+    {
+        pShell->printf("usage: sampler start <period_us> <file.csv|file.bin> <register> [register ...]\n");
+        return false;
+    }
+
+    if ((argc - 4) > SAMPLER_MAX_REGISTERS)
+    {
+        pShell->printf("at most %u registers\n", SAMPLER_MAX_REGISTERS);
+        return false;
+    }
+
+    pSampler->numRegisters = 0;
+    pSampler->firstWord = PE_STATUS_MAX_WORDS;
+
+    for (int i = 4; i < argc; i++)
+    {
+        SamplerRegister* pRegister = &pSampler->registers[pSampler->numRegisters];
+
+        if (!SamplerLookupRegister(argv[i], pData->bSBM, pRegister))
+        {
+            pShell->printf("unknown register '%s'\n", argv[i]);
+            return false;
+        }
+
+        pSampler->firstWord = (pRegister->word < pSampler->firstWord) ? pRegister->word : pSampler->firstWord;
+        lastWord = (pRegister->word + (pRegister->b64 ? 1 : 0) > lastWord) ? (pRegister->word + (pRegister->b64 ? 1 : 0)) : lastWord;
+        pSampler->numRegisters++;
+    }
+
+    //one pass over the span of the chosen registers
+    pSampler->numWords = lastWord - pSampler->firstWord + 1;
+    pSampler->periodNs = periodUs * 1000ull;
+
+    nameLength = strlen(argv[3]);
+    pSampler->bCSV = (nameLength > 4) && (strcmp(&argv[3][nameLength - 4], ".csv") == 0);
+    snprintf(pSampler->fileName, sizeof(pSampler->fileName), "%s", argv[3]);
+
+    pSampler->pFile = fopen(pSampler->fileName, pSampler->bCSV ? "w" : "wb");
+    if (pSampler->pFile == nullptr)
+    {
+        pShell->printf("cannot open '%s'\n", pSampler->fileName);
+        return false;
+    }
+
+    if (pSampler->pRing == nullptr)
+    {
+        pSampler->pRing = (SamplerRecord*)calloc(SAMPLER_RING_DEPTH, sizeof(SamplerRecord));
+        if (pSampler->pRing == nullptr)
+        {
+            pShell->printf("cannot allocate the sample ring\n");
+            fclose(pSampler->pFile);
+            return false;
+        }
+
+        atexit(SamplerShutdown);
+    }
+
+    if (pSampler->bCSV)
+    {
+        fprintf(pSampler->pFile, "timestamp_ns");
+        for (uint32_t i = 0; i < pSampler->numRegisters; i++)
+        {
+            fprintf(pSampler->pFile, ",%s", argv[4 + i]);
+        }
+        fprintf(pSampler->pFile, "\n");
+    }
+    else
+    {
+        header.magic = SAMPLER_FILE_MAGIC;
+        header.numRegisters = pSampler->numRegisters;
+        header.reserved = 0;
+        header.periodNs = pSampler->periodNs;
+        fwrite(&header, sizeof(header), 1, pSampler->pFile);
+
+        for (uint32_t i = 0; i < pSampler->numRegisters; i++)
+        {
+            memset(name, 0, sizeof(name));
+            strncpy(name, argv[4 + i], sizeof(name) - 1);
+            fwrite(name, sizeof(name), 1, pSampler->pFile);
+        }
+    }
+
+    pSampler->head.store(0);
+    pSampler->tail.store(0);
+    pSampler->dropped.store(0);
+    pSampler->late.store(0);
+    pSampler->errors.store(0);
+    pSampler->startNs = MonotonicNs();
+    pSampler->bRunning.store(true);
+
+    pSampler->sampleThread = std::thread(SamplerSampleThread, pSampler);
+    pSampler->writeThread = std::thread(SamplerWriteThread, pSampler);
+
+    pShell->printf("sampling %u registers every %llu us to %s (%s registers)\n", pSampler->numRegisters, (unsigned long long)periodUs,
+                   pSampler->fileName, pData->backend.pName);
+
+    return true;
+}
+
+
+
+static bool SamplerStop(Shell* pShell)
+{
+    Sampler* pSampler = &s_sampler;
+
+
+    if (!pSampler->bRunning.load())
+    {
+        pShell->printf("sampler is not running\n");
+        return false;
+    }
+
+    SamplerShutdown();
+    SamplerPrintStatus(pShell, pSampler);
+
+    return true;
+}
+
+
+
+static bool SamplerCommand(Shell* pShell, int argc, char* argv[])
+{
+    bool bOK = true;
+
+
+    if ((argc > 1) && (strcmp(argv[1], "start") == 0))
+    {
+        bOK = SamplerStart(pShell, argc, argv);
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "stop") == 0))
+    {
+        bOK = SamplerStop(pShell);
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "status") == 0))
+    {
+        if (s_sampler.bRunning.load())
+        {
+            SamplerPrintStatus(pShell, &s_sampler);
+        }
+        else
+        {
+            pShell->printf("sampler is not running\n");
+        }
+    }
+    else
+    {
+        pShell->printf("usage: sampler start <period_us> <file.csv|file.bin> <register> [register ...]\n");
+        pShell->printf("       sampler stop|status\n");
+        bOK = false;
+    }
+
+    return bOK;
+}
+
+
+
+
+
+
+
+//
+//Script flow: waituntil and repeat
+//
+//waituntil polls one pricing engine status register until a comparison holds. The poll interval
+//starts at WAITUNTIL_MIN_POLL_NS and doubles while the register is idle or moving away; while a counter moves
+//towards the target the next poll is placed at half the time its current rate needs to get there, so
+//long waits cost few register reads and the condition is still seen within a few us of it holding.
+//
+//repeat runs a block of lines N times. Lines after "repeat N {" are held, not executed, up to the
+//matching "}", so the block works the same from a script as typed. Blocks may nest, and a repeat
+//stops at the first line that fails.
+//
+
+#define WAITUNTIL_MIN_POLL_NS           (1000ull)
+#define WAITUNTIL_MAX_POLL_NS           (10000000ull)
+#define WAITUNTIL_DEFAULT_TIMEOUT_MS    (60000ull)
+
+#define SCRIPT_BLOCK_MAX_LINES          (256)
+#define SCRIPT_LINE_LENGTH              (256)
+#define SCRIPT_MAX_ARGS                 (32)
+
+typedef enum
+{
+    WAITUNTIL_EQ = 0,
+    WAITUNTIL_NE,
+    WAITUNTIL_LT,
+    WAITUNTIL_LE,
+    WAITUNTIL_GT,
+    WAITUNTIL_GE,
+} WaitUntilOp;
+
+typedef struct
+{
+    uint64_t count;
+    uint32_t numLines;
+    char lines[SCRIPT_BLOCK_MAX_LINES][SCRIPT_LINE_LENGTH];
+} ScriptBlock;
+
+typedef struct
+{
+    uint32_t depth;         //open braces while a block is being held
+    bool bOverflow;         //block did not fit, it is dropped at the closing brace
+    ScriptBlock* pBlock;
+} ScriptBlockCapture;
+
+static ScriptBlockCapture s_scriptBlockCapture;
+
+
+
+static bool WaitUntilParseOp(const char* pString, WaitUntilOp* pOp)
+{
+    static const char* WAITUNTIL_OP_STRINGS[] = {"==", "!=", "<", "<=", ">", ">="};
+
+    for (uint32_t i = 0; i < sizeof(WAITUNTIL_OP_STRINGS) / sizeof(WAITUNTIL_OP_STRINGS[0]); i++)
+    {
+        if (strcmp(WAITUNTIL_OP_STRINGS[i], pString) == 0)
+        {
+            *pOp = (WaitUntilOp)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+static bool WaitUntilCompare(uint64_t value, WaitUntilOp op, uint64_t target)
+{
+    bool bResult = false;
+
+    switch (op)
+    {
+        case WAITUNTIL_EQ:  bResult = (value == target);    break;
+        case WAITUNTIL_NE:  bResult = (value != target);    break;
+        case WAITUNTIL_LT:  bResult = (value <  target);    break;
+        case WAITUNTIL_LE:  bResult = (value <= target);    break;
+        case WAITUNTIL_GT:  bResult = (value >  target);    break;
+        case WAITUNTIL_GE:  bResult = (value >= target);    break;
+    }
+
+    return bResult;
+}
+
+
+
+//Time a counter moving at (delta / elapsedNs) needs to reach the target, 0 when it is not heading there
+static uint64_t WaitUntilEstimateNs(uint64_t value, uint64_t previous, uint64_t elapsedNs, WaitUntilOp op, uint64_t target)
+{
+    uint64_t estimateNs = 0;
+
+    if ((value > previous) && ((op == WAITUNTIL_GT) || (op == WAITUNTIL_GE) || (op == WAITUNTIL_EQ)) && (target > value))
+    {
+        estimateNs = (uint64_t)(((double)(target - value) * elapsedNs) / (value - previous));
+    }
+    else if ((value < previous) && ((op == WAITUNTIL_LT) || (op == WAITUNTIL_LE) || (op == WAITUNTIL_EQ)) && (target < value))
+    {
+        estimateNs = (uint64_t)(((double)(value - target) * elapsedNs) / (previous - value));
+    }
+
+    return estimateNs;
+}
+
+
+
+static bool WaitUntilCommand(Shell* pShell, int argc, char* argv[])
+{
+    PricingEngineShellData* pData = PricingEngineShellGetData(&s_pricingEngineShellData);
+    SamplerRegister reg;
+    WaitUntilOp op;
+    uint64_t target;
+    uint64_t timeoutMs = WAITUNTIL_DEFAULT_TIMEOUT_MS;
+    uint32_t words[PE_STATUS_MAX_WORDS];
+    uint64_t value;
+    uint64_t previous;
+    uint64_t startNs;
+    uint64_t previousNs;
+    uint64_t deadlineNs;
+    uint64_t now;
+    uint64_t intervalNs = WAITUNTIL_MIN_POLL_NS;
+    uint64_t estimateNs;
+    uint32_t numPolls = 0;
+    char* pEnd;
+
+
+    if ((argc < 5) || (argc > 6))
+    {
+        pShell->printf("usage: waituntil %s <register> ==|!=|<|<=|>|>= <value> [timeout_ms]\n", PE_OBJECT_STRING);
+        return false;
+    }
 
+    if (strcmp(argv[1], PE_OBJECT_STRING) != 0)
+    {
+        pShell->printf("waituntil reads the '%s' registers only\n", PE_OBJECT_STRING);
+        return false;
+    }
 
-using namespace XLNX;
+    if (!SamplerLookupRegister(argv[2], pData->bSBM, &reg))
+    {
+        pShell->printf("unknown register '%s'\n", argv[2]);
+        return false;
+    }
 
+    if (!WaitUntilParseOp(argv[3], &op))
+    {
+        pShell->printf("unknown comparison '%s'\n", argv[3]);
+        return false;
+    }
 
+    //decimal or 0x hex, e.g. a status word
+    errno = 0;
+    target = strtoull(argv[4], &pEnd, 0);
+    if ((argv[4][0] == '-') || (*pEnd != '\0') || (errno != 0))
+    {
+        pShell->printf("invalid value '%s'\n", argv[4]);
+        return false;
+    }
+
+    if ((argc > 5) && !ParseDecimal(argv[5], &timeoutMs))
+    {
+        pShell->printf("invalid timeout '%s'\n", argv[5]);
+        return false;
+    }
+
+    startNs = MonotonicNs();
+    deadlineNs = startNs + (timeoutMs * 1000000ull);
+    previous = 0;
+    previousNs = startNs;
+
+    while (true)
+    {
+        if (!PricingEngineReadStatusWords(pData, reg.word, reg.b64 ? 2 : 1, &words[reg.word]))
+        {
+            if (pData->error[0] != '\0')
+            {
+                pShell->printf("failed to read '%s': %s\n", reg.pName, pData->error);
+            }
+            else
+            {
+                pShell->printf("failed to read '%s'\n", reg.pName);
+            }
+            return false;
+        }
+
+        now = MonotonicNs();
+        value = reg.b64 ? PricingEngineGet64(words, reg.word) : words[reg.word];
+        numPolls++;
+
+        if (WaitUntilCompare(value, op, target))
+        {
+            break;
+        }
+
+        if (now >= deadlineNs)
+        {
+            pShell->printf("timeout: %s = %llu after %u polls\n", reg.pName, (unsigned long long)value, numPolls);
+            return false;
+        }
+
+        //back off unless heading for the target, then aim at half the time left while the counter is moving
+        estimateNs = (numPolls > 1) ? WaitUntilEstimateNs(value, previous, now - previousNs, op, target) : 0;
+        if (estimateNs != 0)
+        {
+            intervalNs = estimateNs / 2;
+        }
+        else
+        {
+            intervalNs *= 2;
+        }
+
+        intervalNs = (intervalNs < WAITUNTIL_MIN_POLL_NS) ? WAITUNTIL_MIN_POLL_NS : intervalNs;
+        intervalNs = (intervalNs > WAITUNTIL_MAX_POLL_NS) ? WAITUNTIL_MAX_POLL_NS : intervalNs;
+        intervalNs = ((now + intervalNs) > deadlineNs) ? (deadlineNs - now) : intervalNs;
+
+        previous = value;
+        previousNs = now;
+
+        SleepNs(intervalNs);
+    }
+
+    pShell->printf("%s = %llu at %llu ns, ", reg.pName, (unsigned long long)value, (unsigned long long)now);
+    PrintDuration(pShell, "", now - startNs);
+
+    return true;
+}
+
+
+
+//"repeat N {" on its own, or the whole block on one line as "repeat N { cmd ; cmd }"
+static bool ScriptParseRepeat(int argc, char* argv[], uint64_t* pCount)
+{
+    return (argc >= 3) && (strcmp(argv[0], "repeat") == 0) && ParseDecimal(argv[1], pCount) && (strcmp(argv[2], "{") == 0);
+}
+
+
+
+static bool ScriptBlockAddLine(ScriptBlock* pBlock, int argc, char* argv[])
+{
+    char* pLine;
+    size_t length = 0;
+
+    if (pBlock->numLines >= SCRIPT_BLOCK_MAX_LINES)
+    {
+        return false;
+    }
+
+    pLine = pBlock->lines[pBlock->numLines];
+    pLine[0] = '\0';
+
+    for (int i = 0; i < argc; i++)
+    {
+        length += snprintf(&pLine[length], SCRIPT_LINE_LENGTH - length, (i == 0) ? "%s" : " %s", argv[i]);
+        if (length >= SCRIPT_LINE_LENGTH)
+        {
+            return false;
+        }
+    }
+
+    pBlock->numLines++;
+
+    return true;
+}
+
+
+
+//Runs lines [first, last) of a block, nested repeats included
+static bool ScriptRunLines(CommandManager* pManager, Shell* pShell, ScriptBlock* pBlock, uint32_t first, uint32_t last)
+{
+    char line[SCRIPT_LINE_LENGTH];
+    char* argv[SCRIPT_MAX_ARGS];
+    char* pSave;
+    int argc;
+    uint64_t count;
+    uint32_t depth;
+    uint32_t end;
+
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        strcpy(line, pBlock->lines[i]);
+
+        argc = 0;
+        for (char* pToken = strtok_r(line, " \t", &pSave); (pToken != nullptr) && (argc < SCRIPT_MAX_ARGS); pToken = strtok_r(nullptr, " \t", &pSave))
+        {
+            argv[argc++] = pToken;
+        }
+
+        if (ScriptParseRepeat(argc, argv, &count) && (argc == 3))
+        {
+            //the inner block runs to its matching brace
+            depth = 1;
+            for (end = i + 1; end < last; end++)
+            {
+                depth += (strncmp(pBlock->lines[end], "repeat ", 7) == 0) && (pBlock->lines[end][strlen(pBlock->lines[end]) - 1] == '{') ? 1 : 0;
+                depth -= (strcmp(pBlock->lines[end], "}") == 0) ? 1 : 0;
+                if (depth == 0)
+                {
+                    break;
+                }
+            }
+
+            for (uint64_t n = 0; n < count; n++)
+            {
+                if (!ScriptRunLines(pManager, pShell, pBlock, i + 1, end))
+                {
+                    return false;
+                }
+            }
+
+            i = end;
+        }
+        else if (!pManager->ExecuteCommand(pShell, argc, argv))
+        {
+            pShell->printf("repeat stopped at '%s'\n", pBlock->lines[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+static bool ScriptRunBlock(CommandManager* pManager, Shell* pShell, ScriptBlock* pBlock)
+{
+    bool bOK = true;
+
+    for (uint64_t n = 0; (n < pBlock->count) && bOK; n++)
+    {
+        bOK = ScriptRunLines(pManager, pShell, pBlock, 0, pBlock->numLines);
+    }
+
+    free(pBlock);
+
+    return bOK;
+}
+
+
+
+//Holds a line of an open block, runs the block at its closing brace
+static bool ScriptCaptureLine(CommandManager* pManager, Shell* pShell, int argc, char* argv[])
+{
+    ScriptBlockCapture* pCapture = &s_scriptBlockCapture;
+    ScriptBlock* pBlock = pCapture->pBlock;
+    uint64_t count;
+
+
+    if ((argc == 1) && (strcmp(argv[0], "}") == 0))
+    {
+        pCapture->depth--;
+
+        if (pCapture->depth == 0)
+        {
+            pCapture->pBlock = nullptr;
+
+            if (pCapture->bOverflow)
+            {
+                pShell->printf("repeat block longer than %u lines of %u characters, not run\n", SCRIPT_BLOCK_MAX_LINES, SCRIPT_LINE_LENGTH);
+                free(pBlock);
+                return false;
+            }
+
+            return ScriptRunBlock(pManager, pShell, pBlock);
+        }
+    }
+    else if (ScriptParseRepeat(argc, argv, &count) && (argc == 3))
+    {
+        pCapture->depth++;
+    }
+
+    if (!ScriptBlockAddLine(pBlock, argc, argv))
+    {
+        pCapture->bOverflow = true;
+    }
+
+    return true;
+}
 
-static const char* HELP_STRING  = "help";
-static const char* ALL_STRING   = "all";
-static const char* LINE_STRING  = "----------------------------------------------------------------------------------";
+
+
+static bool RepeatCommand(CommandManager* pManager, Shell* pShell, int argc, char* argv[])
+{
+    ScriptBlockCapture* pCapture = &s_scriptBlockCapture;
+    ScriptBlock* pBlock;
+    uint64_t count;
+    int first;
+
+
+    if (!ScriptParseRepeat(argc, argv, &count))
+    {
+        pShell->printf("usage: repeat <count> {\n");
+        pShell->printf("           <command> [args]\n");
+        pShell->printf("       }\n");
+        pShell->printf("       repeat <count> { <command> [args] ; <command> [args] }\n");
+        return false;
+    }
+
+    pBlock = (ScriptBlock*)calloc(1, sizeof(ScriptBlock));
+    if (pBlock == nullptr)
+    {
+        pShell->printf("cannot allocate the repeat block\n");
+        return false;
+    }
+
+    pBlock->count = count;
+
+    if (argc == 3)
+    {
+        //lines up to the matching brace are held by ExecuteCommand
+        pCapture->depth = 1;
+        pCapture->bOverflow = false;
+        pCapture->pBlock = pBlock;
+        return true;
+    }
+
+    if (strcmp(argv[argc - 1], "}") != 0)
+    {
+        pShell->printf("missing '}' after repeat %s {\n", argv[1]);
+        free(pBlock);
+        return false;
+    }
+
+    //one line block, commands split on ';'
+    first = 3;
+    for (int i = 3; i < argc; i++)
+    {
+        if ((strcmp(argv[i], ";") == 0) || (i == (argc - 1)))
+        {
+            if ((i > first) && !ScriptBlockAddLine(pBlock, i - first, &argv[first]))
+            {
+                pShell->printf("repeat block too long\n");
+                free(pBlock);
+                return false;
+            }
+
+            first = i + 1;
+        }
+    }
+
+    return ScriptRunBlock(pManager, pShell, pBlock);
+}
 
 
 CommandManager::CommandManager()
@@ -41,6 +2207,9 @@ CommandManager::CommandManager()
 	memset(m_objectCommandTableDescriptors, 0, sizeof(m_objectCommandTableDescriptors));
 	m_numObjectCommandTables = 0;
 
+    //the shell's own pricing engine commands, an application table for the same object adds to them
+    AddObjectCommandTable(PE_OBJECT_STRING, &s_pricingEngineShellData, PE_SHELL_COMMANDS_TABLE, PE_NUM_SHELL_COMMANDS);
+
     ResetCompletion();
 }
 
@@ -99,9 +2268,10 @@ bool CommandManager::AddObjectCommandTable(const char* objectName, void* pObject
 		{
 			pDescriptor = &m_objectCommandTableDescriptors[i];
 
-			if (strcmp(pDescriptor->pObjectName, objectName) == 0)
+			//An object may have several tables (e.g. the application's pricingengine table next to the
+			//shell's own), each with its own object data...but the same table can't be added twice
+			if ((strcmp(pDescriptor->pObjectName, objectName) == 0) && (pDescriptor->pTable == pTable))
 			{
-				//Can't have two tables with the same name...
 				bOKToContinue = false;
 				break;
 			}
@@ -150,6 +2320,13 @@ bool CommandManager::ExecuteCommand(Shell* pShell, int argc, char* argv[])
 
 
 
+    //lines inside an open repeat block are held until its closing brace
+    if (s_scriptBlockCapture.depth > 0)
+    {
+        return ScriptCaptureLine(this, pShell, argc, argv);
+    }
+
+
     //first look to see if the user has typed "help"....
     if (strcmp(HELP_STRING, argv[0]) == 0)
     {
@@ -174,12 +2351,17 @@ bool CommandManager::ExecuteCommand(Shell* pShell, int argc, char* argv[])
     }
     else if (strcmp("date", argv[0]) == 0)
     {
+            bFoundCommand = true;
+            bCommandOK = true;
+
             time_t t = time(NULL);
             struct tm *tm = localtime(&t);
             printf("%s", asctime(tm));
     }
     else if (strcmp("sleep", argv[0]) == 0)
     {
+            bFoundCommand = true;
+
 	    if (argc > 1)
             {
 		    bool validNum = true;
@@ -195,8 +2377,83 @@ bool CommandManager::ExecuteCommand(Shell* pShell, int argc, char* argv[])
 			    long arg = strtol(argv[1], NULL, 10);
                             printf("Sleeping for %s second\n", argv[1]);
                             sleep(arg);
+                            bCommandOK = true;
                     }
             }
+
+            if (!bCommandOK)
+            {
+                pShell->printf("usage: sleep <seconds>\n");
+            }
+    }
+    else if ((strcmp("usleep", argv[0]) == 0) || (strcmp("nsleep", argv[0]) == 0))
+    {
+        uint64_t duration;
+
+        bFoundCommand = true;
+
+        if ((argc > 1) && ParseDecimal(argv[1], &duration))
+        {
+            SleepNs((argv[0][0] == 'u') ? (duration * 1000ull) : duration);
+            bCommandOK = true;
+        }
+        else
+        {
+            pShell->printf("usage: %s <%s>\n", argv[0], (argv[0][0] == 'u') ? "microseconds" : "nanoseconds");
+        }
+    }
+    else if (strcmp("timestamp", argv[0]) == 0)
+    {
+        bFoundCommand = true;
+        bCommandOK = true;
+        pShell->printf("%llu\n", (unsigned long long)MonotonicNs());
+    }
+    else if (strcmp("time", argv[0]) == 0)
+    {
+        uint64_t startNs;
+        uint64_t startCPUNs;
+        uint64_t wallNs;
+        uint64_t cpuNs;
+
+        bFoundCommand = true;
+
+        if (argc > 1)
+        {
+            startCPUNs = CPUTimeNs();
+            startNs = MonotonicNs();
+
+            bCommandOK = ExecuteCommand(pShell, (argc - 1), &argv[1]);
+
+            wallNs = MonotonicNs() - startNs;
+            cpuNs = CPUTimeNs() - startCPUNs;
+
+            PrintDuration(pShell, "real: ", wallNs);
+            PrintDuration(pShell, "cpu:  ", cpuNs);
+        }
+        else
+        {
+            pShell->printf("usage: time <command> [args]\n");
+        }
+    }
+    else if (strcmp("stopwatch", argv[0]) == 0)
+    {
+        bFoundCommand = true;
+        bCommandOK = StopwatchCommand(pShell, argc, argv);
+    }
+    else if (strcmp("sampler", argv[0]) == 0)
+    {
+        bFoundCommand = true;
+        bCommandOK = SamplerCommand(pShell, argc, argv);
+    }
+    else if (strcmp("waituntil", argv[0]) == 0)
+    {
+        bFoundCommand = true;
+        bCommandOK = WaitUntilCommand(pShell, argc, argv);
+    }
+    else if (strcmp("repeat", argv[0]) == 0)
+    {
+        bFoundCommand = true;
+        bCommandOK = RepeatCommand(this, pShell, argc, argv);
     }
     else
     {
@@ -259,8 +2516,16 @@ bool CommandManager::ExecuteCommand(Shell* pShell, int argc, char* argv[])
               
 
 
-                if (!bFoundCommand)
+                //the command is looked up in every table of the object, in the order they were added
+                for (uint32_t j = 0; (j < m_numObjectCommandTables) && !bFoundCommand; j++)
                 {
+                    pObjectCommandTableDescriptor = &m_objectCommandTableDescriptors[j];
+
+                    if (strcmp(pObjectCommandTableDescriptor->pObjectName, argv[0]) != 0)
+                    {
+                        continue;
+                    }
+
                     pTable = pObjectCommandTableDescriptor->pTable;
                     tableLength = pObjectCommandTableDescriptor->tableLength;
 
@@ -296,14 +2561,7 @@ bool CommandManager::ExecuteCommand(Shell* pShell, int argc, char* argv[])
 		}
 		else
 		{
-			if (strcmp("date", argv[0]) == 0 || strcmp("sleep", argv[0]) == 0)
-			{
-				//nothing
-			}	
-			else
-			{	
-				pShell->printf("Unknown command or object: '%s'\n", argv[0]);
-			}
+			pShell->printf("Unknown command or object: '%s'\n", argv[0]);
 		}				
 	}
 
@@ -396,6 +2654,12 @@ void CommandManager::PrintBuiltInCommandHelp(Shell* pShell)
         pShell->printf("| %-15s | %-25s | %-40s |\n", pElement->commandName, pElement->argsListString, pElement->descriptionString);
     }
 
+    for (uint32_t i = 0; i < NUM_SCRIPT_BUILT_INS; i++)
+    {
+        pShell->printf("| %-15s | %-25s | %-40s |\n", SCRIPT_BUILT_INS_TABLE[i].commandName, SCRIPT_BUILT_INS_TABLE[i].argsListString,
+                       SCRIPT_BUILT_INS_TABLE[i].descriptionString);
+    }
+
     pShell->printf("+-%.15s-+-%.25s-+-%.40s-+\n", LINE_STRING, LINE_STRING, LINE_STRING);
 }
 
@@ -431,7 +2695,14 @@ void CommandManager::PrintSingleExternalObjectHelp(Shell* pShell, ObjectCommandT
 {
     PrintExternalObjectHelpTableHeader(pShell);
 
-    PrintExternalObjectHelpTableDataRows(pShell, pDescriptor);
+    //the object's rows come from each of its tables...
+    for (uint32_t i = 0; i < m_numObjectCommandTables; i++)
+    {
+        if (strcmp(m_objectCommandTableDescriptors[i].pObjectName, pDescriptor->pObjectName) == 0)
+        {
+            PrintExternalObjectHelpTableDataRows(pShell, &m_objectCommandTableDescriptors[i]);
+        }
+    }
 
     PrintExternalObjectHelpTableFooter(pShell);
 }
@@ -456,7 +2727,26 @@ void CommandManager::PrintAllExternalObjectsHelp(Shell* pShell)
 
         if (bOKToContinue)
         {
-            PrintExternalObjectHelpTableDataRows(pShell, pDescriptor);
+            //an object with several tables is printed once, at its first table...
+            for (uint32_t j = 0; j < i; j++)
+            {
+                if (strcmp(m_objectCommandTableDescriptors[j].pObjectName, pDescriptor->pObjectName) == 0)
+                {
+                    bOKToContinue = false;
+                    break;
+                }
+            }
+        }
+
+        if (bOKToContinue)
+        {
+            for (uint32_t j = i; j < numObjectCommandTables; j++)
+            {
+                if (strcmp(m_objectCommandTableDescriptors[j].pObjectName, pDescriptor->pObjectName) == 0)
+                {
+                    PrintExternalObjectHelpTableDataRows(pShell, &m_objectCommandTableDescriptors[j]);
+                }
+            }
 
             PrintExternalObjectHelpTableFooter(pShell);
         }
@@ -479,11 +2769,22 @@ void CommandManager::PrintExternalObjectHelpTableDataRows(Shell* pShell, ObjectC
     pTable = pDescriptor->pTable;
     tableLength = pDescriptor->tableLength;
 
+    //the name heads the object's first table only...
+    bool bFirstTable = true;
+    for (uint32_t i = 0; (i < m_numObjectCommandTables) && (&m_objectCommandTableDescriptors[i] != pDescriptor); i++)
+    {
+        if (strcmp(m_objectCommandTableDescriptors[i].pObjectName, pObjectName) == 0)
+        {
+            bFirstTable = false;
+            break;
+        }
+    }
+
     for (uint32_t j = 0; j < tableLength; j++)
     {
         pElement = &pTable[j];
 
-        if (j == 0)
+        if ((j == 0) && bFirstTable)
         {
             pShell->printf("| %-15s | %-20s | %-40s | %-45s |\n", pObjectName, pElement->commandName, pElement->argsListString, pElement->descriptionString);
         }
@@ -562,6 +2863,15 @@ void CommandManager::PrintExternalObjectNamesOnly(Shell* pShell)
         {
             bOKToContinue = GetObjectDescriptor(i, &pDescriptor);
 
+            //an object with several tables is listed once...
+            for (uint32_t j = 0; bOKToContinue && (j < i); j++)
+            {
+                if (strcmp(m_objectCommandTableDescriptors[j].pObjectName, pDescriptor->pObjectName) == 0)
+                {
+                    bOKToContinue = false;
+                }
+            }
+
             if (bOKToContinue)
             {
                 PrintExternalObjectNamesOnlyTableDataRow(pShell, (char*)pDescriptor->pObjectName, i);
@@ -707,8 +3017,19 @@ char* CommandManager::SearchForPartialObjectName(uint32_t startIndex, char* toke
     for (uint32_t i = startIndex; i < m_numObjectCommandTables; i++)
     {
         pDescriptor = &m_objectCommandTableDescriptors[i];
-        
-        if (strlen(pDescriptor->pObjectName) > 0)
+
+        //an object with several tables is offered once, at its first table...
+        bool bRepeatedName = false;
+        for (uint32_t j = 0; j < i; j++)
+        {
+            if (strcmp(m_objectCommandTableDescriptors[j].pObjectName, pDescriptor->pObjectName) == 0)
+            {
+                bRepeatedName = true;
+                break;
+            }
+        }
+
+        if ((strlen(pDescriptor->pObjectName) > 0) && !bRepeatedName)
         {
             if (strncmp(pDescriptor->pObjectName, token, strlen(token)) == 0)
             {
@@ -731,29 +3052,42 @@ char* CommandManager::SearchForPartialObjectCommand(char* objectName, uint32_t s
 {
     char* candidate = nullptr;
     uint32_t tokenLength;
-    bool bFoundDescriptor;
+    uint32_t baseIndex = 0;
     ObjectCommandTableDescriptor* pDescriptor;
 
-    bFoundDescriptor = GetObjectDescriptor(objectName, &pDescriptor);
+    tokenLength = strlen(token);
 
-    if (bFoundDescriptor)
+    //the index runs on through each of the object's tables in turn...
+    for (uint32_t j = 0; (j < m_numObjectCommandTables) && (candidate == nullptr); j++)
     {
-        tokenLength = strlen(token);
+        pDescriptor = &m_objectCommandTableDescriptors[j];
+
+        if (strcmp(pDescriptor->pObjectName, objectName) != 0)
+        {
+            continue;
+        }
 
-        for (uint32_t i = startIndex; i < pDescriptor->tableLength; i++)
+        for (uint32_t i = 0; i < pDescriptor->tableLength; i++)
         {
+            if ((baseIndex + i) < startIndex)
+            {
+                continue;
+            }
+
             if (strlen(pDescriptor->pTable[i].commandName) > 0)
             {
                 if (strncmp(pDescriptor->pTable[i].commandName, token, tokenLength) == 0)
                 {
                     candidate = (char*)pDescriptor->pTable[i].commandName;
 
-                    m_nextCompletionStartIndex = i + 1;
+                    m_nextCompletionStartIndex = baseIndex + i + 1;
 
                     break; //out of loop;
                 }
             }
         }
+
+        baseIndex += pDescriptor->tableLength;
     }
 
 
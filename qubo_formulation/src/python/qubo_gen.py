@@ -22,9 +22,9 @@ def build_log_xrate_dict(problem, cur_lst):
 # Objective: Minimize Q.dot(state).dot(state)
 
 # %%
-def build_Q(problem, cur_lst, M1, M2, mode='QUBO'):
+def build_Q(problem, cur_lst, M1, M2, mode='QUBO', M3=0):
     """
-    Build qubo problem matrix Q from problem, with penalty strengths M1 and M2
+    Build qubo problem matrix Q from problem, with penalty strengths M1, M2 and M3
     
     Parameters:
         problem (List[List[str]]): List of lists that describes all the currency exchange rates
@@ -36,6 +36,7 @@ def build_Q(problem, cur_lst, M1, M2, mode='QUBO'):
         cur_lst (List[str]): List of currencies present in the problem
         M1, M2 (num): Penalty strengths
         mode (str): Output format, defaults to 'QUBO'. 'Ising' can also be specified
+        M3 (num): Cycle length penalty strength, M3 * (number of edges)^2, defaults to 0
     """
     log_xrate_dict = build_log_xrate_dict(problem, cur_lst)
 
@@ -52,10 +53,14 @@ def build_Q(problem, cur_lst, M1, M2, mode='QUBO'):
         v2 = np.array([(k == i) for i, j in var_lst], dtype=int)
         pen2 += np.outer(v2, v2) - np.diag(v2)
 
+    # (sum of x)^2, x * x = x keeps the diagonal
+    v3 = np.ones(N, dtype=int)
+    pen3 = np.outer(v3, v3)
+
     if mode == 'QUBO':
-        return -np.diag([log_xrate_dict[var] for var in var_lst]) + M1 * pen1 + M2 * pen2
+        return -np.diag([log_xrate_dict[var] for var in var_lst]) + M1 * pen1 + M2 * pen2 + M3 * pen3
     if mode == 'Ising':
-        return qubo2ising(-np.diag([log_xrate_dict[var] for var in var_lst]) + M1 * pen1 + M2 * pen2)
+        return qubo2ising(-np.diag([log_xrate_dict[var] for var in var_lst]) + M1 * pen1 + M2 * pen2 + M3 * pen3)
 
 
 # %% [markdown]
@@ -84,79 +84,463 @@ void print_update_msg(T old_energy, T new_energy, int old_step, int new_step,
 
 #endif
 
+// Float bit patterns are read through the to_uint union
+static float bitsToFloat(unsigned int bits) {
+#pragma HLS INLINE
+    to_uint tmp = {0};
+    tmp.u = bits;
+    return tmp.f;
+}
+
+static unsigned int floatToBits(float value) {
+#pragma HLS INLINE
+    to_uint tmp = {0};
+    tmp.f = value;
+    return tmp.u;
+}
+
+// log(1 + (i + 0.5) / 2^LOG_LUT_BITS) and its reciprocal argument
+static const float fastLogLut[1 << LOG_LUT_BITS] = {
+    7.782140281e-03f, 2.316705883e-02f, 3.831886500e-02f, 5.324451625e-02f,
+    6.795065850e-02f, 8.244366944e-02f, 9.672962874e-02f, 1.108143628e-01f,
+    1.247034818e-01f, 1.384023279e-01f, 1.519160420e-01f, 1.652495712e-01f,
+    1.784076542e-01f, 1.913948506e-01f, 2.042155415e-01f, 2.168739438e-01f,
+    2.293740958e-01f, 2.417199314e-01f, 2.539152205e-01f, 2.659635544e-01f,
+    2.778684497e-01f, 2.896333039e-01f, 3.012613356e-01f, 3.127557039e-01f,
+    3.241194785e-01f, 3.353555501e-01f, 3.464667797e-01f, 3.574558794e-01f,
+    3.683255613e-01f, 3.790783584e-01f, 3.897167444e-01f, 4.002431631e-01f,
+    4.106599391e-01f, 4.209693074e-01f, 4.311734736e-01f, 4.412745535e-01f,
+    4.512746334e-01f, 4.611757100e-01f, 4.709797204e-01f, 4.806885421e-01f,
+    4.903039932e-01f, 4.998278618e-01f, 5.092619061e-01f, 5.186077356e-01f,
+    5.278670788e-01f, 5.370414853e-01f, 5.461324453e-01f, 5.551415086e-01f,
+    5.640701652e-01f, 5.729197264e-01f, 5.816917419e-01f, 5.903874636e-01f,
+    5.990082026e-01f, 6.075552702e-01f, 6.160298586e-01f, 6.244332790e-01f,
+    6.327666640e-01f, 6.410312057e-01f, 6.492279172e-01f, 6.573580503e-01f,
+    6.654226184e-01f, 6.734226942e-01f, 6.813592315e-01f, 6.892333031e-01f,
+};
+
+static const float fastLogInv[1 << LOG_LUT_BITS] = {
+    9.922480583e-01f, 9.770992398e-01f, 9.624060392e-01f, 9.481481314e-01f,
+    9.343065619e-01f, 9.208633304e-01f, 9.078013897e-01f, 8.951048851e-01f,
+    8.827586174e-01f, 8.707482815e-01f, 8.590604067e-01f, 8.476821184e-01f,
+    8.366013169e-01f, 8.258064389e-01f, 8.152866364e-01f, 8.050314188e-01f,
+    7.950310707e-01f, 7.852760553e-01f, 7.757575512e-01f, 7.664670944e-01f,
+    7.573964596e-01f, 7.485380173e-01f, 7.398843765e-01f, 7.314285636e-01f,
+    7.231638432e-01f, 7.150837779e-01f, 7.071823478e-01f, 6.994535327e-01f,
+    6.918919086e-01f, 6.844919920e-01f, 6.772486567e-01f, 6.701570749e-01f,
+    6.632124186e-01f, 6.564102769e-01f, 6.497461796e-01f, 6.432160735e-01f,
+    6.368159056e-01f, 6.305418611e-01f, 6.243902445e-01f, 6.183574796e-01f,
+    6.124401689e-01f, 6.066350937e-01f, 6.009389758e-01f, 5.953488350e-01f,
+    5.898617506e-01f, 5.844748616e-01f, 5.791855454e-01f, 5.739910603e-01f,
+    5.688889027e-01f, 5.638766289e-01f, 5.589519739e-01f, 5.541125536e-01f,
+    5.493562222e-01f, 5.446808338e-01f, 5.400843620e-01f, 5.355648398e-01f,
+    5.311203599e-01f, 5.267489552e-01f, 5.224489570e-01f, 5.182186365e-01f,
+    5.140562057e-01f, 5.099601746e-01f, 5.059288740e-01f, 5.019608140e-01f,
+};
+
+float fastLog(ap_uint<32> src) {
+#pragma HLS INLINE
+    // src is the bit pattern of a positive normal float x = 2^e * m with m in
+    // [1, 2). The top mantissa bits select the interval centre c, m = c * (1 + r)
+    // with |r| < 2^-(LOG_LUT_BITS + 1), and log(1 + r) is a short polynomial.
+    int e = (int)src.range(30, 23).to_uint() - 127;
+    ap_uint<LOG_LUT_BITS> i = src.range(22, 23 - LOG_LUT_BITS);
+    float m = bitsToFloat((127u << 23) | src.range(22, 0).to_uint());
+
+    float r = m * fastLogInv[i] - 1.0f;
+    float p = r * (1.0f - r * (0.5f - r * (1.0f / 3)));
+
+    return e * FAST_LOG_LN2 + fastLogLut[i] + p;
+}
+
 /**
  * PricingEngine Core
  */
 
+void PricingEngine::cycleCounter(cycleStream_t &pullClock,
+                                 cycleStream_t &updateClock,
+                                 cycleStream_t &solveClock,
+                                 cycleStream_t &pushClock,
+                                 cycleStream_t &latchClock) {
+#pragma HLS PIPELINE II = 1 style = flp
+
+    static ap_uint<64> cycle = 0;
+
+    ++cycle;
+
+    offerCycle(pullClock, cycle);
+    offerCycle(updateClock, cycle);
+    offerCycle(solveClock, cycle);
+    offerCycle(pushClock, cycle);
+    offerCycle(latchClock, cycle);
+
+    return;
+}
+
 void PricingEngine::responsePull(
-    ap_uint<32> &regRxResponse,
     orderBookResponseStreamPack_t &responseStreamPack,
-    orderBookResponseStream_t &responseStream) {
+    orderBookResponseStream_t &responseStream, cycleStream_t &ingressStream,
+    counterStream_t &statusStream, cycleStream_t &clockStream) {
 #pragma HLS PIPELINE II = 1 style = flp
 
     mmInterface intf;
     orderBookResponsePack_t responsePack;
     orderBookResponse_t response;
 
-    static ap_uint<32> countRxResponse = 0;
+    static ap_uint<64> countRxResponse = 0;
 
-    if (!responseStreamPack.empty()) {
+    // drain the whole burst, the conflation in problemUpdate keeps it cheap
+    while (!responseStreamPack.empty()) {
         responsePack = responseStreamPack.read();
         intf.orderBookResponseUnpack(&responsePack, &response);
         responseStream.write(response);
+        ingressStream.write(sampleCycle(clockStream));
         ++countRxResponse;
     }
 
-    regRxResponse = countRxResponse;
+    statusStream.write(countRxResponse);
+
+    return;
+}
+
+void PricingEngine::problemUpdate(ap_uint<32> &regSchedule,
+                                  ap_uint<32> &regSolveInterval,
+                                  ap_uint<32> &regStaleAge,
+                                  ap_uint<32> &regRebuildPeriod,
+                                  pricingEngineRegCost_t *regCosts,
+                                  orderBookResponseStream_t &responseStream,
+                                  cycleStream_t &ingressStream,
+                                  solveTriggerStream_t &triggerStream,
+                                  isingProblemStream_t &problemStream,
+                                  updateStatusStream_t &statusStream,
+                                  cycleStream_t &clockStream) {
+    orderBookResponse_t response;
+    isingProblem_t problem;
+    pricingEngineUpdateStatus_t status;
+    ap_uint<8> symbolIndex = 0;
+    ap_uint<64> tickTimestamp;
+    ap_uint<64> tickCycle;
+    bool timerMode = (regSchedule & PE_SCHEDULE_TIMER);
+    bool idle = true;
+    ap_uint<32> rebuildPeriod = (regRebuildPeriod != 0)
+                                    ? regRebuildPeriod
+                                    : (ap_uint<32>)FIELD_REBUILD_PERIOD;
+
+    static ap_uint<64> countProcessResponse = 0;
+    static ap_uint<64> countConflateResponse = 0;
+
+    // Solve scheduling, a tick arms the trigger once the minimum interval
+    // since the last triggered solve has elapsed, held until it is used
+    static bool trigger = false;
+    static ap_uint<64> triggerTimestamp = 0;
+    static ap_uint<64> lastSolveTimestamp = 0;
+    static ap_uint<32> countRateTick = 0;
+    static ap_uint<32> countRateSolve = 0;
+    static ap_uint<32> solveRate = 0;
+
+    // Pull cycle of the oldest response not yet in a snapshot
+    static ap_uint<64> ingressCycle = 0;
+    static bool ingressValid = false;
+    ap_uint<64> ingress;
+
+    /* ERM debug signals */
+    static bool regERMInitConstr = false;
+
+    // Shadow copy of the rate dependent part of J, ERM keeps folding market
+    // updates in here while the solver anneals on the snapshot it picked up
+    static float exch_logged_rates[physical_bits - 1] = {0};
+    static float ancilla[physical_bits] = {0};
+    static orderBookResponse_t latestResponse;
+    static bool pending = false;
+
+    // Constraint part of the ancilla column, the exact column is
+    // ancilla_constraint - logged rate / 4. The incremental update drifts with
+    // float rounding, so the column is rebuilt from here once rebuildPeriod
+    // edge updates have been applied and no market update is in flight
+    static float ancilla_constraint[physical_bits] = {0};
+    static bool init_field = false;
+    static ap_uint<32> countFieldUpdate = 0;
+    static float fieldDrift = 0;
+
+    // Conflation book, latest top of book per symbol not yet folded into J,
+    // unseen marks symbols updated since the solver took the last snapshot
+    static pricingEngineCacheEntry_t book[NUM_PAIRS];
+    static ap_uint<NUM_PAIRS> dirty = 0;
+    static ap_uint<NUM_PAIRS> unseen = 0;
+    static pricingEngineDepth_t depth[NUM_PAIRS];
+#pragma HLS ARRAY_PARTITION variable = book dim = 1 type = complete
+#pragma HLS ARRAY_PARTITION variable = depth dim = 1 type = complete
+
+    // Quote staleness, pull cycle of the last update per edge and the edges
+    // expired by the sweep, stale edges are clamped off in the snapshot only
+    // so that the shadow ancilla column is restored as soon as the pair quotes
+    // again
+    static ap_uint<64> edgeCycle[physical_bits - 1] = {0};
+    static ap_uint<physical_bits - 1> stale = 0;
+    static bool restage = false;
+#pragma HLS ARRAY_PARTITION variable = edgeCycle dim = 1 type = complete
+
+    if (!init_field) {
+        ERMAncillaConstraint(QUBO_M1, QUBO_M2, QUBO_M3, ancilla_constraint);
+        init_field = true;
+    }
+
+    DRAIN_RESPONSE:
+    while (!responseStream.empty()) {
+#pragma HLS PIPELINE II = 1
+        response = responseStream.read();
+        ingress = ingressStream.read();
+        ++countProcessResponse;
+        idle = false;
+        if (!ingressValid) {
+            ingressCycle = ingress;
+            ingressValid = true;
+        }
+
+        // symbols outside of the Ising model are of no use to the solver
+        symbolIndex = response.symbolIndex;
+        if (symbolIndex < NUM_PAIRS) {
+            // an update the solver has not seen yet is superseded
+            if (unseen[symbolIndex]) {
+                ++countConflateResponse;
+            }
+            book[symbolIndex].bidPrice = response.bidPrice.range(31, 0);
+            book[symbolIndex].askPrice = response.askPrice.range(31, 0);
+            book[symbolIndex].valid = true;
+            depth[symbolIndex].bidPrice = response.bidPrice;
+            depth[symbolIndex].bidQuantity = response.bidQuantity;
+            depth[symbolIndex].askPrice = response.askPrice;
+            depth[symbolIndex].askQuantity = response.askQuantity;
+            dirty[symbolIndex] = 1;
+            unseen[symbolIndex] = 1;
+            latestResponse = response;
+
+            // *2 => bid *2+1 => ask, aged on the kernel clock and not on
+            // the exchange timestamp of the response
+            edgeCycle[symbolIndex * 2] = ingress;
+            edgeCycle[symbolIndex * 2 + 1] = ingress;
+            if (stale.range(symbolIndex * 2 + 1, symbolIndex * 2) != 0) {
+                stale.range(symbolIndex * 2 + 1, symbolIndex * 2) = 0;
+                restage = true;
+            }
+        }
+    }
+
+    if (!triggerStream.empty()) {
+        tickTimestamp = triggerStream.read();
+        if (!trigger && tickTimestamp - lastSolveTimestamp >= regSolveInterval) {
+            trigger = true;
+            triggerTimestamp = tickTimestamp;
+        }
+
+        // solves handed over during the last SOLVE_RATE_TICKS clock ticks
+        if (++countRateTick == SOLVE_RATE_TICKS) {
+            solveRate = countRateSolve;
+            countRateTick = 0;
+            countRateSolve = 0;
+        }
+
+        // expiry sweep, a zero age disables expiry
+        tickCycle = sampleCycle(clockStream);
+        EXPIRE_EDGE:
+        for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+            if (regStaleAge != 0 && !stale[i] &&
+                tickCycle - edgeCycle[i] > regStaleAge) {
+                stale[i] = 1;
+                restage = true;
+            }
+        }
+    }
+
+    // Apply ERM once for every dirty symbol, repeated updates of a symbol in
+    // a burst are folded into the ancilla column only once. The symbol loop
+    // stays rolled, ERM pipelines its own edge loops
+    if (dirty != 0) {
+        APPLY_DIRTY:
+        for (int s = 0; s < NUM_PAIRS; s++) {
+            if (dirty[s]) {
+                // *2 => bid *2+1 => ask
+                int exch_id = s * 2;
+                // NOTE: input data are float bit patterns, bid and ask are
+                // converted by two independent fast log units. The edge cost
+                // is taken off so the annealer sees net rates, a new cost
+                // table applies from the next update of the pair
+                float logged_bid = fastLog(book[s].bidPrice) -
+                                   bitsToFloat(regCosts[s].bidCost.to_uint());
+                float logged_ask = fastLog(book[s].askPrice) -
+                                   bitsToFloat(regCosts[s].askCost.to_uint());
+
+                ERM(exch_id, logged_bid, QUBO_M1, QUBO_M2, QUBO_M3, ancilla,
+                    exch_logged_rates, regERMInitConstr);
+                ERM(exch_id + 1, logged_ask, QUBO_M1, QUBO_M2, QUBO_M3, ancilla,
+                    exch_logged_rates, regERMInitConstr);
+                countFieldUpdate += 2;
+            }
+        }
+        dirty = 0;
+        pending = true;
+    } else if (idle && countFieldUpdate >= rebuildPeriod) {
+        // background rebuild, also records the largest drift corrected so far
+        REBUILD_FIELD:
+        for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+            float exact = ancilla_constraint[i] - exch_logged_rates[i] / 4;
+            float drift = fabs(ancilla[i] - exact);
+            if (drift > fieldDrift) {
+                fieldDrift = drift;
+            }
+            ancilla[i] = exact;
+        }
+        countFieldUpdate = 0;
+    }
+
+    // Once the solver has taken the previous snapshot hand over a new one, so
+    // a burst costs a single solve. In timer mode market updates only refresh
+    // the ancilla column until a tick fires.
+    if ((pending || restage) && !problemStream.full() &&
+        (!timerMode || trigger)) {
+        pending = false;
+        restage = false;
+
+        // Make sure there are no empty price fields
+        if (exch_logged_rates[physical_bits - 2]) {
+            problem.response = latestResponse;
+            // a snapshot restaged by the expiry sweep alone has no response
+            // behind it
+            problem.ingress = ingressValid ? ingressCycle : (ap_uint<64>)0;
+            ingressValid = false;
+            for (int i = 0; i < physical_bits; i++) {
+#pragma HLS UNROLL
+                // a large positive coupling to the ancilla keeps a stale edge
+                // out of the cycle
+                problem.ancilla[i] = ancilla[i];
+                if (i < physical_bits - 1 && stale[i]) {
+                    problem.ancilla[i] += STALE_CLAMP;
+                }
+            }
+            for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+                problem.exch_logged_rates[i] = exch_logged_rates[i];
+            }
+            for (int s = 0; s < NUM_PAIRS; s++) {
+#pragma HLS UNROLL
+                problem.book[s] = book[s];
+                problem.depth[s] = depth[s];
+                problem.cost[s * 2] = bitsToFloat(regCosts[s].bidCost.to_uint());
+                problem.cost[s * 2 + 1] =
+                    bitsToFloat(regCosts[s].askCost.to_uint());
+            }
+            problemStream.write(problem);
+            unseen = 0;
+            ++countRateSolve;
+            if (trigger) {
+                lastSolveTimestamp = triggerTimestamp;
+                trigger = false;
+            }
+        }
+    }
+
+    status.processResponse = countProcessResponse;
+    status.conflateResponse = countConflateResponse;
+    status.solveRate = solveRate;
+    status.staleEdge = stale;
+    status.fieldDrift = floatToBits(fieldDrift);
+    status.strategyNone = regERMInitConstr;
+    statusStream.write(status);
 
     return;
 }
 
 void PricingEngine::pricingProcess(
-    ap_uint<32> &regStrategyControl, ap_uint<32> &regProcessResponse,
-    ap_uint<32> &regStrategyNone, ap_uint<32> &regStrategyPeg,
-    ap_uint<32> &regStrategyLimit, ap_uint<32> &regStrategyUnknown,
+    ap_uint<32> &regStrategyControl, ap_uint<32> &regDedupAge,
+    ap_uint<32> &regRepriceThreshold, ap_uint<32> &regSchedule,
+    ap_uint<32> &regSolveBudget, ap_uint<32> &regConvergeSweeps,
     pricingEngineRegStrategy_t *regStrategies,
-    orderBookResponseStream_t &responseStream,
-    orderEntryOperationStream_t &operationStream) {
+    isingProblemStream_t &problemStream,
+    orderEntryOperationStream_t &operationStream,
+    solveStampStream_t &stampStream, solveStatusStream_t &statusStream,
+    cycleStream_t &clockStream) {
 #pragma HLS PIPELINE II = 1 style = flp
 
     mmInterface intf;
+    isingProblem_t problem;
     orderBookResponse_t response;
     orderEntryOperation_t operation;
+    pricingEngineSolveStamp_t stamp;
+    pricingEngineSolveStatus_t status;
     ap_uint<8> symbolIndex = 0;
     ap_uint<8> strategySelect = 0;
     ap_uint<8> thresholdEnable = 0;
     ap_uint<8> thresholdPosition = 0;
+    ap_uint<32> legQuantity[physical_bits - 1];
+    ap_uint<BASKET_LEG_BITS> legCount = 0;
+    ap_uint<BASKET_LEG_BITS> sendCount = 0;
+    ap_uint<8> verdict = 0;
+    ap_uint<64> solveStart = 0;
     // bool orderExecute = false;
 
-    static float exch_logged_rates[physical_bits - 1] = {0};
-    static ap_uint<32> orderId = 0;
-    static ap_uint<32> countProcessResponse = 0;
+    // Top of book of every symbol as of the snapshot, each leg is priced from
+    // its own symbol
+    pricingEngineCacheEntry_t top[NUM_PAIRS];
+    ap_uint<physical_bits - 1> legs = 0;
+    ap_uint<32> legPrice[physical_bits - 1];
+#pragma HLS ARRAY_PARTITION variable = top dim = 1 type = complete
+#pragma HLS ARRAY_PARTITION variable = legPrice dim = 1 type = complete
+#pragma HLS ARRAY_PARTITION variable = legQuantity dim = 1 type = complete
+
+    static ap_uint<64> countBasket = 0;
+    static ap_uint<64> countSolveProblem = 0;
     // static ap_uint<32> countStrategyNone = 0;
     // static ap_uint<32> countStrategyPeg = 0;
     // static ap_uint<32> countStrategyLimit = 0;
     // static ap_uint<32> countStrategyUnknown = 0;
-    /* ERM / SBM debug signals */
-    static bool regERMInitConstr = false;
-    static ap_uint<32> countAncillaFlip = 0;
+    /* SBM debug signals */
+    static ap_uint<64> countAncillaFlip = 0;
     static ap_uint<32> regSBMExecStatus = 0;
-
-    // Start of QUBO formulation parameters
-    const float M1 = 10; // 50;
-    const float M2 = 10; // 25;
+    static ap_uint<32> settleStep = 0;
+    static ap_uint<32> executedStep = 0;
+    static ap_uint<32> solutionSpin = 0;
+
+    // Solution quality
+    static ap_uint<physical_bits - 1> lastLegs = 0;
+    static ap_uint<64> countAllZero = 0;
+    static ap_uint<64> countNoCycle = 0;
+    static ap_uint<64> countCycle = 0;
+    static ap_uint<64> countProfitable = 0;
+    static ap_uint<64> countSpinFlip = 0;
+    ap_uint<physical_bits - 1> flipped = 0;
+    ap_uint<8> countFlipped = 0;
 
     // For SQA ONLY
     // static J[physical_bits][physical_bits];
     // static h[physical_bits] = {0};
 
     // For SBM ONLY
-    const int steps = 10; // dt * steps = 100 (0.1 * 1000) will converge
+    // dt * steps = 100 (0.1 * 1000) will converge, an anytime solve runs the
+    // steps of its budget
+    bool anytime = (regSolveBudget != 0 || regConvergeSweeps != 0);
+    int steps = (regSolveBudget == 0) ? SBM_STEPS
+              : (regSolveBudget > SBM_MAX_STEPS) ? SBM_MAX_STEPS
+              : (int)regSolveBudget;
+    int executed = 0;
     const float dt = 0.5;
     const float a0 = 1.;
     //const float c0 = 0.000636366292;
     const float c0 = 0.033613;
     static float J[physical_bits][physical_bits] = {0};
+    static bool init_constraint = false;
+
+    // Solution memo keyed by the sign pattern of the ancilla column
+    static pricingEngineMemoEntry_t memo[MEMO_DEPTH];
+    static ap_uint<8> memoNext = 0;
+    static ap_uint<32> countMemoHit = 0;
+    static ap_uint<32> countMemoReject = 0;
+    bool memoEnable = (regSchedule & PE_SCHEDULE_MEMO);
+    bool memoHit = false;
+    ap_uint<physical_bits - 1> signature = 0;
+    int slot = -1;
+#pragma HLS ARRAY_PARTITION variable = memo dim = 1 type = complete
     float spin_x[physical_bits] = {0};
     float spin_y[physical_bits] = {0};
 
@@ -166,10 +550,18 @@ void PricingEngine::pricingProcess(
     }
     // spin_y[physical_bits - 1] = -0.1;
 
+    // The constraint part of J never changes, build it once
+    if (!init_constraint) {
+        ERMConstraint(QUBO_M1, QUBO_M2, QUBO_M3, J);
+        init_constraint = true;
+    }
+
     // Start of original AAT code
-    if (!responseStream.empty()) {
-        response = responseStream.read();
-        ++countProcessResponse;
+    if (!problemStream.empty()) {
+        problem = problemStream.read();
+        solveStart = sampleCycle(clockStream);
+        response = problem.response;
+        ++countSolveProblem;
 
         symbolIndex = response.symbolIndex;
         thresholdEnable = regStrategies[symbolIndex].enable.range(7, 0);
@@ -205,128 +597,257 @@ void PricingEngine::pricingProcess(
         // }
         // end of original aat code
 
-        // *2 => bid *2+1 => ask
-        int exch_id = ((int)response.symbolIndex) * 2;
-        // NOTE: input data originally is uint and we static_cast it to float
-        unsigned int bidprice = response.bidPrice.range(31, 0);
-        unsigned int askprice = response.askPrice.range(31, 0);
+        float *exch_logged_rates = problem.exch_logged_rates;
         dcal_t best_energy = MAXFLOAT;
         int best_step = 0;
         bool best_spin[physical_bits] = {0};
 
-        ERM(exch_id, log(reinterpret_cast<float &>(bidprice)), M1, M2, J, exch_logged_rates, regERMInitConstr);
-        ERM(exch_id + 1, log(reinterpret_cast<float &>(askprice)), M1, M2, J, exch_logged_rates, regERMInitConstr);
+        // Swap in the active ancilla column, problemUpdate keeps writing its
+        // shadow copy
+        for (unsigned int i = 0; i < physical_bits - 1; i++) {
+            J[i][physical_bits - 1] = problem.ancilla[i];
+            J[physical_bits - 1][i] = problem.ancilla[i];
+        }
+        LOAD_TOP:
+        for (int s = 0; s < NUM_PAIRS; s++) {
+#pragma HLS UNROLL
+            top[s] = problem.book[s];
+        }
 
-        // Run SBM if there are no empty price fields
-        if (exch_logged_rates[physical_bits - 2]) {
 #ifndef __SYNTHESIS__
-            // Coefficient check
-            checkSBMCoeff<float>(J, c0);
-
-            // Brute-force the best solution
-            std::cout << "Brute-force calculation\n";
-            bool best_spin_bf[physical_bits] = {0};
-            bool spin_bf[physical_bits] = {0};
-            float best_energy_bf = MAXFLOAT;
-            float energy_bf = MAXFLOAT;
-            long long bf_iteration = pow(2, physical_bits);
-            if (bf_iteration == 0) {
-                std::cerr << "Too many spins (" << physical_bits << ")" << ";\n"
-                        << "Skip brute-force solution calculation\n";
-            } else {
-                long long iteration = 1;
-                while (iteration < bf_iteration) {
-                    ++iteration;
-                    full_adder_plus_1(physical_bits, spin_bf);
-                    if (spin_bf[physical_bits - 1] == 0) { continue; }
-                    calc_energy(spin_bf, J, energy_bf);
-                    if (energy_bf < best_energy_bf) {
-                        best_energy_bf = energy_bf;
+        // Coefficient check
+        checkSBMCoeff<float>(J, c0);
+
+        // Brute-force the best solution
+        std::cout << "Brute-force calculation\n";
+        bool best_spin_bf[physical_bits] = {0};
+        bool spin_bf[physical_bits] = {0};
+        float best_energy_bf = MAXFLOAT;
+        float energy_bf = MAXFLOAT;
+        long long bf_iteration = pow(2, physical_bits);
+        if (bf_iteration == 0) {
+            std::cerr << "Too many spins (" << physical_bits << ")" << ";\n"
+                    << "Skip brute-force solution calculation\n";
+        } else {
+            long long iteration = 1;
+            while (iteration < bf_iteration) {
+                ++iteration;
+                full_adder_plus_1(physical_bits, spin_bf);
+                if (spin_bf[physical_bits - 1] == 0) { continue; }
+                calc_energy(spin_bf, J, energy_bf);
+                if (energy_bf < best_energy_bf) {
+                    best_energy_bf = energy_bf;
+                    for (int i = 0; i < physical_bits; i++) {
+                        best_spin_bf[i] = spin_bf[i];
+                    }
+                } else if (energy_bf == best_energy_bf) {
+                    if (checkSBMSolution(spin_bf, exch_logged_rates)) {
                         for (int i = 0; i < physical_bits; i++) {
                             best_spin_bf[i] = spin_bf[i];
                         }
-                    } else if (energy_bf == best_energy_bf) {
-                        if (checkSBMSolution(spin_bf, exch_logged_rates)) {
-                            for (int i = 0; i < physical_bits; i++) {
-                                best_spin_bf[i] = spin_bf[i];
-                            }
-                        }
                     }
                 }
-                if (best_spin_bf[physical_bits - 1] == 0) {
-                    for (unsigned int i = 0; i < physical_bits - 1; i++) {
-                        best_spin_bf[i] = 1 - best_spin_bf[i];
-                    }
+            }
+            if (best_spin_bf[physical_bits - 1] == 0) {
+                for (unsigned int i = 0; i < physical_bits - 1; i++) {
+                    best_spin_bf[i] = 1 - best_spin_bf[i];
                 }
-                std::cout << "Best energy: " << best_energy_bf << "\n";
-                std::cout << "Best spin  : ";
-                print_vec<bool, physical_bits>(best_spin_bf, physical_bits - 1, std::cout);
-                checkSBMSolution(best_spin_bf, exch_logged_rates);
-
-                // A solution we found for the testbench
-                // bool spin_theo[physical_bits] = {0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1};
-                // calc_energy(spin_theo, J, energy_bf);
-                // std::cout << "Theo energy: " << energy_bf << "\n";
-                // std::cout << "Theo spin  : ";
-                // print_vec<bool, physical_bits>(spin_theo, physical_bits - 1, std::cout);
-                // checkSBMSolution(spin_theo, exch_logged_rates);
             }
-            std::cout << "End of brute-force calculation\n\n";
+            std::cout << "Best energy: " << best_energy_bf << "\n";
+            std::cout << "Best spin  : ";
+            print_vec<bool, physical_bits>(best_spin_bf, physical_bits - 1, std::cout);
+            checkSBMSolution(best_spin_bf, exch_logged_rates);
+
+            // A solution we found for the testbench
+            // bool spin_theo[physical_bits] = {0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+            // calc_energy(spin_theo, J, energy_bf);
+            // std::cout << "Theo energy: " << energy_bf << "\n";
+            // std::cout << "Theo spin  : ";
+            // print_vec<bool, physical_bits>(spin_theo, physical_bits - 1, std::cout);
+            // checkSBMSolution(spin_theo, exch_logged_rates);
+        }
+        std::cout << "End of brute-force calculation\n\n";
 #endif
+        // A solution cached for the same sign pattern of the ancilla column is
+        // taken over when it is still a local minimum, so a tick that cannot
+        // move the optimum skips SBM
+        if (memoEnable) {
+            MEMO_SIGNATURE:
+            for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+                signature[i] = (problem.ancilla[i] < 0);
+            }
+            MEMO_LOOKUP:
+            for (int d = 0; d < MEMO_DEPTH; d++) {
+#pragma HLS UNROLL
+                if (memo[d].valid && memo[d].signature == signature) slot = d;
+            }
+            if (slot >= 0) {
+                for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+                    best_spin[i] = memo[slot].spins[i];
+                }
+                best_spin[physical_bits - 1] = 1;
+                memoHit = isLocalMinimum(best_spin, J);
+                if (memoHit) {
+                    ++countMemoHit;
+                } else {
+                    ++countMemoReject;
+                }
+            }
+        }
+
+        if (memoHit) {
+            settleStep = 0;
+            executedStep = 0;
+        } else {
             // RUN SBM
 #ifndef __SYNTHESIS__
             std::cout << "Start SBM execution\n";
 #endif
-            SBM(J, spin_y, spin_x, steps, dt, c0, best_energy, best_step, best_spin, regSBMExecStatus);
+            SBM(J, spin_y, spin_x, steps, dt, c0, best_energy, best_step,
+                best_spin, regSBMExecStatus, regConvergeSweeps, anytime,
+                executed);
+            settleStep = best_step;
+            executedStep = executed;
+        }
 
-#ifndef __SYNTHESIS__
-        calc_energy(best_spin, J, best_energy);
-#endif
+        // energy of the readout, memo hits and fixed runs included, for the
+        // decision trace and the solution record
+        best_energy = isingEnergy(best_spin, J);
 
-            // In this problem, if the SBM ancilla spin is -1,
-            // we flip all the other spins
-            if (best_spin[physical_bits - 1] == 0) {
-                ++countAncillaFlip;
-                for (unsigned int i = 0; i < physical_bits - 1; i++) {
-                    best_spin[i] = 1 - best_spin[i];
-                }
+        // In this problem, if the SBM ancilla spin is -1,
+        // we flip all the other spins
+        if (best_spin[physical_bits - 1] == 0) {
+            ++countAncillaFlip;
+            for (unsigned int i = 0; i < physical_bits - 1; i++) {
+                best_spin[i] = 1 - best_spin[i];
             }
+        }
 
-            regStrategyUnknown = 0;
-            // Should assert(physical_bits <= 32);
-            // but HLS can't assert
-            for (unsigned int i = 0; i < physical_bits; i++) {
-                if (best_spin[i]) {
-                    regStrategyUnknown.invert(i);
-                }
+        // a rejected entry is refreshed in place, a new pattern replaces round
+        // robin
+        if (memoEnable && !memoHit) {
+            if (slot < 0) {
+                slot = memoNext;
+                memoNext = (memoNext + 1 == MEMO_DEPTH) ? (ap_uint<8>)0
+                                                        : (ap_uint<8>)(memoNext + 1);
             }
+            memo[slot].signature = signature;
+            MEMO_STORE:
+            for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+                memo[slot].spins[i] = best_spin[i];
+            }
+            memo[slot].valid = true;
+        }
+
+        solutionSpin = 0;
+        // Should assert(physical_bits <= 32);
+        // but HLS can't assert
+        for (unsigned int i = 0; i < physical_bits; i++) {
+            if (best_spin[i]) {
+                solutionSpin.invert(i);
+            }
+        }
 
 #ifndef __SYNTHESIS__
-            std::cout << "Final energy: " << best_energy << "\n";
-            std::cout << "Final spin  : ";
-            print_vec<bool, physical_bits>(best_spin, physical_bits-1, std::cout);
+        std::cout << "Final energy: " << best_energy << "\n";
+        std::cout << "Final spin  : ";
+        print_vec<bool, physical_bits>(best_spin, physical_bits-1, std::cout);
 
-            checkSBMSolution(best_spin, exch_logged_rates);
-            std::cout << "End of SBM execution\n\n";
+        checkSBMSolution(best_spin, exch_logged_rates);
+        std::cout << "End of SBM execution\n\n";
 #endif
 
+        // every cycle of the spins is sized to the largest notional the book
+        // depth can fill while it stays profitable, the legs of a cycle that
+        // is not profitable even at the top of book are left out
+        sendCount = sizeCycle(best_spin, problem.depth, problem.cost, legQuantity);
+
+        // every leg carries the basket ID and the count of legs sent so that
+        // order entry can tell where a basket ends
+        COUNT_LEG:
+        for (unsigned int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+            legCount += best_spin[i];
+            legs[i] = best_spin[i];
+            legPrice[i] = (i & 1) ? top[i / 2].askPrice : top[i / 2].bidPrice;
+        }
+        verdict = (legCount == 0)  ? PE_VERDICT_NONE
+                : (sendCount == 0) ? PE_VERDICT_REJECT
+                                   : PE_VERDICT_SEND;
+
+        // quality of the spins as solved, before duplicate suppression
+        if (legCount == 0) {
+            ++countAllZero;
+        } else if (!checkExchCycle(best_spin)) {
+            ++countNoCycle;
+        } else {
+            ++countCycle;
+            if (sendCount != 0) ++countProfitable;
+        }
+        flipped = legs ^ lastLegs;
+        COUNT_FLIP:
+        for (unsigned int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS UNROLL
+            countFlipped += flipped[i];
+        }
+        countSpinFlip += countFlipped;
+        lastLegs = legs;
+
+        // the same cycle at the same prices is already in flight
+        if (sendCount != 0 &&
+            dedupBasket(legs, legPrice, response.timestamp, regDedupAge,
+                        regRepriceThreshold)) {
+            sendCount = 0;
+            verdict = PE_VERDICT_SUPPRESS;
+        }
+        if (sendCount != 0) {
+            ++countBasket;
+        }
+        if (memoHit) verdict |= PE_VERDICT_MEMO;
+
+        // the end of the solve goes ahead of its legs, with what the decision
+        // trace keeps of it
+        stamp.ingress = (problem.ingress != 0) ? problem.ingress : solveStart;
+        stamp.solveStart = solveStart;
+        stamp.solveEnd = sampleCycle(clockStream);
+        stamp.legs = sendCount;
+        stamp.timestamp = response.timestamp;
+        stamp.symbol = symbolIndex;
+        stamp.verdict = verdict;
+        stamp.hBid = 0;
+        stamp.hAsk = 0;
+        if (symbolIndex < NUM_PAIRS) {
+            stamp.hBid = floatToBits(problem.ancilla[symbolIndex * 2]);
+            stamp.hAsk = floatToBits(problem.ancilla[symbolIndex * 2 + 1]);
+        }
+        stamp.spins = 0;
+        TRACE_SPIN:
+        for (unsigned int i = 0; i < physical_bits; i++) {
+#pragma HLS UNROLL
+            stamp.spins[i] = best_spin[i];
+        }
+        stamp.energy = floatToBits(best_energy);
+        stamp.iterations = (executedStep > 0xffff) ? (ap_uint<16>)0xffff
+                                                   : (ap_uint<16>)executedStep;
+        stampStream.write(stamp);
+
         // Write orderResponse if there are no empty price fields
-            for (unsigned int i = 0; i < physical_bits - 1; i++) {
-                if (best_spin[i] > 0) {
-                    operation.orderId = ++orderId;
-                    operation.timestamp = response.timestamp;
-                    operation.opCode = ORDERENTRY_ADD;
-                    operation.quantity = 1;  // change to 1
-                    operation.symbolIndex = i / 2;
-                    if ((i & 1) == 1) {  // direction ask
-                        operation.price = response.askPrice.range(31, 0);
-                        operation.direction = ORDER_ASK;
-                    } else {  // direction bid
-                        operation.price = (response.bidPrice.range(31, 0));
-                        operation.direction = ORDER_BID;
-                    }
-                    operationStream.write(operation);
+        for (unsigned int i = 0; i < physical_bits - 1; i++) {
+            if (sendCount != 0 && legQuantity[i] != 0) {
+                operation.timestamp = response.timestamp;
+                operation.opCode = ORDERENTRY_ADD;
+                operation.quantity = legQuantity[i];
+                operation.symbolIndex = i / 2;
+                operation.price = legPrice[i];
+                if ((i & 1) == 1) {  // direction ask
+                    operation.direction = ORDER_ASK;
+                } else {  // direction bid
+                    operation.direction = ORDER_BID;
                 }
+                operationStream.write(operation);
             }
         }
         // if (orderExecute) {
@@ -335,19 +856,226 @@ void PricingEngine::pricingProcess(
         // }
     }
 
-    regProcessResponse = countProcessResponse;
     // regStrategyNone = countStrategyNone;
     // regStrategyPeg = countStrategyPeg;
     // regStrategyLimit = countStrategyLimit;
     // regStrategyUnknown = countStrategyUnknown;
-    regStrategyNone = regERMInitConstr;
-    regStrategyPeg = regSBMExecStatus;
-    regStrategyLimit = countAncillaFlip;
-    // regStrategyUnknown = 0;
+    status.solveProblem = countSolveProblem;
+    status.strategyPeg = regSBMExecStatus;
+    status.strategyLimit = countAncillaFlip;
+    status.strategyUnknown = solutionSpin;
+    status.debug = settleStep;
+    status.annealIter = executedStep;
+    status.suppressBasket = countSuppressBasket;
+    status.repriceBasket = countRepriceBasket;
+    status.memoHit = countMemoHit;
+    status.memoReject = countMemoReject;
+    status.qualityAllZero = countAllZero;
+    status.qualityNoCycle = countNoCycle;
+    status.qualityCycle = countCycle;
+    status.qualityProfitable = countProfitable;
+    status.qualitySpinFlip = countSpinFlip;
+    status.qualityAncillaFlip = countAncillaFlip;
+    status.txBasket = countBasket;
+    statusStream.write(status);
 
     return;
 }
 
+bool PricingEngine::dedupBasket(ap_uint<physical_bits - 1> legs,
+                                ap_uint<32> price[physical_bits - 1],
+                                ap_uint<64> timestamp,
+                                ap_uint<32> &regDedupAge,
+                                ap_uint<32> &regRepriceThreshold) {
+    float threshold = bitsToFloat(regRepriceThreshold.to_uint());
+    int slot = -1;
+    bool moved = false;
+
+    static pricingEngineDedupEntry_t dedup[DEDUP_DEPTH];
+    static ap_uint<8> dedupNext = 0;
+#pragma HLS ARRAY_PARTITION variable = dedup dim = 1 type = complete
+
+    if (regDedupAge == 0) return false;
+
+    // every entry is compared in parallel, an entry older than the age has
+    // expired
+    DEDUP_LOOKUP:
+    for (int d = 0; d < DEDUP_DEPTH; d++) {
+#pragma HLS UNROLL
+        if (dedup[d].valid && dedup[d].legs == legs &&
+            timestamp - dedup[d].timestamp <= regDedupAge) {
+            slot = d;
+        }
+    }
+
+    if (slot >= 0) {
+        DEDUP_REPRICE:
+        for (int e = 0; e < physical_bits - 1; e++) {
+#pragma HLS UNROLL
+            float sent = bitsToFloat(dedup[slot].price[e].to_uint());
+            float now = bitsToFloat(price[e].to_uint());
+            if (legs[e] && fabs(now - sent) > threshold * sent) moved = true;
+        }
+        if (!moved) {
+            ++countSuppressBasket;
+            return true;
+        }
+        ++countRepriceBasket;
+    } else {
+        // round robin replacement of the oldest basket sent
+        slot = dedupNext;
+        dedupNext = (dedupNext + 1 == DEDUP_DEPTH) ? (ap_uint<8>)0
+                                                  : (ap_uint<8>)(dedupNext + 1);
+    }
+
+    dedup[slot].legs = legs;
+    dedup[slot].timestamp = timestamp;
+    DEDUP_STORE:
+    for (int e = 0; e < physical_bits - 1; e++) {
+#pragma HLS UNROLL
+        dedup[slot].price[e] = price[e];
+    }
+    dedup[slot].valid = true;
+
+    return false;
+}
+
+ap_uint<BASKET_LEG_BITS> PricingEngine::sizeCycle(bool spin[physical_bits],
+                                                  pricingEngineDepth_t depth[NUM_PAIRS],
+                                                  float cost[physical_bits - 1],
+                                                  ap_uint<32> legQuantity[physical_bits - 1]) {
+    // price and cumulative quantity ladder per edge, bid edges walk the bid
+    // side and ask edges the ask side of their symbol
+    float price[physical_bits - 1][NUM_LEVEL];
+    ap_uint<32> cumQuantity[physical_bits - 1][NUM_LEVEL];
+#pragma HLS ARRAY_PARTITION variable = price dim = 0 type = complete
+#pragma HLS ARRAY_PARTITION variable = cumQuantity dim = 0 type = complete
+
+    // the legs of a basket split into closed trails, each walked leg by leg.
+    // order holds the legs of one trail as they are walked and reach[p] the
+    // top of book rate from its first currency to leg p
+    int order[physical_bits - 1];
+    float reach[physical_bits - 1];
+    ap_uint<32> size[physical_bits - 1];
+#pragma HLS ARRAY_PARTITION variable = order dim = 1 type = complete
+#pragma HLS ARRAY_PARTITION variable = reach dim = 1 type = complete
+#pragma HLS ARRAY_PARTITION variable = size dim = 1 type = complete
+    ap_uint<physical_bits - 1> walked = 0;
+    ap_uint<BASKET_LEG_BITS> sized = 0;
+
+    BUILD_LADDER:
+    for (int e = 0; e < physical_bits - 1; e++) {
+#pragma HLS UNROLL
+        ap_uint<160> levelPrice =
+            (e & 1) ? depth[e / 2].askPrice : depth[e / 2].bidPrice;
+        ap_uint<160> levelQuantity =
+            (e & 1) ? depth[e / 2].askQuantity : depth[e / 2].bidQuantity;
+        ap_uint<32> cum = 0;
+        for (int k = 0; k < NUM_LEVEL; k++) {
+            cum += levelQuantity.range(32 * k + 31, 32 * k);
+            cumQuantity[e][k] = cum;
+            price[e][k] =
+                bitsToFloat(levelPrice.range(32 * k + 31, 32 * k).to_uint());
+        }
+        legQuantity[e] = 0;
+    }
+
+    SIZE_TRAIL:
+    for (int r = 0; r < (physical_bits - 1) / 2; r++) {
+        // walk the next trail from the currency of its lowest leg, always on
+        // the lowest leg out of the currency reached, a path that does not
+        // close is not sized
+        int start = -1;
+        for (int e = physical_bits - 2; e >= 0; e--) {
+#pragma HLS UNROLL
+            if (spin[e] && !walked[e]) start = exch_index2id[e][0];
+        }
+        if (start < 0) continue;
+
+        float rate = 1.0f;
+        int currency = start;
+        int trailLength = 0;
+        bool closed = false;
+        WALK_TRAIL:
+        for (int p = 0; p < physical_bits - 1; p++) {
+            int e = -1;
+            for (int f = physical_bits - 2; f >= 0; f--) {
+#pragma HLS UNROLL
+                if (spin[f] && !walked[f] && exch_index2id[f][0] == currency) e = f;
+            }
+            order[p] = 0;
+            reach[p] = 0;
+            if (!closed && e >= 0) {
+                walked[e] = 1;
+                order[p] = e;
+                reach[p] = rate;
+                rate *= price[e][0];
+                currency = exch_index2id[e][1];
+                closed = (currency == start);
+                ++trailLength;
+            }
+        }
+        if (!closed) continue;
+
+        // Candidate notionals are the level boundaries of the legs taken back
+        // to the first currency at the top of book. A candidate is carried leg
+        // to leg, each leg sized at what reaches it and converted at its own
+        // VWAP, and the largest notional that every leg can fill whose summed
+        // logged VWAP net of the edge costs stays positive wins. The leg a
+        // candidate comes from is capped at its boundary, so float rounding of
+        // the carry never pushes it past the depth it was taken from
+        float bestNotional = 0;
+        SIZE_CANDIDATE:
+        for (int c = 0; c < (physical_bits - 1) * NUM_LEVEL; c++) {
+            int cp = c / NUM_LEVEL;
+            int ck = c % NUM_LEVEL;
+            if (cp >= trailLength || reach[cp] <= 0) continue;
+            float notional = (float)cumQuantity[order[cp]][ck].to_uint() / reach[cp];
+            if (notional < 1.0f || notional <= bestNotional) continue;
+
+            float amount = notional;
+            float gain = 0;
+            bool fillable = true;
+            SIZE_LEG:
+            for (int p = 0; p < physical_bits - 1; p++) {
+                if (p < trailLength) {
+                    int e = order[p];
+                    float value = 0;
+                    ap_uint<32> filled = 0;
+                    size[p] = (ap_uint<32>)(amount + 0.5f);
+                    if (p == cp && size[p] > cumQuantity[e][ck]) size[p] = cumQuantity[e][ck];
+                    for (int k = 0; k < NUM_LEVEL; k++) {
+                        ap_uint<32> fill = 0;
+                        if (size[p] > filled) {
+                            fill = (size[p] < cumQuantity[e][k])
+                                       ? (ap_uint<32>)(size[p] - filled)
+                                       : (ap_uint<32>)(cumQuantity[e][k] - filled);
+                            filled += fill;
+                        }
+                        value += (float)fill.to_uint() * price[e][k];
+                    }
+                    fillable = fillable && (size[p] != 0) && (filled == size[p]);
+                    if (size[p] != 0) {
+                        float vwap = value / (float)size[p].to_uint();
+                        gain += fastLog(floatToBits(vwap)) - cost[e];
+                    }
+                    amount = value;
+                }
+            }
+            if (fillable && gain > 0) {
+                bestNotional = notional;
+                for (int p = 0; p < physical_bits - 1; p++) {
+#pragma HLS UNROLL
+                    if (p < trailLength) legQuantity[order[p]] = size[p];
+                }
+            }
+        }
+        if (bestNotional > 0) sized += trailLength;
+    }
+
+    return sized;
+}
+
 bool PricingEngine::pricingStrategyPeg(ap_uint<8> thresholdEnable,
                                        ap_uint<32> thresholdPosition,
                                        orderBookResponse_t &response,
@@ -421,57 +1149,278 @@ bool PricingEngine::pricingStrategyLimit(ap_uint<8> thresholdEnable,
 }
 
 void PricingEngine::operationPush(
-    ap_uint<32> &regCaptureControl, ap_uint<32> &regTxOperation,
-    ap_uint<1024> &regCaptureBuffer,
+    ap_uint<32> &regCaptureControl, ap_uint<1024> &regCaptureBuffer,
+    ap_uint<32> *regLatency, ap_uint<PE_TRACE_BITS> *regTrace,
     orderEntryOperationStream_t &operationStream,
-    orderEntryOperationStreamPack_t &operationStreamPack) {
+    solveStampStream_t &stampStream,
+    orderEntryOperationStreamPack_t &operationStreamPack,
+    solveRecordStream_t &recordStream, orderTagStream_t &tagStream,
+    pushStatusStream_t &statusStream, cycleStream_t &clockStream) {
 #pragma HLS PIPELINE II = 1 style = flp
 
     mmInterface intf;
     orderEntryOperation_t operation;
     orderEntryOperationPack_t operationPack;
+    pricingEngineSolveStamp_t stamp;
+    pricingEnginePushStatus_t status;
+    ap_uint<PE_RECORD_BITS> record;
+    ap_uint<PE_TAG_BITS> tag;
 
-    static ap_uint<32> countTxOperation = 0;
+    static ap_uint<64> countTxOperation = 0;
+    static ap_uint<32> countTxBasket = 0;
+    static ap_uint<32> countRecordDrop = 0;
 
-    // Use `while` if there are multiple operations
+    // every solve leaves a stamp, the legs of its basket follow it
     operationPush_label0:
-    while (!operationStream.empty()) {
-        operation = operationStream.read();
-
-        intf.orderEntryOperationPack(&operation, &operationPack);
-        operationStreamPack.write(operationPack);
-        ++countTxOperation;
-
-        // check if host has capture freeze control enabled before updating
-        // TODO: filter capture by user supplied symbol
-        if (0 == (0x80000000 & regCaptureControl)) {
-            regCaptureBuffer = operationPack.data;
+    while (!stampStream.empty()) {
+        stamp = stampStream.read();
+        recordLatency(PE_LATENCY_UPDATE, stamp.solveStart - stamp.ingress,
+                      regLatency);
+        recordLatency(PE_LATENCY_SOLVE, stamp.solveEnd - stamp.solveStart,
+                      regLatency);
+
+        // a basket leaves in one burst, once its first leg is out the rest
+        // of the legs are waited for so baskets are never split or
+        // interleaved
+        PUSH_BASKET:
+        ap_uint<64> egress = stamp.solveEnd;
+        for (ap_uint<BASKET_LEG_BITS> leg = 0; leg < stamp.legs; leg++) {
+            operation = operationStream.read();
+            operation.orderId = countTxOperation.range(31, 0);
+
+            intf.orderEntryOperationPack(&operation, &operationPack);
+            operationStreamPack.write(operationPack);
+            ++countTxOperation;
+
+            // egress of the basket goes to its solution record, of every
+            // order to its tag
+            egress = sampleCycle(clockStream);
+            tag = 0;
+            ORDER_TAG_ID(tag) = operation.orderId;
+            ORDER_TAG_BASKET(tag) = countTxBasket;
+            ORDER_TAG_LEG_INDEX(tag) = leg;
+            ORDER_TAG_LEG_COUNT(tag) = stamp.legs;
+            ORDER_TAG_INGRESS(tag) = stamp.ingress;
+            ORDER_TAG_EGRESS(tag) = egress;
+            if (!tagStream.full())
+                tagStream.write(tag);
+            else
+                ++countRecordDrop;
+
+            // check if host has capture freeze control enabled before
+            // updating
+            // TODO: filter capture by user supplied symbol
+            if (0 == (0x80000000 & regCaptureControl)) {
+                regCaptureBuffer = operationPack.data;
+            }
         }
+        if (stamp.legs != 0) {
+            recordLatency(PE_LATENCY_EMIT, egress - stamp.solveEnd, regLatency);
+            recordLatency(PE_LATENCY_TOTAL, egress - stamp.ingress, regLatency);
+            ++countTxBasket;
+        }
+        recordTrace(stamp, egress - stamp.ingress, regCaptureControl, regTrace);
+
+        // the record is dropped rather than holding up the orders when
+        // nothing drains the stream
+        record.range(63, 0) = stamp.timestamp;
+        record.range(95, 64) = stamp.ingress.range(31, 0);
+        record.range(127, 96) = stamp.solveEnd.range(31, 0);
+        record.range(159, 128) = egress.range(31, 0);
+        record.range(191, 160) = stamp.spins;
+        record.range(223, 192) = stamp.energy;
+        record.range(239, 224) = stamp.iterations;
+        record.range(242, 240) = stamp.verdict.range(2, 0);
+        record.range(247, 243) = stamp.legs;
+        record.range(255, 248) = stamp.symbol;
+        if (!recordStream.full())
+            recordStream.write(record);
+        else
+            ++countRecordDrop;
     }
 
-    regTxOperation = countTxOperation;
+    status.txOperation = countTxOperation;
+    LATCH_LATENCY:
+    for (int stage = 0; stage < PE_LATENCY_STAGES; stage++) {
+#pragma HLS UNROLL
+        status.latencyMin[stage] = latencyMin[stage];
+        status.latencyMax[stage] = latencyMax[stage];
+        status.latencyMean[stage] = meanLatency(stage);
+    }
+    status.traceCount = traceCount;
+    status.traceTrigger = traceTrigger;
+    status.recordDrop = countRecordDrop;
+    statusStream.write(status);
 
     return;
 }
 
-void PricingEngine::eventHandler(ap_uint<32> &regRxEvent,
-                                 clockTickGeneratorEventStream_t &eventStream) {
+void PricingEngine::recordLatency(int stage, ap_uint<64> latency,
+                                  ap_uint<32> *regLatency) {
+#pragma HLS INLINE
+    // saturate to the width of the registers
+    ap_uint<32> sample = (latency > 0xffffffff) ? (ap_uint<32>)0xffffffff
+                                                : (ap_uint<32>)latency;
+    int bucket = 0;
+    LATENCY_BUCKET:
+    for (int b = 0; b < 32; b++) {
+#pragma HLS UNROLL
+        if (sample[b]) bucket = b + 1;
+    }
+    if (bucket >= PE_LATENCY_BUCKETS) bucket = PE_LATENCY_BUCKETS - 1;
+
+    if (latencyCount[stage] == 0 || sample < latencyMin[stage]) {
+        latencyMin[stage] = sample;
+    }
+    if (sample > latencyMax[stage]) latencyMax[stage] = sample;
+    latencySum[stage] += sample;
+    ++latencyCount[stage];
+    regLatency[stage * PE_LATENCY_BUCKETS + bucket] =
+        ++latencyHist[stage][bucket];
+}
+
+ap_uint<32> PricingEngine::meanLatency(int stage) {
+#pragma HLS INLINE
+    return latencyCount[stage]
+               ? (ap_uint<32>)(latencySum[stage] / latencyCount[stage])
+               : (ap_uint<32>)0;
+}
+
+void PricingEngine::recordTrace(pricingEngineSolveStamp_t &stamp,
+                                ap_uint<64> latency,
+                                ap_uint<32> &regCaptureControl,
+                                ap_uint<PE_TRACE_BITS> *regTrace) {
+#pragma HLS INLINE
+    ap_uint<PE_TRACE_BITS> entry = 0;
+    ap_uint<4> verdictMask = PE_CAPTURE_TRACE_VERDICT(regCaptureControl);
+    bool armed = (regCaptureControl & PE_CAPTURE_TRACE_ARM);
+
+    // clearing the arm bit rearms the trigger
+    if (!armed) {
+        traceTrigger = 0;
+        tracePost = 0;
+    }
+    if ((regCaptureControl & PE_CAPTURE_TRACE_FREEZE) || traceTrigger[30])
+        return;
+
+    entry.range(63, 0) = stamp.timestamp;
+    entry.range(71, 64) = stamp.symbol;
+    entry.range(79, 72) = stamp.verdict;
+    entry.range(84, 80) = stamp.legs;
+    entry.range(127, 96) = stamp.hBid;
+    entry.range(159, 128) = stamp.hAsk;
+    entry.range(191, 160) = stamp.spins;
+    entry.range(223, 192) = stamp.energy;
+    entry.range(255, 224) = (latency > 0xffffffff) ? (ap_uint<32>)0xffffffff
+                                                   : (ap_uint<32>)latency;
+    regTrace[traceCount % PE_TRACE_DEPTH] = entry;
+
+    // the trigger entry ends up in the middle of the stopped ring
+    if (traceTrigger[31]) {
+        if (--tracePost == 0) traceTrigger[30] = 1;
+    } else if (armed && verdictMask[(int)stamp.verdict.range(1, 0)]) {
+        traceTrigger = 0x80000000 | traceCount.range(29, 0);
+        tracePost = PE_TRACE_DEPTH / 2;
+    }
+    ++traceCount;
+}
+
+void PricingEngine::eventHandler(clockTickGeneratorEventStream_t &eventStream,
+                                 solveTriggerStream_t &triggerStream,
+                                 counterStream_t &statusStream) {
 #pragma HLS PIPELINE II = 1 style = flp
 
     clockTickGeneratorEvent_t tickEvent;
 
-    static ap_uint<32> countRxEvent = 0;
+    static ap_uint<64> countRxEvent = 0;
 
     if (!eventStream.empty()) {
         eventStream.read(tickEvent);
         ++countRxEvent;
 
         // event notification has been received from programmable clock tick
-        // generator, handling currently limited to incrementing a counter,
-        // placeholder for user to extend with custom event handling code
+        // generator, forwarded to problemUpdate to schedule timer driven
+        // solves, a tick is dropped rather than stalling if one is pending
+        if (!triggerStream.full()) {
+            triggerStream.write(tickEvent.timestamp);
+        }
     }
 
-    regRxEvent = countRxEvent;
+    statusStream.write(countRxEvent);
+
+    return;
+}
+
+void PricingEngine::statusLatch(ap_uint<32> &regCaptureControl,
+                                pricingEngineRegStatus_t &regStatus,
+                                counterStream_t &pullStatus,
+                                counterStream_t &eventStatus,
+                                updateStatusStream_t &updateStatus,
+                                solveStatusStream_t &solveStatus,
+                                pushStatusStream_t &pushStatus,
+                                cycleStream_t &clockStream) {
+#pragma HLS PIPELINE II = 1 style = flp
+
+    static ap_uint<64> rxResponse = 0;
+    static ap_uint<64> rxEvent = 0;
+    static pricingEngineUpdateStatus_t update;
+    static pricingEngineSolveStatus_t solve;
+    static pricingEnginePushStatus_t push;
+    ap_uint<64> cycle;
+
+    latestStatus(pullStatus, rxResponse);
+    latestStatus(eventStatus, rxEvent);
+    latestStatus(updateStatus, update);
+    latestStatus(solveStatus, solve);
+    latestStatus(pushStatus, push);
+    cycle = sampleCycle(clockStream);
+
+    // the one writer of the status block, held as a whole while the snapshot
+    // is latched
+    if (0 == (PE_CAPTURE_SNAPSHOT & regCaptureControl)) {
+        regStatus.rxResponse = rxResponse;
+        regStatus.rxEvent = rxEvent;
+        regStatus.processResponse = update.processResponse;
+        regStatus.conflateResponse = update.conflateResponse;
+        regStatus.solveRate = update.solveRate;
+        regStatus.staleEdge = update.staleEdge;
+        regStatus.fieldDrift = update.fieldDrift;
+        regStatus.strategyNone = update.strategyNone;
+        regStatus.solveProblem = solve.solveProblem;
+        regStatus.strategyPeg = solve.strategyPeg;
+        regStatus.strategyLimit = solve.strategyLimit;
+        regStatus.strategyUnknown = solve.strategyUnknown;
+        regStatus.debug = solve.debug;
+        regStatus.suppressBasket = solve.suppressBasket;
+        regStatus.repriceBasket = solve.repriceBasket;
+        regStatus.memoHit = solve.memoHit;
+        regStatus.memoReject = solve.memoReject;
+        regStatus.annealIter = solve.annealIter;
+        regStatus.qualityAllZero = solve.qualityAllZero;
+        regStatus.qualityNoCycle = solve.qualityNoCycle;
+        regStatus.qualityCycle = solve.qualityCycle;
+        regStatus.qualityProfitable = solve.qualityProfitable;
+        regStatus.qualitySpinFlip = solve.qualitySpinFlip;
+        regStatus.qualityAncillaFlip = solve.qualityAncillaFlip;
+        regStatus.txBasket = solve.txBasket;
+        regStatus.txOperation = push.txOperation;
+        regStatus.latencyUpdateMin = push.latencyMin[PE_LATENCY_UPDATE];
+        regStatus.latencyUpdateMax = push.latencyMax[PE_LATENCY_UPDATE];
+        regStatus.latencyUpdateMean = push.latencyMean[PE_LATENCY_UPDATE];
+        regStatus.latencySolveMin = push.latencyMin[PE_LATENCY_SOLVE];
+        regStatus.latencySolveMax = push.latencyMax[PE_LATENCY_SOLVE];
+        regStatus.latencySolveMean = push.latencyMean[PE_LATENCY_SOLVE];
+        regStatus.latencyEmitMin = push.latencyMin[PE_LATENCY_EMIT];
+        regStatus.latencyEmitMax = push.latencyMax[PE_LATENCY_EMIT];
+        regStatus.latencyEmitMean = push.latencyMean[PE_LATENCY_EMIT];
+        regStatus.latencyTotalMin = push.latencyMin[PE_LATENCY_TOTAL];
+        regStatus.latencyTotalMax = push.latencyMax[PE_LATENCY_TOTAL];
+        regStatus.latencyTotalMean = push.latencyMean[PE_LATENCY_TOTAL];
+        regStatus.traceCount = push.traceCount;
+        regStatus.traceTrigger = push.traceTrigger;
+        regStatus.recordDrop = push.recordDrop;
+        regStatus.snapshotCycle = cycle;
+    }
 
     return;
 }
@@ -485,71 +1434,20 @@ void PricingEngine::eventHandler(ap_uint<32> &regRxEvent,
  *
  * *********************************************/
 
-// without local field
+// without local field, only the ancilla column of J depends on the rates
 void PricingEngine::ERM(int index, float logged_price, float M1, float M2,
-                        float J[physical_bits][physical_bits], float exch_logged_rates[physical_bits - 1], bool &regInitConstr) {
+                        float M3, float ancilla[physical_bits],
+                        float exch_logged_rates[physical_bits - 1],
+                        bool &regInitConstr) {
 
-#pragma HLS ARRAY_PARTITION dim=1 type=complete variable=J
-    // static float exch_logged_rates[physical_bits - 1] = {0};
+#pragma HLS ARRAY_PARTITION dim=1 type=complete variable=ancilla
     static bool init_constraint = false;
     if (!init_constraint) {
         regInitConstr = false;
-        INIT_CONSTRAINT:
-        for (int k = 0; k < currencies; k++) {
-            float v1i_list[physical_bits - 1] = {0};
-            bool v2i_list[physical_bits - 1] = {0};
-            CHECK_ID:
-            for (int i = 0; i < physical_bits - 1; i++) {
-#pragma HLS PIPELINE
-                // v1 vector's ith element value
-                v1i_list[i] =
-                    (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
-                v2i_list[i] = (exch_index2id[i][0] == k);
-            }
-            // penalty 1 without diagonal part (+1 at j-for loop)
-            // penalty 2 has no diagonal part originally
-            // physical_bits - 1 for not changing the ancilla bit
-            // i is increasing in diagonal direction
-            ERM_penalty_ij:
-            for (int i = 0; i < physical_bits - 1; i++) {
-                ERM_penalty_ij_in:
-                for (int j = i + 1; j < physical_bits - 1; j++) {
-                    // outer product
-                    // also convert to ising model by divided by 4
-                    float pen1 = v1i_list[i] * v1i_list[j] * M1 / 4;
-                    float pen2 = v2i_list[i] * v2i_list[j] * M2 / 4;
-                    float pen1_plus_pen2 = pen1 + pen2;
-                    J[i][j] += pen1_plus_pen2;
-                    // Transforming to ising model will remove the diagonal part
-                    // and form local field h. The forming of local field h is
-                    // replaced with ancilla bit which is the sum of the
-                    // original row/col of matrix containing diagonal part
-                    J[i][physical_bits - 1] += (pen1_plus_pen2);  // /2 /2 = /4
-                    J[j][physical_bits - 1] += (pen1_plus_pen2);
-                }
-            }
-            ERM_penalty_ii:
-            for (int i = 0; i < physical_bits - 1; i++) {
-                float v1i = v1i_list[i];
-                // Adding the original diagonal part back to ancilla bit
-                // vli is either +1, 0, or -1
-                // vli * vli = (vli != 0)
-                float v1i_square_pen = (v1i != 0) * M1 / 4;
-                J[i][physical_bits - 1] += v1i_square_pen;
-            }
-            ERM_penalty_symmetric:
-            for (int i = 0; i < physical_bits; i++) {
-                for (int j = i + 1; j < physical_bits; j++) {
-                    J[j][i] = J[i][j];
-                }
-            }
-        }
+        ERMAncillaConstraint(M1, M2, M3, ancilla);
         init_constraint = true;
         regInitConstr = true;
 #ifndef __SYNTHESIS__
-        // for (int i = 0; i < physical_bits; i++) {
-        //     print_whole_vec<float, physical_bits>(J[i], std::cout);
-        // }
         print_whole_vec<float, physical_bits - 1>(exch_logged_rates, std::cout);
 #endif
     }
@@ -559,12 +1457,125 @@ void PricingEngine::ERM(int index, float logged_price, float M1, float M2,
     float replace_new_rate_divide_4 =
         (exch_logged_rates[index] - logged_price) /
         4;  // -(-old rate) + (-net rate)
-    J[index][physical_bits - 1] += replace_new_rate_divide_4;
-    J[physical_bits - 1][index] += replace_new_rate_divide_4;
+    ancilla[index] += replace_new_rate_divide_4;
     exch_logged_rates[index] = logged_price;
     return;
 }
 
+// constraint part of the ancilla column, independent of the exchange rates
+void PricingEngine::ERMAncillaConstraint(float M1, float M2, float M3,
+                                         float ancilla[physical_bits]) {
+
+#pragma HLS ARRAY_PARTITION dim=1 type=complete variable=ancilla
+    // penalty 3, M3 * (sum of x)^2, every edge is coupled to the other
+    // physical_bits - 2 edges and has M3 on its diagonal
+    LENGTH_PENALTY:
+    for (int i = 0; i < physical_bits - 1; i++) {
+        ancilla[i] += (physical_bits - 1) * M3 / 4;
+    }
+    INIT_CONSTRAINT:
+    for (int k = 0; k < currencies; k++) {
+        float v1i_list[physical_bits - 1] = {0};
+        bool v2i_list[physical_bits - 1] = {0};
+        CHECK_ID:
+        for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS PIPELINE
+            // v1 vector's ith element value
+            v1i_list[i] =
+                (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
+            v2i_list[i] = (exch_index2id[i][0] == k);
+        }
+        // Same accumulation as ERMConstraint, restricted to the ancilla
+        // column J[i][physical_bits - 1]
+        ERM_penalty_ij:
+        for (int i = 0; i < physical_bits - 1; i++) {
+            ERM_penalty_ij_in:
+            for (int j = i + 1; j < physical_bits - 1; j++) {
+                float pen1 = v1i_list[i] * v1i_list[j] * M1 / 4;
+                float pen2 = v2i_list[i] * v2i_list[j] * M2 / 4;
+                float pen1_plus_pen2 = pen1 + pen2;
+                ancilla[i] += (pen1_plus_pen2);  // /2 /2 = /4
+                ancilla[j] += (pen1_plus_pen2);
+            }
+        }
+        ERM_penalty_ii:
+        for (int i = 0; i < physical_bits - 1; i++) {
+            float v1i = v1i_list[i];
+            // vli * vli = (vli != 0)
+            float v1i_square_pen = (v1i != 0) * M1 / 4;
+            ancilla[i] += v1i_square_pen;
+        }
+    }
+}
+
+// constraint part of J, independent of the exchange rates
+void PricingEngine::ERMConstraint(float M1, float M2, float M3,
+                                  float J[physical_bits][physical_bits]) {
+
+#pragma HLS ARRAY_PARTITION dim=1 type=complete variable=J
+    // penalty 3, cycle length, the same weight between every pair of edges,
+    // the symmetric half is filled in below
+    LENGTH_PENALTY:
+    for (int i = 0; i < physical_bits - 1; i++) {
+        for (int j = i + 1; j < physical_bits - 1; j++) {
+            J[i][j] += M3 / 4;
+            J[i][physical_bits - 1] += M3 / 4;
+            J[j][physical_bits - 1] += M3 / 4;
+        }
+        J[i][physical_bits - 1] += M3 / 4;
+    }
+    INIT_CONSTRAINT:
+    for (int k = 0; k < currencies; k++) {
+        float v1i_list[physical_bits - 1] = {0};
+        bool v2i_list[physical_bits - 1] = {0};
+        CHECK_ID:
+        for (int i = 0; i < physical_bits - 1; i++) {
+#pragma HLS PIPELINE
+            // v1 vector's ith element value
+            v1i_list[i] =
+                (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
+            v2i_list[i] = (exch_index2id[i][0] == k);
+        }
+        // penalty 1 without diagonal part (+1 at j-for loop)
+        // penalty 2 has no diagonal part originally
+        // physical_bits - 1 for not changing the ancilla bit
+        // i is increasing in diagonal direction
+        ERM_penalty_ij:
+        for (int i = 0; i < physical_bits - 1; i++) {
+            ERM_penalty_ij_in:
+            for (int j = i + 1; j < physical_bits - 1; j++) {
+                // outer product
+                // also convert to ising model by divided by 4
+                float pen1 = v1i_list[i] * v1i_list[j] * M1 / 4;
+                float pen2 = v2i_list[i] * v2i_list[j] * M2 / 4;
+                float pen1_plus_pen2 = pen1 + pen2;
+                J[i][j] += pen1_plus_pen2;
+                // Transforming to ising model will remove the diagonal part
+                // and form local field h. The forming of local field h is
+                // replaced with ancilla bit which is the sum of the
+                // original row/col of matrix containing diagonal part
+                J[i][physical_bits - 1] += (pen1_plus_pen2);  // /2 /2 = /4
+                J[j][physical_bits - 1] += (pen1_plus_pen2);
+            }
+        }
+        ERM_penalty_ii:
+        for (int i = 0; i < physical_bits - 1; i++) {
+            float v1i = v1i_list[i];
+            // Adding the original diagonal part back to ancilla bit
+            // vli is either +1, 0, or -1
+            // vli * vli = (vli != 0)
+            float v1i_square_pen = (v1i != 0) * M1 / 4;
+            J[i][physical_bits - 1] += v1i_square_pen;
+        }
+        ERM_penalty_symmetric:
+        for (int i = 0; i < physical_bits; i++) {
+            for (int j = i + 1; j < physical_bits; j++) {
+                J[j][i] = J[i][j];
+            }
+        }
+    }
+}
+
 // with local field h
 void PricingEngine::ERM(int index, float logged_price, float M1, float M2,
                         float J[physical_bits][physical_bits],
@@ -685,6 +1696,40 @@ bool PricingEngine::checkProfitable(bool spin[physical_bits], float exch_logged_
     return (logged_rate > 0);
 }
 
+bool PricingEngine::isLocalMinimum(bool spin[physical_bits],
+                                   float J[physical_bits][physical_bits]) {
+    // With s = +-1 and E = s^T J s, flipping spin i changes the energy by
+    // -4 * s_i * sum_{j != i} J_ij * s_j
+    bool minimum = true;
+    LOCAL_MINIMUM:
+    for (int i = 0; i < physical_bits; i++) {
+#pragma HLS PIPELINE
+        float local = 0;
+        for (int j = 0; j < physical_bits; j++) {
+            if (j != i) local += spin[j] ? J[i][j] : -J[i][j];
+        }
+        if ((spin[i] ? local : -local) > 0) minimum = false;
+    }
+    return minimum;
+}
+
+float PricingEngine::isingEnergy(bool spin[physical_bits],
+                                 float J[physical_bits][physical_bits]) {
+    // E = s^T J s with s = +-1, summed in the order of calc_energy so that
+    // csim matches the reference bit for bit
+    float energy = 0;
+    ISING_ENERGY:
+    for (int i = 0; i < physical_bits; i++) {
+#pragma HLS PIPELINE
+        float local = 0;
+        for (int j = 0; j < physical_bits; j++) {
+            local += spin[j] ? J[i][j] : -J[i][j];
+        }
+        energy += spin[i] ? local : -local;
+    }
+    return energy;
+}
+
 #ifndef __SYNTHESIS__
 bool PricingEngine::checkSBMSolution(bool spin[physical_bits], float exch_logged_prices[physical_bits - 1]) {
     bool hasCycle = checkExchCycle(spin);
@@ -974,7 +2019,8 @@ void SBM_update(dcal_t Q_matrix_cache[physical_bits][physical_bits],
 
 void PricingEngine::SBM(float Q_Matrix[physical_bits][physical_bits], dcal_t y[physical_bits],
          dcal_t x[physical_bits], int steps, float dt, float c0, dcal_t& best_energy, int& best_step,
-         bool best_spin[physical_bits], ap_uint<32> &regSBMExecStatus) {
+         bool best_spin[physical_bits], ap_uint<32> &regSBMExecStatus,
+         int converge, bool anytime, int& executed) {
 #ifndef __SYNTHESIS__
     // Init debug file
     std::fstream f("out.txt", std::ios::out);
@@ -992,6 +2038,12 @@ void PricingEngine::SBM(float Q_Matrix[physical_bits][physical_bits], dcal_t y[p
     float x_updated[physical_bits] = {0};
     float y_updated[physical_bits] = {0};
     bool x_updated_bool[physical_bits] = {0};
+    bool x_last_bool[physical_bits] = {0};
+    bool anytime_spin[physical_bits] = {0};
+    int quiet = 0;
+    bool changed;
+    best_step = 0;
+    executed = 0;
 SBM_MAIN:
     for (int i = 0; i < steps; i++) {
 #pragma HLS LOOP_TRIPCOUNT min = 100 max = 2000
@@ -1004,11 +2056,47 @@ SBM_MAIN:
             x[i] = x_updated[i];
             y[i] = y_updated[i];
         }
+        // step after which the spin signs last changed
+        changed = (i == 0);
+    SETTLE_CHECK:
+        for (int j = 0; j < physical_bits; ++j) {
+#pragma HLS UNROLL
+            if (i == 0 || x_updated_bool[j] != x_last_bool[j]) {
+                best_step = i + 1;
+                changed = true;
+            }
+            x_last_bool[j] = x_updated_bool[j];
+        }
+        quiet = changed ? 0 : quiet + 1;
+        executed = i + 1;
+
+        // anytime solve, keep the lowest energy step and stop once the
+        // spins have been quiet for converge steps
+        if (anytime) {
+            energy = 0;
+        ANYTIME_ENERGY:
+            for (int r = 0; r < physical_bits; ++r) {
+#pragma HLS PIPELINE
+                float local = 0;
+                for (int c = 0; c < physical_bits; ++c) {
+                    local += x_updated_bool[c] ? Q_Matrix[r][c] : -Q_Matrix[r][c];
+                }
+                energy += x_updated_bool[r] ? local : -local;
+            }
+            if (i == 0 || energy < best_energy) {
+                best_energy = energy;
+                for (int j = 0; j < physical_bits; ++j) {
+#pragma HLS UNROLL
+                    anytime_spin[j] = x_updated_bool[j];
+                }
+            }
+            if (converge != 0 && quiet >= converge) break;
+        }
     }
     // TODO: Dataflow for best_spin
     // TODO: Pack spins to integers to burst write
     for (int i = 0; i < physical_bits; ++i) {
-        best_spin[i] = x_updated_bool[i];
+        best_spin[i] = anytime ? anytime_spin[i] : x_updated_bool[i];
     }
     regSBMExecStatus = 2; // SBM done and idle
 }
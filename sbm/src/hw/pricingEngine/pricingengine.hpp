@@ -23,7 +23,265 @@
 #include "exch2ising.hpp"
 #include "hls_stream.h"
 
+#ifndef __SYNTHESIS__
+#include <chrono>
+#endif
+
 #define PE_CAPTURE_FREEZE (1 << 31)
+// capture bit 30 is reserved. The order timestamp goes out as SendingTime
+// (tag 52) and is never rewritten, tick to trade cycle stamps are carried by
+// the solution records instead
+// Decision trace controls, the ring stops while TRACE_FREEZE is set. With
+// TRACE_ARM set the first solve whose verdict is selected by capture[3:0]
+// (bit v for verdict v) triggers it, the ring then records PE_TRACE_DEPTH / 2
+// more solves and stops until TRACE_ARM is cleared
+#define PE_CAPTURE_TRACE_FREEZE (1 << 29)
+#define PE_CAPTURE_TRACE_ARM (1 << 28)
+#define PE_CAPTURE_TRACE_VERDICT(capture) ((capture).range(3, 0))
+// Statistics snapshot, the stages send their counters to statusLatch, the
+// one process that writes the status block. While set statusLatch holds the
+// whole block and snapshotCycle at the values of the first cycle it saw the
+// bit and the counters run on underneath, so every register of the block is
+// latched on the same clock edge
+#define PE_CAPTURE_SNAPSHOT (1 << 27)
+
+// Currency pairs (symbols) covered by the Ising model, ancilla excluded
+#define NUM_PAIRS ((physical_bits - 1) / 2)
+
+// Fast log unit for price ingestion, mantissa bits indexing the LUT
+#define LOG_LUT_BITS 6
+#define FAST_LOG_LN2 0.693147181f
+
+float fastLog(ap_uint<32> src);
+
+// QUBO formulation penalty strengths
+#define QUBO_M1 10 // 50
+#define QUBO_M2 10 // 25
+
+// Cycle length penalty M3 * (number of legs)^2, set per deployment with
+// -DQUBO_M3=<weight>, 0 keeps only flow balance (M1) and one outgoing edge
+// per currency (M2)
+#ifndef QUBO_M3
+#define QUBO_M3 0
+#endif
+
+// Order book depth of one symbol, five 32-bit levels per field
+#define NUM_LEVEL 5
+
+typedef struct pricingEngineDepth_t {
+    ap_uint<160> bidPrice;
+    ap_uint<160> bidQuantity;
+    ap_uint<160> askPrice;
+    ap_uint<160> askQuantity;
+} pricingEngineDepth_t;
+
+typedef struct pricingEngineCacheEntry_t {
+    ap_uint<32> bidPrice;
+    ap_uint<32> askPrice;
+    ap_uint<32> valid;
+} pricingEngineCacheEntry_t;
+
+// Ising problem snapshot handed over from ERM to the solver, only the ancilla
+// column of J depends on the exchange rates
+typedef struct isingProblem_t {
+    orderBookResponse_t response; // latest response folded into the snapshot
+    ap_uint<64> ingress;          // cycle the oldest response folded in was pulled, 0 if none
+    float ancilla[physical_bits];
+    float exch_logged_rates[physical_bits - 1];
+    pricingEngineCacheEntry_t book[NUM_PAIRS]; // top of book for pricing the legs
+    pricingEngineDepth_t depth[NUM_PAIRS]; // book depth for sizing the legs
+    float cost[physical_bits - 1];         // log domain trading cost per edge
+} isingProblem_t;
+
+typedef hls::stream<isingProblem_t> isingProblemStream_t;
+
+// Order baskets, all legs of one cycle leave back to back. The orderId of a
+// leg is the count of orders sent ahead of it, so it never repeats before
+// 2^32 orders, and its basket travels on the order tag, see PE_TAG_BITS
+#define BASKET_LEG_BITS 5
+
+// Duplicate basket suppression, the last DEDUP_DEPTH baskets sent keyed by
+// their legs. A cycle found again within regControl.dedupAge of being sent is
+// dropped unless a leg price moved by more than regControl.repriceThreshold
+// (relative, float bits), a zero age disables suppression
+#define DEDUP_DEPTH 4
+
+typedef struct pricingEngineDedupEntry_t {
+    ap_uint<physical_bits - 1> legs;
+    ap_uint<64> timestamp;
+    ap_uint<32> price[physical_bits - 1];
+    bool valid;
+} pricingEngineDedupEntry_t;
+
+// Anytime solving, regControl.solveBudget bounds SBM to that many steps (at
+// most SBM_MAX_STEPS), the pump schedule is compressed to fit them, and
+// regControl.convergeSweeps stops it after that many steps without a spin
+// sign change. With either set the lowest energy step is returned, with both
+// 0 the fixed SBM_STEPS steps run as before. The budget is counted in steps,
+// not clock cycles, the cycles of a step follow from the csynth report of
+// SBM_update
+#define SBM_STEPS 10
+#define SBM_MAX_STEPS 64
+
+// Solve scheduling, regControl.schedule
+#define PE_SCHEDULE_TIMER (1 << 0) // solve on clock tick instead of on every market update
+#define PE_SCHEDULE_MEMO (1 << 1)  // reuse a cached solution instead of SBM when valid
+#define SOLVE_RATE_TICKS (16)      // clock ticks per regStatus.solveRate window
+
+// Solution memo, the last MEMO_DEPTH solutions keyed by the sign pattern of
+// the ancilla column (the field the edges see). A cached solution stands in
+// for SBM while none of its 1-flip neighbours is lower in energy under the
+// current J
+#define MEMO_DEPTH 4
+
+typedef struct pricingEngineMemoEntry_t {
+    ap_uint<physical_bits - 1> signature;
+    ap_uint<physical_bits - 1> spins;
+    bool valid;
+} pricingEngineMemoEntry_t;
+
+// Solution quality, every solve is counted by the class of its spins after
+// the ancilla flip and before duplicate suppression: qualityAllZero no edge
+// selected, qualityNoCycle edges that are not flow balanced, qualityCycle a
+// cycle and qualityProfitable a cycle that sizeCycle can fill at a profit.
+// qualitySpinFlip sums the spins that differ from the previous solution and
+// qualityAncillaFlip counts the solutions read out with the ancilla at -1
+
+// Ancilla coupling added to an edge whose quote is older than
+// regControl.staleAge, counted in cycles of the kernel clock of cycleCounter
+// (ns of the host clock in csim) from the cycle the quote was pulled to the
+// clock tick that sweeps it
+#define STALE_CLAMP (QUBO_M1 + QUBO_M2)
+
+// Edge updates between background rebuilds of the ancilla column when
+// regControl.rebuildPeriod is 0
+#define FIELD_REBUILD_PERIOD (1 << 16)
+
+// Clock tick timestamps forwarded from eventHandler to problemUpdate
+typedef hls::stream<ap_uint<64> > solveTriggerStream_t;
+
+// Latency instrumentation, cycleCounter is the one clock of every stamp. It
+// is a free running II = 1 process that counts kernel clock cycles from reset
+// and offers the count to every stage that stamps on a depth 1 clock stream
+// of its own, a stage reads it with sampleCycle whenever it needs a stamp
+// whatever its own II, so all stamps share the free running count give or
+// take a cycle (csim runs the processes one after the other and reads the
+// host clock in ns from the first sample instead). responsePull stamps every response on a
+// sideband and the snapshot carries the oldest stamp folded in,
+// pricingProcess stamps the solver start and end into the stamp it sends
+// ahead of the legs of every solve and operationPush stamps the legs as they
+// are written. operationPush keeps min / max / mean per stage and a log2
+// histogram in regLatency[stage * PE_LATENCY_BUCKETS + bucket], bucket b
+// counts the latencies of b significant bits
+#define PE_LATENCY_UPDATE 0 // response pulled to solver start
+#define PE_LATENCY_SOLVE 1  // solver start to solver end
+#define PE_LATENCY_EMIT 2   // solver end to the last leg written
+#define PE_LATENCY_TOTAL 3  // response pulled to the last leg written
+#define PE_LATENCY_STAGES 4
+#define PE_LATENCY_BUCKETS 32
+
+typedef hls::stream<ap_uint<64> > cycleStream_t;
+
+// Offers the count to a stage, a stage that has not taken the previous count
+// yet keeps it
+inline void offerCycle(cycleStream_t &clockStream, ap_uint<64> cycle) {
+#pragma HLS INLINE
+#ifndef __SYNTHESIS__
+    // csim streams are never full, one pending count is all a stage drops
+    if (!clockStream.empty()) return;
+#endif
+    if (!clockStream.full()) clockStream.write(cycle);
+}
+
+// Current count of the kernel clock, a pending count went stale while the
+// stage was busy so it is dropped and the next one offered is taken
+inline ap_uint<64> sampleCycle(cycleStream_t &clockStream) {
+#pragma HLS INLINE
+    if (!clockStream.empty()) clockStream.read();
+#ifndef __SYNTHESIS__
+    static const auto reset = std::chrono::steady_clock::now();
+    return (ap_uint<64>)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - reset)
+        .count();
+#else
+    return clockStream.read();
+#endif
+}
+
+// Outcome of a solve
+#define PE_VERDICT_NONE 0     // all spins zero, no cycle
+#define PE_VERDICT_REJECT 1   // not a cycle or not profitable at the top of book
+#define PE_VERDICT_SUPPRESS 2 // duplicate of a basket in flight
+#define PE_VERDICT_SEND 3     // basket sent
+#define PE_VERDICT_MEMO (1 << 2) // flag, the solution came from the memo
+
+// Decision trace ring, operationPush writes one entry per solve to
+// regTrace[regTraceCount % PE_TRACE_DEPTH], regTraceTrigger holds bit 31
+// triggered, bit 30 stopped and [29:0] the count of the trigger entry. The
+// host reads an entry from the trace AXI-lite bundle, apart from the control
+// bundle, as eight 32-bit words:
+//   0-1  exchange timestamp of the response behind the solve
+//   2    symbol [7:0], verdict [15:8], legs [20:16]
+//   3-4  ancilla coupling of the bid / ask edge of the symbol (float bits)
+//   5    spin bitmask after the ancilla flip, ancilla in the top bit
+//   6    energy of the SBM step returned (float bits), not evaluated for a
+//        memo hit
+//   7    response pulled to the last leg written, to the solver end without
+//        legs
+#define PE_TRACE_DEPTH 2048
+#define PE_TRACE_BITS 256
+
+typedef struct pricingEngineSolveStamp_t {
+    ap_uint<64> ingress;
+    ap_uint<64> solveStart;
+    ap_uint<64> solveEnd;
+    ap_uint<BASKET_LEG_BITS> legs; // legs that follow on the operation stream
+    ap_uint<64> timestamp;         // the rest is only kept for the trace
+    ap_uint<8> symbol;
+    ap_uint<8> verdict;
+    ap_uint<32> hBid;
+    ap_uint<32> hAsk;
+    ap_uint<32> spins;
+    ap_uint<32> energy;
+    ap_uint<16> iterations;
+} pricingEngineSolveStamp_t;
+
+typedef hls::stream<pricingEngineSolveStamp_t> solveStampStream_t;
+
+// Solution records, operationPush writes one PE_RECORD_BITS record per solve
+// to the recordStream AXI-stream of pricingEngineTop for a data mover to the
+// host, a record that finds the stream full is counted in regRecordDrop
+// instead. Eight little endian 32-bit words:
+//   0-1  exchange timestamp of the response behind the solve
+//   2    ingress cycle [31:0], response pulled
+//   3    solver end cycle [31:0]
+//   4    egress cycle [31:0], last leg written, the solver end without legs
+//   5    spin bitmask
+//   6    energy (float bits)
+//   7    SBM steps [15:0], verdict [18:16], legs [23:19], symbol [31:24]
+#define PE_RECORD_BITS 256
+
+typedef hls::stream<ap_uint<PE_RECORD_BITS> > solveRecordStream_t;
+
+// Order tags, operationPush writes one PE_TAG_BITS tag per order to the
+// orderTagStream AXI-stream of pricingEngineTop right behind the order, a tag
+// that finds the stream full is counted in regRecordDrop with the records.
+// Eight little endian 32-bit words:
+//   0    orderId of the order
+//   1    basket ID, the count of baskets sent ahead of its basket
+//   2    leg index [7:0], leg count [15:8]
+//   3    reserved
+//   4-5  ingress cycle, response pulled
+//   6-7  egress cycle, order written
+#define PE_TAG_BITS 256
+#define ORDER_TAG_ID(tag) ((tag).range(31, 0))
+#define ORDER_TAG_BASKET(tag) ((tag).range(63, 32))
+#define ORDER_TAG_LEG_INDEX(tag) ((tag).range(71, 64))
+#define ORDER_TAG_LEG_COUNT(tag) ((tag).range(79, 72))
+#define ORDER_TAG_INGRESS(tag) ((tag).range(191, 128))
+#define ORDER_TAG_EGRESS(tag) ((tag).range(255, 192))
+
+typedef hls::stream<ap_uint<PE_TAG_BITS> > orderTagStream_t;
 
 typedef struct pricingEngineRegControl_t {
     ap_uint<32> control;
@@ -34,18 +292,26 @@ typedef struct pricingEngineRegControl_t {
     ap_uint<32> reserved05;
     ap_uint<32> reserved06;
     ap_uint<32> reserved07;
+    ap_uint<32> schedule;
+    ap_uint<32> solveInterval;
+    ap_uint<32> staleAge;
+    ap_uint<32> rebuildPeriod;
+    ap_uint<32> dedupAge;
+    ap_uint<32> repriceThreshold;
+    ap_uint<32> solveBudget;
+    ap_uint<32> convergeSweeps;
 } pricingEngineRegControl_t;
 
 typedef struct pricingEngineRegStatus_t {
     ap_uint<32> status;
-    ap_uint<32> rxResponse;
-    ap_uint<32> processResponse;
-    ap_uint<32> txOperation;
+    ap_uint<64> rxResponse;
+    ap_uint<64> processResponse;
+    ap_uint<64> txOperation;
     ap_uint<32> strategyNone;
     ap_uint<32> strategyPeg;
     ap_uint<32> strategyLimit;
     ap_uint<32> strategyUnknown;
-    ap_uint<32> rxEvent;
+    ap_uint<64> rxEvent;
     ap_uint<32> debug;
     ap_uint<32> reserved10;
     ap_uint<32> reserved11;
@@ -53,8 +319,103 @@ typedef struct pricingEngineRegStatus_t {
     ap_uint<32> reserved13;
     ap_uint<32> reserved14;
     ap_uint<32> reserved15;
+    ap_uint<64> conflateResponse;
+    ap_uint<64> solveProblem;
+    ap_uint<32> solveRate;
+    ap_uint<32> staleEdge;
+    ap_uint<32> fieldDrift;
+    ap_uint<32> suppressBasket;
+    ap_uint<32> repriceBasket;
+    ap_uint<32> memoHit;
+    ap_uint<32> memoReject;
+    ap_uint<32> annealIter;
+    ap_uint<32> latencyUpdateMin;
+    ap_uint<32> latencyUpdateMax;
+    ap_uint<32> latencyUpdateMean;
+    ap_uint<32> latencySolveMin;
+    ap_uint<32> latencySolveMax;
+    ap_uint<32> latencySolveMean;
+    ap_uint<32> latencyEmitMin;
+    ap_uint<32> latencyEmitMax;
+    ap_uint<32> latencyEmitMean;
+    ap_uint<32> latencyTotalMin;
+    ap_uint<32> latencyTotalMax;
+    ap_uint<32> latencyTotalMean;
+    ap_uint<32> traceCount;
+    ap_uint<32> traceTrigger;
+    ap_uint<32> recordDrop;
+    ap_uint<64> qualityAllZero;
+    ap_uint<64> qualityNoCycle;
+    ap_uint<64> qualityCycle;
+    ap_uint<64> qualityProfitable;
+    ap_uint<64> qualitySpinFlip;
+    ap_uint<64> qualityAncillaFlip;
+    ap_uint<64> txBasket;
+    ap_uint<64> snapshotCycle;
 } pricingEngineRegStatus_t;
 
+// Counters of a stage, sent to statusLatch at the end of every pass of the
+// stage. responsePull and eventHandler send their one counter on a
+// counterStream_t
+typedef hls::stream<ap_uint<64> > counterStream_t;
+
+typedef struct pricingEngineUpdateStatus_t {
+    ap_uint<64> processResponse;
+    ap_uint<64> conflateResponse;
+    ap_uint<32> solveRate;
+    ap_uint<32> staleEdge;
+    ap_uint<32> fieldDrift;
+    ap_uint<32> strategyNone;
+} pricingEngineUpdateStatus_t;
+
+typedef hls::stream<pricingEngineUpdateStatus_t> updateStatusStream_t;
+
+typedef struct pricingEngineSolveStatus_t {
+    ap_uint<64> solveProblem;
+    ap_uint<32> strategyPeg;
+    ap_uint<32> strategyLimit;
+    ap_uint<32> strategyUnknown;
+    ap_uint<32> debug;
+    ap_uint<32> suppressBasket;
+    ap_uint<32> repriceBasket;
+    ap_uint<32> memoHit;
+    ap_uint<32> memoReject;
+    ap_uint<32> annealIter;
+    ap_uint<64> qualityAllZero;
+    ap_uint<64> qualityNoCycle;
+    ap_uint<64> qualityCycle;
+    ap_uint<64> qualityProfitable;
+    ap_uint<64> qualitySpinFlip;
+    ap_uint<64> qualityAncillaFlip;
+    ap_uint<64> txBasket;
+} pricingEngineSolveStatus_t;
+
+typedef hls::stream<pricingEngineSolveStatus_t> solveStatusStream_t;
+
+typedef struct pricingEnginePushStatus_t {
+    ap_uint<64> txOperation;
+    ap_uint<32> latencyMin[PE_LATENCY_STAGES];
+    ap_uint<32> latencyMax[PE_LATENCY_STAGES];
+    ap_uint<32> latencyMean[PE_LATENCY_STAGES];
+    ap_uint<32> traceCount;
+    ap_uint<32> traceTrigger;
+    ap_uint<32> recordDrop;
+} pricingEnginePushStatus_t;
+
+typedef hls::stream<pricingEnginePushStatus_t> pushStatusStream_t;
+
+// Last status a stage sent, csim runs the stages ahead of statusLatch so it
+// takes the last of the call, the kernel takes at most one a cycle
+template <typename T>
+inline void latestStatus(hls::stream<T> &statusStream, T &status) {
+#pragma HLS INLINE
+#ifndef __SYNTHESIS__
+    while (!statusStream.empty()) status = statusStream.read();
+#else
+    if (!statusStream.empty()) status = statusStream.read();
+#endif
+}
+
 typedef struct pricingEngineRegStrategy_t {
     // 32b registers are wider than required here for some fields (e.g. select
     // and enable) but not sure what XRT does in terms of packing, potential to
@@ -78,30 +439,54 @@ typedef struct pricingEngineRegThresholds_t {
     ap_uint<32> threshold7;
 } pricingEngineRegThresholds_t;
 
-typedef struct pricingEngineCacheEntry_t {
-    ap_uint<32> bidPrice;
-    ap_uint<32> askPrice;
-    ap_uint<32> valid;
-} pricingEngineCacheEntry_t;
+// Per symbol trading cost loaded by the host, log domain fee plus expected
+// slippage as float bit patterns, taken off the logged rate of the edge
+typedef struct pricingEngineRegCost_t {
+    ap_uint<32> bidCost;
+    ap_uint<32> askCost;
+} pricingEngineRegCost_t;
 
 /**
  * PricingEngine Core
  */
 class PricingEngine {
    public:
-    void responsePull(ap_uint<32> &regRxResponse,
-                      orderBookResponseStreamPack_t &responseStreamPack,
-                      orderBookResponseStream_t &responseStream);
+    void cycleCounter(cycleStream_t &pullClock,
+                      cycleStream_t &updateClock,
+                      cycleStream_t &solveClock,
+                      cycleStream_t &pushClock,
+                      cycleStream_t &latchClock);
+
+    void responsePull(orderBookResponseStreamPack_t &responseStreamPack,
+                      orderBookResponseStream_t &responseStream,
+                      cycleStream_t &ingressStream,
+                      counterStream_t &statusStream,
+                      cycleStream_t &clockStream);
+
+    void problemUpdate(ap_uint<32> &regSchedule,
+                       ap_uint<32> &regSolveInterval,
+                       ap_uint<32> &regStaleAge,
+                       ap_uint<32> &regRebuildPeriod,
+                       pricingEngineRegCost_t *regCosts,
+                       orderBookResponseStream_t &responseStream,
+                       cycleStream_t &ingressStream,
+                       solveTriggerStream_t &triggerStream,
+                       isingProblemStream_t &problemStream,
+                       updateStatusStream_t &statusStream,
+                       cycleStream_t &clockStream);
 
     void pricingProcess(ap_uint<32> &regStrategyControl,
-                        ap_uint<32> &regProcessResponse,
-                        ap_uint<32> &regStrategyNone,
-                        ap_uint<32> &regStrategyPeg,
-                        ap_uint<32> &regStrategyLimit,
-                        ap_uint<32> &regStrategyUnknown,
+                        ap_uint<32> &regDedupAge,
+                        ap_uint<32> &regRepriceThreshold,
+                        ap_uint<32> &regSchedule,
+                        ap_uint<32> &regSolveBudget,
+                        ap_uint<32> &regConvergeSweeps,
                         pricingEngineRegStrategy_t *regStrategies,
-                        orderBookResponseStream_t &responseStream,
-                        orderEntryOperationStream_t &operationStream);
+                        isingProblemStream_t &problemStream,
+                        orderEntryOperationStream_t &operationStream,
+                        solveStampStream_t &stampStream,
+                        solveStatusStream_t &statusStream,
+                        cycleStream_t &clockStream);
 
     // ERM formulation validation
     // SBM parameter validation
@@ -111,13 +496,17 @@ class PricingEngine {
     // SBM solution validation
     bool checkExchCycle(bool spin[physical_bits]);
     bool checkProfitable(bool spin[physical_bits], float exch_logged_prices[physical_bits - 1]);
+    bool isLocalMinimum(bool spin[physical_bits], float J[physical_bits][physical_bits]);
+    float isingEnergy(bool spin[physical_bits], float J[physical_bits][physical_bits]);
 #ifndef __SYNTHESIS__
     bool checkSBMSolution(bool spin[physical_bits], float exch_logged_prices[physical_bits - 1]);
 #endif
 
     // For SBM
-    void ERM(int index, float logged_price, float M1, float M2,
-             float J[physical_bits][physical_bits], float exch_logged_rates[physical_bits - 1], bool &regInitConstr);
+    void ERM(int index, float logged_price, float M1, float M2, float M3,
+             float ancilla[physical_bits], float exch_logged_rates[physical_bits - 1], bool &regInitConstr);
+    void ERMConstraint(float M1, float M2, float M3, float J[physical_bits][physical_bits]);
+    void ERMAncillaConstraint(float M1, float M2, float M3, float ancilla[physical_bits]);
 
     // For SQA
     void ERM(int index, float logged_price, float M1, float M2,
@@ -125,7 +514,22 @@ class PricingEngine {
     void SBM(float Q_Matrix[physical_bits][physical_bits],
             dcal_t y[physical_bits], dcal_t x[physical_bits],
             int steps, float dt, float c0, dcal_t& best_energy,
-            int& best_step, bool best_spin[physical_bits], ap_uint<32> &regSBMExecStatus);
+            int& best_step, bool best_spin[physical_bits], ap_uint<32> &regSBMExecStatus,
+            int converge, bool anytime, int& executed);
+
+    // Sizes every leg of the cycles of the spins in legQuantity, 0 for the
+    // legs of a cycle that is not fillable and profitable, and returns the
+    // count of legs sized
+    ap_uint<BASKET_LEG_BITS> sizeCycle(bool spin[physical_bits],
+                                       pricingEngineDepth_t depth[NUM_PAIRS],
+                                       float cost[physical_bits - 1],
+                                       ap_uint<32> legQuantity[physical_bits - 1]);
+
+    bool dedupBasket(ap_uint<physical_bits - 1> legs,
+                     ap_uint<32> price[physical_bits - 1],
+                     ap_uint<64> timestamp,
+                     ap_uint<32> &regDedupAge,
+                     ap_uint<32> &regRepriceThreshold);
 
     bool pricingStrategyPeg(ap_uint<8> thresholdEnable,
                             ap_uint<32> thresholdPosition,
@@ -138,17 +542,56 @@ class PricingEngine {
                               orderEntryOperation_t &operation);
 
     void operationPush(ap_uint<32> &regCaptureControl,
-                       ap_uint<32> &regTxOperation,
                        ap_uint<1024> &regCaptureBuffer,
+                       ap_uint<32> *regLatency,
+                       ap_uint<PE_TRACE_BITS> *regTrace,
                        orderEntryOperationStream_t &operationStream,
-                       orderEntryOperationStreamPack_t &operationStreamPack);
+                       solveStampStream_t &stampStream,
+                       orderEntryOperationStreamPack_t &operationStreamPack,
+                       solveRecordStream_t &recordStream,
+                       orderTagStream_t &tagStream,
+                       pushStatusStream_t &statusStream,
+                       cycleStream_t &clockStream);
 
-    void eventHandler(ap_uint<32> &regRxEvent,
-                      clockTickGeneratorEventStream_t &eventStream);
+    void eventHandler(clockTickGeneratorEventStream_t &eventStream,
+                      solveTriggerStream_t &triggerStream,
+                      counterStream_t &statusStream);
+
+    void statusLatch(ap_uint<32> &regCaptureControl,
+                     pricingEngineRegStatus_t &regStatus,
+                     counterStream_t &pullStatus,
+                     counterStream_t &eventStatus,
+                     updateStatusStream_t &updateStatus,
+                     solveStatusStream_t &solveStatus,
+                     pushStatusStream_t &pushStatus,
+                     cycleStream_t &clockStream);
 
    private:
     // pricingEngineRegThresholds_t thresholds[NUM_SYMBOL];
     pricingEngineCacheEntry_t cache[NUM_SYMBOL];
+
+    // Latency statistics, owned by operationPush
+    ap_uint<32> latencyMin[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyMax[PE_LATENCY_STAGES] = {0};
+    ap_uint<64> latencySum[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyCount[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyHist[PE_LATENCY_STAGES][PE_LATENCY_BUCKETS] = {{0}};
+
+    void recordLatency(int stage, ap_uint<64> latency, ap_uint<32> *regLatency);
+    ap_uint<32> meanLatency(int stage);
+
+    // Duplicate suppression counts, owned by pricingProcess
+    ap_uint<32> countSuppressBasket = 0;
+    ap_uint<32> countRepriceBasket = 0;
+
+    // Decision trace state, owned by operationPush
+    ap_uint<32> traceCount = 0;
+    ap_uint<32> traceTrigger = 0;
+    ap_uint<32> tracePost = 0;
+
+    void recordTrace(pricingEngineSolveStamp_t &stamp, ap_uint<64> latency,
+                     ap_uint<32> &regCaptureControl,
+                     ap_uint<PE_TRACE_BITS> *regTrace);
 };
 
 #endif
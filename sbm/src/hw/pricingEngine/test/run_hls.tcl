@@ -21,7 +21,7 @@ set SOLN "sol"
 set CLKP 300MHz
 set CASE_ROOT [pwd]
 set KERNEL_ROOT "${CASE_ROOT}/../"
-set CFLAGS "-I${CASE_ROOT}/../../common/include -std=c++14"
+set CFLAGS "-I${CASE_ROOT}/../../common/include -std=c++14 -DQUBO_M3=${QUBO_M3}"
 
 open_project -reset $PROJ
 
@@ -39,6 +39,17 @@ create_clock -period $CLKP -name default
 
 if {$CSIM == 1} {
   csim_design
+  # the replay modes run on a book with an arbitrage so they have baskets to
+  # check, the backtest adds its arbitrage to the plain book from a csv
+  if {[info exists CSIM_MODES]} {
+    foreach mode $CSIM_MODES {
+      if {$mode == "backtest"} {
+        csim_design -argv "${CASE_ROOT}/ordBookResp.txt $mode ${CASE_ROOT}/arbBacktest.csv"
+      } else {
+        csim_design -argv "${CASE_ROOT}/arbBookResp.txt $mode"
+      }
+    }
+  }
 }
 
 if {$CSYNTH == 1} {
@@ -16,7 +16,7 @@
 
 set COMMON_DIR [pwd]/../common/include
 set KERNEL_DIR [pwd]
-set CFLAGS "-I${COMMON_DIR} -I${KERNEL_DIR} -std=c++14"
+set CFLAGS "-I${COMMON_DIR} -I${KERNEL_DIR} -std=c++14 -DQUBO_M3=$::env(QUBO_M3)"
 
 open_project -reset prj_pe
 add_files ${COMMON_DIR}/aat_interfaces.cpp -cflags ${CFLAGS}
@@ -8,7 +8,7 @@
 // [id*2 / id*2 + 1][0/1]
 //  id*2   => bid 
 //  id*2+1 => ask
-const int exch_index2id[PHYSICAL_BITS][2] = {
+constexpr int exch_index2id[PHYSICAL_BITS][2] = {
     {1, 3}, {3, 1}, {0, 4}, {4, 0}, {3, 2}, {2, 3}, {1, 2}, {2, 1}, {0, 2},
     {2, 0}, {3, 0}, {0, 3}, {1, 0}, {0, 1}, {1, 4}, {4, 1}, {4, 2}, {2, 4}};
 
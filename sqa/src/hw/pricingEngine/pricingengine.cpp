@@ -46,13 +46,71 @@ void convertByte2Float(float &dst, ap_uint<32> src)
     dst = tmp.fp_data;
 }
 
-#if !__SYNTHESIS__
+// log(1 + (i + 0.5) / 2^LOG_LUT_BITS) and its reciprocal argument
+static const float fastLogLut[1 << LOG_LUT_BITS] = {
+    7.782140281e-03f, 2.316705883e-02f, 3.831886500e-02f, 5.324451625e-02f,
+    6.795065850e-02f, 8.244366944e-02f, 9.672962874e-02f, 1.108143628e-01f,
+    1.247034818e-01f, 1.384023279e-01f, 1.519160420e-01f, 1.652495712e-01f,
+    1.784076542e-01f, 1.913948506e-01f, 2.042155415e-01f, 2.168739438e-01f,
+    2.293740958e-01f, 2.417199314e-01f, 2.539152205e-01f, 2.659635544e-01f,
+    2.778684497e-01f, 2.896333039e-01f, 3.012613356e-01f, 3.127557039e-01f,
+    3.241194785e-01f, 3.353555501e-01f, 3.464667797e-01f, 3.574558794e-01f,
+    3.683255613e-01f, 3.790783584e-01f, 3.897167444e-01f, 4.002431631e-01f,
+    4.106599391e-01f, 4.209693074e-01f, 4.311734736e-01f, 4.412745535e-01f,
+    4.512746334e-01f, 4.611757100e-01f, 4.709797204e-01f, 4.806885421e-01f,
+    4.903039932e-01f, 4.998278618e-01f, 5.092619061e-01f, 5.186077356e-01f,
+    5.278670788e-01f, 5.370414853e-01f, 5.461324453e-01f, 5.551415086e-01f,
+    5.640701652e-01f, 5.729197264e-01f, 5.816917419e-01f, 5.903874636e-01f,
+    5.990082026e-01f, 6.075552702e-01f, 6.160298586e-01f, 6.244332790e-01f,
+    6.327666640e-01f, 6.410312057e-01f, 6.492279172e-01f, 6.573580503e-01f,
+    6.654226184e-01f, 6.734226942e-01f, 6.813592315e-01f, 6.892333031e-01f,
+};
+
+static const float fastLogInv[1 << LOG_LUT_BITS] = {
+    9.922480583e-01f, 9.770992398e-01f, 9.624060392e-01f, 9.481481314e-01f,
+    9.343065619e-01f, 9.208633304e-01f, 9.078013897e-01f, 8.951048851e-01f,
+    8.827586174e-01f, 8.707482815e-01f, 8.590604067e-01f, 8.476821184e-01f,
+    8.366013169e-01f, 8.258064389e-01f, 8.152866364e-01f, 8.050314188e-01f,
+    7.950310707e-01f, 7.852760553e-01f, 7.757575512e-01f, 7.664670944e-01f,
+    7.573964596e-01f, 7.485380173e-01f, 7.398843765e-01f, 7.314285636e-01f,
+    7.231638432e-01f, 7.150837779e-01f, 7.071823478e-01f, 6.994535327e-01f,
+    6.918919086e-01f, 6.844919920e-01f, 6.772486567e-01f, 6.701570749e-01f,
+    6.632124186e-01f, 6.564102769e-01f, 6.497461796e-01f, 6.432160735e-01f,
+    6.368159056e-01f, 6.305418611e-01f, 6.243902445e-01f, 6.183574796e-01f,
+    6.124401689e-01f, 6.066350937e-01f, 6.009389758e-01f, 5.953488350e-01f,
+    5.898617506e-01f, 5.844748616e-01f, 5.791855454e-01f, 5.739910603e-01f,
+    5.688889027e-01f, 5.638766289e-01f, 5.589519739e-01f, 5.541125536e-01f,
+    5.493562222e-01f, 5.446808338e-01f, 5.400843620e-01f, 5.355648398e-01f,
+    5.311203599e-01f, 5.267489552e-01f, 5.224489570e-01f, 5.182186365e-01f,
+    5.140562057e-01f, 5.099601746e-01f, 5.059288740e-01f, 5.019608140e-01f,
+};
+
+float fastLog(ap_uint<32> src)
+{
+#pragma HLS INLINE
+    // src is the bit pattern of a positive normal float x = 2^e * m, m in [1, 2).
+    // The top mantissa bits select the interval centre c, m = c * (1 + r) with
+    // |r| < 2^-(LOG_LUT_BITS + 1), and log(1 + r) is a short polynomial.
+    int e = (int)src.range(30, 23).to_uint() - 127;
+    ap_uint<LOG_LUT_BITS> i = src.range(22, 23 - LOG_LUT_BITS);
+    float m;
+    convertByte2Float(m, (ap_uint<32>(127) << 23) | src.range(22, 0));
+
+    float r = m * fastLogInv[i] - 1.0f;
+    float p = r * (1.0f - r * (0.5f - r * (1.0f / 3)));
+
+    return e * FAST_LOG_LN2 + fastLogLut[i] + p;
+}
+
 bool PricingEngine::checkExchCycle(spin_t spin[NUM_SPIN])
 {
     // Check for exchange rate cycle
-    int lhs[NUM_CURRENCIES] = {0};
-    int rhs[NUM_CURRENCIES] = {0};
+    ap_uint<8> lhs[NUM_CURRENCIES] = {0};
+    ap_uint<8> rhs[NUM_CURRENCIES] = {0};
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = lhs
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = rhs
     for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
         if (spin[i] == 1) {
             lhs[exch_index2id[i][0]] += 1;
             rhs[exch_index2id[i][1]] += 1;
@@ -61,15 +119,14 @@ bool PricingEngine::checkExchCycle(spin_t spin[NUM_SPIN])
 
     bool hasCycle = 1;
     for (int i = 0; i < NUM_CURRENCIES; i++) {
-        if (lhs[i] != rhs[i]) {
-            hasCycle = 0;
-            break;
-        }
+#pragma HLS UNROLL
+        if (lhs[i] != rhs[i]) hasCycle = 0;
     }
 
     return hasCycle;
 }
 
+#if !__SYNTHESIS__
 bool PricingEngine::checkProfitable(spin_t spin[NUM_SPIN])
 {
     float logged_rate = 0;
@@ -120,9 +177,29 @@ void PricingEngine::checkSolution(spin_t spin[NUM_SPIN])
  * PricingEngine Core
  */
 
-void PricingEngine::responsePull(ap_uint<32> &regRxResponse,
-                                 orderBookResponseStreamPack_t &responseStreamPack,
-                                 orderBookResponseStream_t &responseStream)
+void PricingEngine::cycleCounter(cycleStream_t &pullClock, cycleStream_t &updateClock,
+                                 cycleStream_t &solveClock, cycleStream_t &pushClock,
+                                 cycleStream_t &latchClock)
+{
+#pragma HLS PIPELINE II = 1 style = flp
+
+    static ap_uint<64> cycle = 0;
+
+    ++cycle;
+
+    offerCycle(pullClock, cycle);
+    offerCycle(updateClock, cycle);
+    offerCycle(solveClock, cycle);
+    offerCycle(pushClock, cycle);
+    offerCycle(latchClock, cycle);
+
+    return;
+}
+
+void PricingEngine::responsePull(orderBookResponseStreamPack_t &responseStreamPack,
+                                 orderBookResponseStream_t &responseStream,
+                                 cycleStream_t &ingressStream, counterStream_t &statusStream,
+                                 cycleStream_t &clockStream)
 {
 #pragma HLS PIPELINE II = 1 style = flp
 
@@ -130,56 +207,320 @@ void PricingEngine::responsePull(ap_uint<32> &regRxResponse,
     orderBookResponsePack_t responsePack;
     orderBookResponse_t response;
 
-    static ap_uint<32> countRxResponse = 0;
+    static ap_uint<64> countRxResponse = 0;
 
-    if (!responseStreamPack.empty()) {
+    // drain the whole burst, the conflation in problemUpdate keeps it cheap
+    while (!responseStreamPack.empty()) {
         responsePack = responseStreamPack.read();
         intf.orderBookResponseUnpack(&responsePack, &response);
         responseStream.write(response);
+        ingressStream.write(sampleCycle(clockStream));
         ++countRxResponse;
     }
 
-    regRxResponse = countRxResponse;
+    statusStream.write(countRxResponse);
+
+    return;
+}
+
+void PricingEngine::problemUpdate(ap_uint<32> &regSchedule, ap_uint<32> &regSolveInterval,
+                                  ap_uint<32> &regStaleAge, ap_uint<32> &regRebuildPeriod,
+                                  pricingEngineRegCost_t *regCosts,
+                                  orderBookResponseStream_t &responseStream,
+                                  cycleStream_t &ingressStream,
+                                  solveTriggerStream_t &triggerStream,
+                                  isingProblemStream_t &problemStream,
+                                  updateStatusStream_t &statusStream, cycleStream_t &clockStream)
+{
+    orderBookResponse_t response;
+    isingProblem_t problem;
+    pricingEngineUpdateStatus_t status;
+    ap_uint<8> symbolIndex = 0;
+    ap_uint<64> tickTimestamp;
+    ap_uint<64> tickCycle;
+    float bidCost, askCost;
+    bool timerMode = (regSchedule & PE_SCHEDULE_TIMER);
+    bool idle = true;
+    ap_uint<32> rebuildPeriod = (regRebuildPeriod != 0) ? regRebuildPeriod
+                                                        : (ap_uint<32>)FIELD_REBUILD_PERIOD;
+
+    static ap_uint<64> countProcessResponse = 0;
+    static ap_uint<64> countConflateResponse = 0;
+
+    // Solve scheduling, a tick arms the trigger once the minimum interval since
+    // the last triggered solve has elapsed, the trigger is held until it is used
+    static bool trigger = false;
+    static ap_uint<64> triggerTimestamp = 0;
+    static ap_uint<64> lastSolveTimestamp = 0;
+    static ap_uint<32> countRateTick = 0;
+    static ap_uint<32> countRateSolve = 0;
+    static ap_uint<32> solveRate = 0;
+
+    // Pull cycle of the oldest response not yet in a snapshot
+    static ap_uint<64> ingressCycle = 0;
+    static bool ingressValid = false;
+    ap_uint<64> ingress;
+
+    // Shadow local field, ERM keeps folding market updates in here while the
+    // solver anneals on the snapshot it has already picked up
+    static fp_t h[NUM_SPIN] = {0};
+    static orderBookResponse_t latestResponse;
+    static bool pending = false;
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = h
+
+    // Constraint part of h, the exact field is h_constraint - logged rate / 2.
+    // The incremental update drifts with float rounding, so h is rebuilt from
+    // here once rebuildPeriod edge updates have been applied and no market
+    // update is in flight
+    static fp_t h_constraint[NUM_SPIN] = {0};
+    static bool init_field = false;
+    static ap_uint<32> countFieldUpdate = 0;
+    static float fieldDrift = 0;
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = h_constraint
+
+    // Conflation book, latest top of book per symbol not yet folded into h,
+    // unseen marks symbols updated since the solver took the last snapshot
+    static pricingEngineCacheEntry_t book[NUM_PAIRS];
+    static ap_uint<NUM_PAIRS> dirty = 0;
+    static ap_uint<NUM_PAIRS> unseen = 0;
+    static pricingEngineDepth_t depth[NUM_PAIRS];
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = book
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = depth
+
+    // Quote staleness, pull cycle of the last update per edge and the edges
+    // expired by the sweep, stale edges are clamped off in the snapshot only
+    // so that the shadow h is restored as soon as the pair quotes again
+    static ap_uint<64> edgeCycle[PHYSICAL_BITS] = {0};
+    static ap_uint<PHYSICAL_BITS> stale = 0;
+    static bool restage = false;
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = edgeCycle
+
+    if (!init_field) {
+        initField(QUBO_M1, QUBO_M2, QUBO_M3, h_constraint);
+        init_field = true;
+    }
+
+    while (!responseStream.empty()) {
+        response = responseStream.read();
+        ingress = ingressStream.read();
+        ++countProcessResponse;
+        idle = false;
+        if (!ingressValid) {
+            ingressCycle = ingress;
+            ingressValid = true;
+        }
+
+        // symbols outside of the Ising model are of no use to the solver
+        symbolIndex = response.symbolIndex;
+        if (symbolIndex < NUM_PAIRS) {
+            // an update the solver has not seen yet is superseded
+            if (unseen[symbolIndex]) {
+                ++countConflateResponse;
+            }
+            book[symbolIndex].bidPrice = response.bidPrice.range(31, 0);
+            book[symbolIndex].askPrice = response.askPrice.range(31, 0);
+            book[symbolIndex].valid = true;
+            depth[symbolIndex].bidPrice = response.bidPrice;
+            depth[symbolIndex].bidQuantity = response.bidQuantity;
+            depth[symbolIndex].askPrice = response.askPrice;
+            depth[symbolIndex].askQuantity = response.askQuantity;
+            dirty[symbolIndex] = 1;
+            unseen[symbolIndex] = 1;
+            latestResponse = response;
+
+            // *2 => bid *2+1 => ask, aged on the kernel clock and not on
+            // the exchange timestamp of the response
+            edgeCycle[symbolIndex * 2] = ingress;
+            edgeCycle[symbolIndex * 2 + 1] = ingress;
+            if (stale.range(symbolIndex * 2 + 1, symbolIndex * 2) != 0) {
+                stale.range(symbolIndex * 2 + 1, symbolIndex * 2) = 0;
+                restage = true;
+            }
+        }
+    }
+
+    if (!triggerStream.empty()) {
+        tickTimestamp = triggerStream.read();
+        if (!trigger && tickTimestamp - lastSolveTimestamp >= regSolveInterval) {
+            trigger = true;
+            triggerTimestamp = tickTimestamp;
+        }
+
+        // solves handed over during the last SOLVE_RATE_TICKS clock ticks
+        if (++countRateTick == SOLVE_RATE_TICKS) {
+            solveRate = countRateSolve;
+            countRateTick = 0;
+            countRateSolve = 0;
+        }
+
+        // expiry sweep, a zero age disables expiry
+        tickCycle = sampleCycle(clockStream);
+        for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+            if (regStaleAge != 0 && !stale[i] && tickCycle - edgeCycle[i] > regStaleAge) {
+                stale[i] = 1;
+                restage = true;
+            }
+        }
+    }
+
+    // Apply ERM once for every dirty symbol, repeated updates of a symbol in a
+    // burst are folded into h only once
+    if (dirty != 0) {
+        for (int s = 0; s < NUM_PAIRS; s++) {
+            if (dirty[s]) {
+                // NOTE: input data are float bit patterns, bid and ask are
+                // converted by two independent fast log units. The edge
+                // cost is taken off here so the annealer sees net rates, a
+                // new cost table applies from the next update of the pair
+                convertByte2Float(bidCost, regCosts[s].bidCost);
+                convertByte2Float(askCost, regCosts[s].askCost);
+                float logged_bid = fastLog(book[s].bidPrice) - bidCost;
+                float logged_ask = fastLog(book[s].askPrice) - askCost;
+                runERM(s * 2, logged_bid, QUBO_M1, QUBO_M2, QUBO_M3, h);
+                runERM(s * 2 + 1, logged_ask, QUBO_M1, QUBO_M2, QUBO_M3, h);
+                countFieldUpdate += 2;
+            }
+        }
+        dirty = 0;
+        pending = true;
+    } else if (idle && countFieldUpdate >= rebuildPeriod) {
+        // background rebuild, also records the largest drift corrected so far
+        for (int i = 0; i < NUM_SPIN; i++) {
+#pragma HLS UNROLL
+            fp_t exact = h_constraint[i] - this->exch_logged_rates[i] / 2;
+            float drift = fabs(h[i] - exact);
+            if (drift > fieldDrift) {
+                fieldDrift = drift;
+            }
+            h[i] = exact;
+        }
+        countFieldUpdate = 0;
+    }
+
+    // Once the solver has taken the previous snapshot swap the shadow h in, so
+    // a burst costs a single solve. In timer mode market updates only refresh
+    // h until a tick fires.
+    if ((pending || restage) && !problemStream.full() && (!timerMode || trigger)) {
+        pending = false;
+        restage = false;
+
+        // Make sure there is no empty price fields
+        if (this->exch_logged_rates[PHYSICAL_BITS - 1] != 0) {
+            problem.response = latestResponse;
+            // a snapshot restaged by the expiry sweep alone has no response behind it
+            problem.ingress = ingressValid ? ingressCycle : (ap_uint<64>)0;
+            ingressValid = false;
+            for (int i = 0; i < NUM_SPIN; i++) {
+#pragma HLS UNROLL
+                // a large positive field pins the spin of a stale edge to -1 (not traded)
+                problem.h[i] = (i < PHYSICAL_BITS && stale[i]) ? (fp_t)(h[i] + STALE_CLAMP) : h[i];
+            }
+            for (int s = 0; s < NUM_PAIRS; s++) {
+#pragma HLS UNROLL
+                problem.book[s] = book[s];
+                problem.depth[s] = depth[s];
+                convertByte2Float(problem.cost[s * 2], regCosts[s].bidCost);
+                convertByte2Float(problem.cost[s * 2 + 1], regCosts[s].askCost);
+            }
+            problemStream.write(problem);
+            unseen = 0;
+            ++countRateSolve;
+            if (trigger) {
+                lastSolveTimestamp = triggerTimestamp;
+                trigger = false;
+            }
+        }
+    }
+
+    status.processResponse = countProcessResponse;
+    status.conflateResponse = countConflateResponse;
+    status.solveRate = solveRate;
+    status.staleEdge = stale;
+    convertFloat2Byte(status.fieldDrift, fieldDrift);
+    statusStream.write(status);
 
     return;
 }
 
-void PricingEngine::pricingProcess(ap_uint<32> &regStrategyControl, ap_uint<32> &regProcessResponse,
-                                   ap_uint<32> &regStrategyNone, ap_uint<32> &regStrategyPeg,
-                                   ap_uint<32> &regStrategyLimit, ap_uint<32> &regStrategyUnknown,
-                                   pricingEngineRegStatus_t &regStatus,
+void PricingEngine::pricingProcess(ap_uint<32> &regStrategyControl,
                                    pricingEngineRegControl_t &regControl,
                                    pricingEngineRegStrategy_t *regStrategies,
-                                   orderBookResponseStream_t &responseStream,
-                                   orderEntryOperationStream_t &operationStream)
+                                   isingProblemStream_t &problemStream,
+                                   orderEntryOperationStream_t &operationStream,
+                                   solveStampStream_t &stampStream,
+                                   solveStatusStream_t &statusStream, cycleStream_t &clockStream)
 {
     // #pragma HLS PIPELINE II = 1 style = flp
 
     mmInterface intf;
+    isingProblem_t problem;
     orderBookResponse_t response;
     orderEntryOperation_t operation;
+    pricingEngineSolveStamp_t stamp;
     ap_uint<8> symbolIndex = 0;
     ap_uint<8> strategySelect = 0;
     ap_uint<8> thresholdEnable = 0;
     ap_uint<8> thresholdPosition = 0;
+    ap_uint<32> legQuantity[PHYSICAL_BITS];
+    ap_uint<BASKET_LEG_BITS> legCount = 0;
+    ap_uint<BASKET_LEG_BITS> sendCount = 0;
+    ap_uint<8> verdict = 0;
+    ap_uint<32> iterations = 0;
+    ap_uint<64> solveStart = 0;
     bool orderExecute = false;
 
-    static ap_uint<32> orderId = 0;
-    static ap_uint<32> countProcessResponse = 0;
+    // Top of book of every symbol as of the snapshot the solver ran on, each
+    // leg is priced from its own symbol
+    pricingEngineCacheEntry_t top[NUM_PAIRS];
+    ap_uint<PHYSICAL_BITS> legs = 0;
+    ap_uint<32> legPrice[PHYSICAL_BITS];
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = top
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = legPrice
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = legQuantity
+
+    static ap_uint<64> countBasket = 0;
+    static ap_uint<64> countSolveProblem = 0;
     static ap_uint<32> countStrategyNone = 0;
     static ap_uint<32> countStrategyPeg = 0;
     static ap_uint<32> countStrategyLimit = 0;
     static ap_uint<32> countStrategyUnknown = 0;
 
-    // Start of QUBO formulation parameters
-    const float M1 = 10;  // 50;
-    const float M2 = 10;  // 25;
+    // Solver debug registers, filled in by runSQA
+    static pricingEngineSolveStatus_t status;
+
+    // Solution quality
+    static ap_uint<PHYSICAL_BITS> lastLegs = 0;
+    static ap_uint<64> countAllZero = 0;
+    static ap_uint<64> countNoCycle = 0;
+    static ap_uint<64> countCycle = 0;
+    static ap_uint<64> countProfitable = 0;
+    static ap_uint<64> countSpinFlip = 0;
+    ap_uint<PHYSICAL_BITS> flipped = 0;
+    ap_uint<8> countFlipped = 0;
 
     // For SQA ONLY
     static fp_t J[NUM_SPIN][NUM_SPIN] = {0};
-    static fp_t h[NUM_SPIN] = {0};
+    static bool init_coupling = false;
     static spin_t spins[NUM_SPIN];
+    fp_t h[NUM_SPIN];
+
+    // Solution memo keyed by the sign pattern of h
+    static pricingEngineMemoEntry_t memo[MEMO_DEPTH];
+    static ap_uint<8> memoNext = 0;
+    static ap_uint<32> countMemoHit = 0;
+    static ap_uint<32> countMemoReject = 0;
+    bool memoEnable = (regControl.schedule & PE_SCHEDULE_MEMO);
+    bool memoHit = false;
+    ap_uint<PHYSICAL_BITS> signature = 0;
+    int slot = -1;
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = memo
+#if QMC_COLORING
+    // every row of a colour is read in the same stage, the rows of a colour can share a bank
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = J
+#else
 #pragma HLS ARRAY_PARTITION dim = 1 type = cyclic factor = 4 variable = J
+#endif
 #pragma HLS ARRAY_RESHAPE dim = 2 type = complete variable = J
 #pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = h
 #pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = spins
@@ -188,10 +529,18 @@ void PricingEngine::pricingProcess(ap_uint<32> &regStrategyControl, ap_uint<32>
     if (regControl.reserved04 == 0) convertFloat2Byte(regControl.reserved04, 5.0f);   // Gamma
     if (regControl.reserved05 == 0) convertFloat2Byte(regControl.reserved05, 0.05f);  // T
 
+    // J only holds the constraint terms, build it once
+    if (!init_coupling) {
+        initCoupling(QUBO_M1, QUBO_M2, QUBO_M3, J);
+        init_coupling = true;
+    }
+
     // Start of original AAT code
-    if (!responseStream.empty()) {
-        response = responseStream.read();
-        ++countProcessResponse;
+    if (!problemStream.empty()) {
+        problem = problemStream.read();
+        solveStart = sampleCycle(clockStream);
+        response = problem.response;
+        ++countSolveProblem;
 
         symbolIndex = response.symbolIndex;
         thresholdEnable = regStrategies[symbolIndex].enable.range(7, 0);
@@ -227,58 +576,396 @@ void PricingEngine::pricingProcess(ap_uint<32> &regStrategyControl, ap_uint<32>
         // }
         // end of original aat code
 
-        // NOTE: input data originally is uint and we static_cast it to float
-        unsigned int bidprice = response.bidPrice.range(31, 0);
-        unsigned int askprice = response.askPrice.range(31, 0);
-        int exch_id = ((int)response.symbolIndex) * 2;
-        runERM(exch_id, log(reinterpret_cast<float &>(bidprice)), M1, M2, J, h);
-        runERM(exch_id + 1, log(reinterpret_cast<float &>(askprice)), M1, M2, J, h);
+        // Active local field, problemUpdate keeps writing its shadow copy
+        for (int i = 0; i < NUM_SPIN; i++) {
+#pragma HLS UNROLL
+            h[i] = problem.h[i];
+        }
+        for (int s = 0; s < NUM_PAIRS; s++) {
+#pragma HLS UNROLL
+            top[s] = problem.book[s];
+        }
 
-        // Make sure there is no empty price fields
-        if (this->exch_logged_rates[PHYSICAL_BITS - 1] != 0) {
+        // A solution cached for the same sign pattern of h is taken over when it is still a local
+        // minimum, so a tick that cannot move the optimum skips the anneal
+        if (memoEnable) {
+            for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+                signature[i] = (h[i] < 0);
+            }
+            for (int d = 0; d < MEMO_DEPTH; d++) {
+#pragma HLS UNROLL
+                if (memo[d].valid && memo[d].signature == signature) slot = d;
+            }
+            if (slot >= 0) {
+                for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+                    spins[i] = memo[slot].spins[i];
+                }
+                memoHit = isLocalMinimum(spins, J, h);
+                if (memoHit) {
+                    ++countMemoHit;
+                } else {
+                    ++countMemoReject;
+                }
+            }
+        }
+
+        if (memoHit) {
+            status.debug = 0;
+            status.annealIter = 0;
+        } else {
             // RUN SQA
-            runSQA(spins, J, h, regStatus, regControl);
+            iterations = runSQA(spins, J, h, status, regControl);
+
+            if (memoEnable) {
+                // a rejected entry is refreshed in place, a new pattern replaces round robin
+                if (slot < 0) {
+                    slot = memoNext;
+                    memoNext = (memoNext + 1 == MEMO_DEPTH) ? (ap_uint<8>)0
+                                                            : (ap_uint<8>)(memoNext + 1);
+                }
+                memo[slot].signature = signature;
+                for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+                    memo[slot].spins[i] = spins[i];
+                }
+                memo[slot].valid = true;
+            }
+        }
 
 #if !__SYNTHESIS__ && CHECK_SOLUTION
-            // Check Profitable or Not
-            checkSolution(spins);
+        // Check Profitable or Not
+        checkSolution(spins);
 #endif
 
-            // Write out Operations based on SQA result
-            for (unsigned int i = 0; i < PHYSICAL_BITS; i++) {
-                if (spins[i]) {
-                    operation.orderId = ++orderId;
-                    operation.timestamp = response.timestamp;
-                    operation.opCode = ORDERENTRY_ADD;
-                    operation.quantity = 1;  // change to 1
-                    operation.symbolIndex = i / 2;
-                    if ((i & 1) == 1) {  // direction ask
-                        operation.price = response.askPrice.range(31, 0);
-                        operation.direction = ORDER_ASK;
-                    } else {  // direction bid
-                        operation.price = (response.bidPrice.range(31, 0));
-                        operation.direction = ORDER_BID;
-                    }
-                    operationStream.write(operation);
+        // Write out Operations based on SQA result
+        // every cycle of the spins is sized to the largest notional the book
+        // depth can fill while it stays profitable, the legs of a cycle that
+        // is not profitable even at the top of book are left out
+        sendCount = sizeCycle(spins, problem.depth, problem.cost, legQuantity);
+
+        // every leg carries the basket ID and the count of legs sent so that
+        // order entry can tell where a basket ends
+        for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+            legCount += spins[i];
+            legs[i] = spins[i];
+            legPrice[i] = (i & 1) ? top[i / 2].askPrice : top[i / 2].bidPrice;
+        }
+        verdict = (legCount == 0) ? PE_VERDICT_NONE : (sendCount == 0) ? PE_VERDICT_REJECT
+                                                                       : PE_VERDICT_SEND;
+
+        // quality of the spins as solved, before duplicate suppression
+        if (legCount == 0) {
+            ++countAllZero;
+        } else if (!checkExchCycle(spins)) {
+            ++countNoCycle;
+        } else {
+            ++countCycle;
+            if (sendCount != 0) ++countProfitable;
+        }
+        flipped = legs ^ lastLegs;
+        for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+            countFlipped += flipped[i];
+        }
+        countSpinFlip += countFlipped;
+        lastLegs = legs;
+
+        // the same cycle at the same prices is already in flight
+        if (sendCount != 0 &&
+            dedupBasket(legs, legPrice, response.timestamp, regControl.dedupAge,
+                        regControl.repriceThreshold)) {
+            sendCount = 0;
+            verdict = PE_VERDICT_SUPPRESS;
+        }
+        if (sendCount != 0) {
+            ++countBasket;
+        }
+        if (memoHit) verdict |= PE_VERDICT_MEMO;
+
+        // the end of the solve goes ahead of its legs, with what the decision trace keeps of it
+        stamp.ingress = (problem.ingress != 0) ? problem.ingress : solveStart;
+        stamp.solveStart = solveStart;
+        stamp.solveEnd = sampleCycle(clockStream);
+        stamp.legs = sendCount;
+        stamp.timestamp = response.timestamp;
+        stamp.symbol = symbolIndex;
+        stamp.verdict = verdict;
+        stamp.hBid = 0;
+        stamp.hAsk = 0;
+        if (symbolIndex < NUM_PAIRS) {
+            convertFloat2Byte(stamp.hBid, h[symbolIndex * 2]);
+            convertFloat2Byte(stamp.hAsk, h[symbolIndex * 2 + 1]);
+        }
+        stamp.spins = legs;
+        convertFloat2Byte(stamp.energy, isingEnergy(spins, J, h));
+        stamp.iterations = (iterations > 0xffff) ? (ap_uint<16>)0xffff : (ap_uint<16>)iterations;
+        stampStream.write(stamp);
+
+        for (unsigned int i = 0; i < PHYSICAL_BITS; i++) {
+            if (sendCount != 0 && legQuantity[i] != 0) {
+                operation.timestamp = response.timestamp;
+                operation.opCode = ORDERENTRY_ADD;
+                operation.quantity = legQuantity[i];
+                operation.symbolIndex = i / 2;
+                operation.price = legPrice[i];
+                if ((i & 1) == 1) {  // direction ask
+                    operation.direction = ORDER_ASK;
+                } else {  // direction bid
+                    operation.direction = ORDER_BID;
                 }
+                operationStream.write(operation);
             }
-
-            // if (orderExecute) {
-            //     operation.orderId = ++orderId;
-            //     operationStream.write(operation);
-            // }
         }
+
+        // if (orderExecute) {
+        //     operation.orderId = ++orderId;
+        //     operationStream.write(operation);
+        // }
     }
 
-    regProcessResponse = countProcessResponse;
-    regStrategyNone = countStrategyNone;
-    regStrategyPeg = countStrategyPeg;
-    regStrategyLimit = countStrategyLimit;
-    regStrategyUnknown = countStrategyUnknown;
+    status.solveProblem = countSolveProblem;
+    status.strategyNone = countStrategyNone;
+    status.strategyPeg = countStrategyPeg;
+    status.strategyLimit = countStrategyLimit;
+    status.strategyUnknown = countStrategyUnknown;
+    status.suppressBasket = countSuppressBasket;
+    status.repriceBasket = countRepriceBasket;
+    status.memoHit = countMemoHit;
+    status.memoReject = countMemoReject;
+    status.qualityAllZero = countAllZero;
+    status.qualityNoCycle = countNoCycle;
+    status.qualityCycle = countCycle;
+    status.qualityProfitable = countProfitable;
+    status.qualitySpinFlip = countSpinFlip;
+    status.txBasket = countBasket;
+    statusStream.write(status);
 
     return;
 }
 
+bool PricingEngine::dedupBasket(ap_uint<PHYSICAL_BITS> legs, ap_uint<32> price[PHYSICAL_BITS],
+                                ap_uint<64> timestamp, ap_uint<32> &regDedupAge,
+                                ap_uint<32> &regRepriceThreshold)
+{
+    float threshold, sent, now;
+    int slot = -1;
+    bool moved = false;
+
+    static pricingEngineDedupEntry_t dedup[DEDUP_DEPTH];
+    static ap_uint<8> dedupNext = 0;
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = dedup
+
+    if (regDedupAge == 0) return false;
+
+    // every entry is compared in parallel, an entry older than the age has expired
+    for (int d = 0; d < DEDUP_DEPTH; d++) {
+#pragma HLS UNROLL
+        if (dedup[d].valid && dedup[d].legs == legs &&
+            timestamp - dedup[d].timestamp <= regDedupAge) {
+            slot = d;
+        }
+    }
+
+    if (slot >= 0) {
+        convertByte2Float(threshold, regRepriceThreshold);
+        for (int e = 0; e < PHYSICAL_BITS; e++) {
+#pragma HLS UNROLL
+            convertByte2Float(sent, dedup[slot].price[e]);
+            convertByte2Float(now, price[e]);
+            if (legs[e] && fabs(now - sent) > threshold * sent) moved = true;
+        }
+        if (!moved) {
+            ++countSuppressBasket;
+            return true;
+        }
+        ++countRepriceBasket;
+    } else {
+        // round robin replacement of the oldest basket sent
+        slot = dedupNext;
+        dedupNext = (dedupNext + 1 == DEDUP_DEPTH) ? (ap_uint<8>)0 : (ap_uint<8>)(dedupNext + 1);
+    }
+
+    dedup[slot].legs = legs;
+    dedup[slot].timestamp = timestamp;
+    for (int e = 0; e < PHYSICAL_BITS; e++) {
+#pragma HLS UNROLL
+        dedup[slot].price[e] = price[e];
+    }
+    dedup[slot].valid = true;
+
+    return false;
+}
+
+bool PricingEngine::isLocalMinimum(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
+                                   float h[NUM_SPIN])
+{
+    // With s = +-1, flipping spin i changes the energy by -2 * s_i * (h_i + 2 * sum_j J_ij * s_j),
+    // the same local field the trotter units flip on
+    bool minimum = true;
+
+    for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS PIPELINE
+        fp_t local = h[i];
+        for (int j = 0; j < PHYSICAL_BITS; j++) {
+            local += spins[j] ? 2 * J[i][j] : -2 * J[i][j];
+        }
+        if ((spins[i] ? local : -local) > 0) minimum = false;
+    }
+
+    return minimum;
+}
+
+fp_t PricingEngine::isingEnergy(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
+                                float h[NUM_SPIN])
+{
+    // E = sum_i s_i * (h_i + sum_j J_ij * s_j) with s = +-1, the energy the flips descend
+    fp_t energy = 0;
+
+    for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS PIPELINE
+        fp_t local = h[i];
+        for (int j = 0; j < PHYSICAL_BITS; j++) {
+            local += spins[j] ? J[i][j] : -J[i][j];
+        }
+        energy += spins[i] ? local : -local;
+    }
+
+    return energy;
+}
+
+ap_uint<BASKET_LEG_BITS> PricingEngine::sizeCycle(spin_t spin[NUM_SPIN],
+                                                  pricingEngineDepth_t depth[NUM_PAIRS],
+                                                  fp_t cost[PHYSICAL_BITS],
+                                                  ap_uint<32> legQuantity[PHYSICAL_BITS])
+{
+    // price and cumulative quantity ladder per edge, bid edges walk the bid
+    // side and ask edges the ask side of their symbol
+    float price[PHYSICAL_BITS][NUM_LEVEL];
+    ap_uint<32> cumQuantity[PHYSICAL_BITS][NUM_LEVEL];
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = price
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = cumQuantity
+
+    // the legs of a basket split into closed trails, each walked leg by leg.
+    // order holds the legs of one trail as they are walked and reach[p] the
+    // top of book rate from its first currency to leg p
+    int order[PHYSICAL_BITS];
+    float reach[PHYSICAL_BITS];
+    ap_uint<32> size[PHYSICAL_BITS];
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = order
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = reach
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = size
+    ap_uint<PHYSICAL_BITS> walked = 0;
+    ap_uint<BASKET_LEG_BITS> sized = 0;
+
+    for (int e = 0; e < PHYSICAL_BITS; e++) {
+#pragma HLS UNROLL
+        ap_uint<160> levelPrice = (e & 1) ? depth[e / 2].askPrice : depth[e / 2].bidPrice;
+        ap_uint<160> levelQuantity = (e & 1) ? depth[e / 2].askQuantity : depth[e / 2].bidQuantity;
+        ap_uint<32> cum = 0;
+        for (int k = 0; k < NUM_LEVEL; k++) {
+            cum += levelQuantity.range(32 * k + 31, 32 * k);
+            cumQuantity[e][k] = cum;
+            convertByte2Float(price[e][k], levelPrice.range(32 * k + 31, 32 * k));
+        }
+        legQuantity[e] = 0;
+    }
+
+    for (int r = 0; r < PHYSICAL_BITS / 2; r++) {
+        // walk the next trail from the currency of its lowest leg, always on
+        // the lowest leg out of the currency reached, a path that does not
+        // close is not sized
+        int start = -1;
+        for (int e = PHYSICAL_BITS - 1; e >= 0; e--) {
+#pragma HLS UNROLL
+            if (spin[e] == 1 && !walked[e]) start = exch_index2id[e][0];
+        }
+        if (start < 0) continue;
+
+        float rate = 1.0f;
+        int currency = start;
+        int trailLength = 0;
+        bool closed = false;
+        for (int p = 0; p < PHYSICAL_BITS; p++) {
+            int e = -1;
+            for (int f = PHYSICAL_BITS - 1; f >= 0; f--) {
+#pragma HLS UNROLL
+                if (spin[f] == 1 && !walked[f] && exch_index2id[f][0] == currency) e = f;
+            }
+            order[p] = 0;
+            reach[p] = 0;
+            if (!closed && e >= 0) {
+                walked[e] = 1;
+                order[p] = e;
+                reach[p] = rate;
+                rate *= price[e][0];
+                currency = exch_index2id[e][1];
+                closed = (currency == start);
+                ++trailLength;
+            }
+        }
+        if (!closed) continue;
+
+        // Candidate notionals are the level boundaries of the legs taken back
+        // to the first currency at the top of book. A candidate is carried leg
+        // to leg, each leg sized at what reaches it and converted at its own
+        // VWAP, and the largest notional that every leg can fill whose summed
+        // logged VWAP net of the edge costs stays positive wins. The leg a
+        // candidate comes from is capped at its boundary, so float rounding of
+        // the carry never pushes it past the depth it was taken from
+        float bestNotional = 0;
+        for (int c = 0; c < PHYSICAL_BITS * NUM_LEVEL; c++) {
+            int cp = c / NUM_LEVEL;
+            int ck = c % NUM_LEVEL;
+            if (cp >= trailLength || reach[cp] <= 0) continue;
+            float notional = (float)cumQuantity[order[cp]][ck].to_uint() / reach[cp];
+            if (notional < 1.0f || notional <= bestNotional) continue;
+
+            float amount = notional;
+            float gain = 0;
+            bool fillable = true;
+            for (int p = 0; p < PHYSICAL_BITS; p++) {
+                if (p < trailLength) {
+                    int e = order[p];
+                    float value = 0;
+                    ap_uint<32> filled = 0;
+                    size[p] = (ap_uint<32>)(amount + 0.5f);
+                    if (p == cp && size[p] > cumQuantity[e][ck]) size[p] = cumQuantity[e][ck];
+                    for (int k = 0; k < NUM_LEVEL; k++) {
+                        ap_uint<32> fill = 0;
+                        if (size[p] > filled) {
+                            fill = (size[p] < cumQuantity[e][k])
+                                       ? (ap_uint<32>)(size[p] - filled)
+                                       : (ap_uint<32>)(cumQuantity[e][k] - filled);
+                            filled += fill;
+                        }
+                        value += (float)fill.to_uint() * price[e][k];
+                    }
+                    fillable = fillable && (size[p] != 0) && (filled == size[p]);
+                    if (size[p] != 0) {
+                        ap_uint<32> vwap;
+                        convertFloat2Byte(vwap, value / (float)size[p].to_uint());
+                        gain += fastLog(vwap) - cost[e];
+                    }
+                    amount = value;
+                }
+            }
+            if (fillable && gain > 0) {
+                bestNotional = notional;
+                for (int p = 0; p < PHYSICAL_BITS; p++) {
+#pragma HLS UNROLL
+                    if (p < trailLength) legQuantity[order[p]] = size[p];
+                }
+            }
+        }
+        if (bestNotional > 0) sized += trailLength;
+    }
+
+    return sized;
+}
+
 bool PricingEngine::pricingStrategyPeg(ap_uint<8> thresholdEnable, ap_uint<32> thresholdPosition,
                                        orderBookResponse_t &response,
                                        orderEntryOperation_t &operation)
@@ -351,59 +1038,272 @@ bool PricingEngine::pricingStrategyLimit(ap_uint<8> thresholdEnable, ap_uint<32>
     return executeOrder;
 }
 
-void PricingEngine::operationPush(ap_uint<32> &regCaptureControl, ap_uint<32> &regTxOperation,
-                                  ap_uint<1024> &regCaptureBuffer,
+void PricingEngine::operationPush(ap_uint<32> &regCaptureControl,
+                                  ap_uint<1024> &regCaptureBuffer, ap_uint<32> *regLatency,
+                                  ap_uint<PE_TRACE_BITS> *regTrace,
                                   orderEntryOperationStream_t &operationStream,
-                                  orderEntryOperationStreamPack_t &operationStreamPack)
+                                  solveStampStream_t &stampStream,
+                                  orderEntryOperationStreamPack_t &operationStreamPack,
+                                  solveRecordStream_t &recordStream,
+                                  orderTagStream_t &tagStream, pushStatusStream_t &statusStream,
+                                  cycleStream_t &clockStream)
 {
 #pragma HLS PIPELINE II = 1 style = flp
 
     mmInterface intf;
     orderEntryOperation_t operation;
     orderEntryOperationPack_t operationPack;
+    pricingEngineSolveStamp_t stamp;
+    pricingEnginePushStatus_t status;
+    ap_uint<PE_RECORD_BITS> record;
+    ap_uint<PE_TAG_BITS> tag;
+
+    static ap_uint<64> countTxOperation = 0;
+    static ap_uint<32> countTxBasket = 0;
+    static ap_uint<32> countRecordDrop = 0;
+
+    // every solve leaves a stamp, the legs of its basket follow it
+    while (!stampStream.empty()) {
+        stamp = stampStream.read();
+        recordLatency(PE_LATENCY_UPDATE, stamp.solveStart - stamp.ingress, regLatency);
+        recordLatency(PE_LATENCY_SOLVE, stamp.solveEnd - stamp.solveStart, regLatency);
+
+        // a basket leaves in one burst, once its first leg is out the rest of
+        // the legs are waited for so baskets are never split or interleaved
+        ap_uint<64> egress = stamp.solveEnd;
+        for (ap_uint<BASKET_LEG_BITS> leg = 0; leg < stamp.legs; leg++) {
+            operation = operationStream.read();
+            operation.orderId = countTxOperation.range(31, 0);
+
+            intf.orderEntryOperationPack(&operation, &operationPack);
+            operationStreamPack.write(operationPack);
+            ++countTxOperation;
+
+            // egress of the basket goes to its solution record, of every order to its tag
+            egress = sampleCycle(clockStream);
+            tag = 0;
+            ORDER_TAG_ID(tag) = operation.orderId;
+            ORDER_TAG_BASKET(tag) = countTxBasket;
+            ORDER_TAG_LEG_INDEX(tag) = leg;
+            ORDER_TAG_LEG_COUNT(tag) = stamp.legs;
+            ORDER_TAG_INGRESS(tag) = stamp.ingress;
+            ORDER_TAG_EGRESS(tag) = egress;
+            if (!tagStream.full()) {
+                tagStream.write(tag);
+            } else {
+                ++countRecordDrop;
+            }
+
+            // check if host has capture freeze control enabled before updating
+            // TODO: filter capture by user supplied symbol
+            if (0 == (0x80000000 & regCaptureControl)) {
+                regCaptureBuffer = operationPack.data;
+            }
+        }
+        if (stamp.legs != 0) {
+            recordLatency(PE_LATENCY_EMIT, egress - stamp.solveEnd, regLatency);
+            recordLatency(PE_LATENCY_TOTAL, egress - stamp.ingress, regLatency);
+            ++countTxBasket;
+        }
+        recordTrace(stamp, egress - stamp.ingress, regCaptureControl, regTrace);
+
+        // the record is dropped rather than holding up the orders when nothing drains the stream
+        record.range(63, 0) = stamp.timestamp;
+        record.range(95, 64) = stamp.ingress.range(31, 0);
+        record.range(127, 96) = stamp.solveEnd.range(31, 0);
+        record.range(159, 128) = egress.range(31, 0);
+        record.range(191, 160) = stamp.spins;
+        record.range(223, 192) = stamp.energy;
+        record.range(239, 224) = stamp.iterations;
+        record.range(242, 240) = stamp.verdict.range(2, 0);
+        record.range(247, 243) = stamp.legs;
+        record.range(255, 248) = stamp.symbol;
+        if (!recordStream.full()) {
+            recordStream.write(record);
+        } else {
+            ++countRecordDrop;
+        }
+    }
 
-    static ap_uint<32> countTxOperation = 0;
+    status.txOperation = countTxOperation;
+    for (int stage = 0; stage < PE_LATENCY_STAGES; stage++) {
+#pragma HLS UNROLL
+        status.latencyMin[stage] = latencyMin[stage];
+        status.latencyMax[stage] = latencyMax[stage];
+        status.latencyMean[stage] = meanLatency(stage);
+    }
+    status.traceCount = traceCount;
+    status.traceTrigger = traceTrigger;
+    status.recordDrop = countRecordDrop;
+    statusStream.write(status);
 
-    // if (!operationStream.empty()) {
-    // change this since there may be multiple operations
-    while (!operationStream.empty()) {
-        operation = operationStream.read();
+    return;
+}
 
-        intf.orderEntryOperationPack(&operation, &operationPack);
-        operationStreamPack.write(operationPack);
-        ++countTxOperation;
+void PricingEngine::recordLatency(int stage, ap_uint<64> latency, ap_uint<32> *regLatency)
+{
+#pragma HLS INLINE
 
-        // check if host has capture freeze control enabled before updating
-        // TODO: filter capture by user supplied symbol
-        if (0 == (0x80000000 & regCaptureControl)) {
-            regCaptureBuffer = operationPack.data;
-        }
+    // saturate to the width of the registers
+    ap_uint<32> sample = (latency > 0xffffffff) ? (ap_uint<32>)0xffffffff : (ap_uint<32>)latency;
+    int bucket = 0;
+    for (int b = 0; b < 32; b++) {
+#pragma HLS UNROLL
+        if (sample[b]) bucket = b + 1;
     }
+    if (bucket >= PE_LATENCY_BUCKETS) bucket = PE_LATENCY_BUCKETS - 1;
 
-    regTxOperation = countTxOperation;
+    if (latencyCount[stage] == 0 || sample < latencyMin[stage]) latencyMin[stage] = sample;
+    if (sample > latencyMax[stage]) latencyMax[stage] = sample;
+    latencySum[stage] += sample;
+    ++latencyCount[stage];
+    regLatency[stage * PE_LATENCY_BUCKETS + bucket] = ++latencyHist[stage][bucket];
+}
 
-    return;
+ap_uint<32> PricingEngine::meanLatency(int stage)
+{
+#pragma HLS INLINE
+
+    return latencyCount[stage] ? (ap_uint<32>)(latencySum[stage] / latencyCount[stage])
+                               : (ap_uint<32>)0;
 }
 
-void PricingEngine::eventHandler(ap_uint<32> &regRxEvent,
-                                 clockTickGeneratorEventStream_t &eventStream)
+void PricingEngine::recordTrace(pricingEngineSolveStamp_t &stamp, ap_uint<64> latency,
+                                ap_uint<32> &regCaptureControl, ap_uint<PE_TRACE_BITS> *regTrace)
+{
+#pragma HLS INLINE
+
+    ap_uint<PE_TRACE_BITS> entry = 0;
+    ap_uint<4> verdictMask = PE_CAPTURE_TRACE_VERDICT(regCaptureControl);
+    bool armed = (regCaptureControl & PE_CAPTURE_TRACE_ARM);
+
+    // clearing the arm bit rearms the trigger
+    if (!armed) {
+        traceTrigger = 0;
+        tracePost = 0;
+    }
+    if ((regCaptureControl & PE_CAPTURE_TRACE_FREEZE) || traceTrigger[30]) return;
+
+    entry.range(63, 0) = stamp.timestamp;
+    entry.range(71, 64) = stamp.symbol;
+    entry.range(79, 72) = stamp.verdict;
+    entry.range(84, 80) = stamp.legs;
+    entry.range(127, 96) = stamp.hBid;
+    entry.range(159, 128) = stamp.hAsk;
+    entry.range(191, 160) = stamp.spins;
+    entry.range(223, 192) = stamp.energy;
+    entry.range(255, 224) = (latency > 0xffffffff) ? (ap_uint<32>)0xffffffff : (ap_uint<32>)latency;
+    regTrace[traceCount % PE_TRACE_DEPTH] = entry;
+
+    // the trigger entry ends up in the middle of the stopped ring
+    if (traceTrigger[31]) {
+        if (--tracePost == 0) traceTrigger[30] = 1;
+    } else if (armed && verdictMask[(int)stamp.verdict.range(1, 0)]) {
+        traceTrigger = 0x80000000 | traceCount.range(29, 0);
+        tracePost = PE_TRACE_DEPTH / 2;
+    }
+    ++traceCount;
+}
+
+void PricingEngine::eventHandler(clockTickGeneratorEventStream_t &eventStream,
+                                 solveTriggerStream_t &triggerStream,
+                                 counterStream_t &statusStream)
 {
 #pragma HLS PIPELINE II = 1 style = flp
 
     clockTickGeneratorEvent_t tickEvent;
 
-    static ap_uint<32> countRxEvent = 0;
+    static ap_uint<64> countRxEvent = 0;
 
     if (!eventStream.empty()) {
         eventStream.read(tickEvent);
         ++countRxEvent;
 
         // event notification has been received from programmable clock tick
-        // generator, handling currently limited to incrementing a counter,
-        // placeholder for user to extend with custom event handling code
+        // generator, forwarded to problemUpdate to schedule timer driven solves,
+        // a tick is dropped rather than stalling if the previous one is pending
+        if (!triggerStream.full()) {
+            triggerStream.write(tickEvent.timestamp);
+        }
     }
 
-    regRxEvent = countRxEvent;
+    statusStream.write(countRxEvent);
+
+    return;
+}
+
+void PricingEngine::statusLatch(ap_uint<32> &regCaptureControl,
+                                pricingEngineRegStatus_t &regStatus, counterStream_t &pullStatus,
+                                counterStream_t &eventStatus, updateStatusStream_t &updateStatus,
+                                solveStatusStream_t &solveStatus, pushStatusStream_t &pushStatus,
+                                cycleStream_t &clockStream)
+{
+#pragma HLS PIPELINE II = 1 style = flp
+
+    static ap_uint<64> rxResponse = 0;
+    static ap_uint<64> rxEvent = 0;
+    static pricingEngineUpdateStatus_t update;
+    static pricingEngineSolveStatus_t solve;
+    static pricingEnginePushStatus_t push;
+    ap_uint<64> cycle;
+
+    latestStatus(pullStatus, rxResponse);
+    latestStatus(eventStatus, rxEvent);
+    latestStatus(updateStatus, update);
+    latestStatus(solveStatus, solve);
+    latestStatus(pushStatus, push);
+    cycle = sampleCycle(clockStream);
+
+    // the one writer of the status block, held as a whole while the snapshot is latched
+    if (0 == (PE_CAPTURE_SNAPSHOT & regCaptureControl)) {
+        regStatus.rxResponse = rxResponse;
+        regStatus.rxEvent = rxEvent;
+        regStatus.processResponse = update.processResponse;
+        regStatus.conflateResponse = update.conflateResponse;
+        regStatus.solveRate = update.solveRate;
+        regStatus.staleEdge = update.staleEdge;
+        regStatus.fieldDrift = update.fieldDrift;
+        regStatus.solveProblem = solve.solveProblem;
+        regStatus.strategyNone = solve.strategyNone;
+        regStatus.strategyPeg = solve.strategyPeg;
+        regStatus.strategyLimit = solve.strategyLimit;
+        regStatus.strategyUnknown = solve.strategyUnknown;
+        regStatus.debug = solve.debug;
+        regStatus.reserved10 = solve.reserved10;
+        regStatus.reserved11 = solve.reserved11;
+        regStatus.reserved12 = solve.reserved12;
+        regStatus.reserved13 = solve.reserved13;
+        regStatus.reserved14 = solve.reserved14;
+        regStatus.reserved15 = solve.reserved15;
+        regStatus.suppressBasket = solve.suppressBasket;
+        regStatus.repriceBasket = solve.repriceBasket;
+        regStatus.memoHit = solve.memoHit;
+        regStatus.memoReject = solve.memoReject;
+        regStatus.annealIter = solve.annealIter;
+        regStatus.qualityAllZero = solve.qualityAllZero;
+        regStatus.qualityNoCycle = solve.qualityNoCycle;
+        regStatus.qualityCycle = solve.qualityCycle;
+        regStatus.qualityProfitable = solve.qualityProfitable;
+        regStatus.qualitySpinFlip = solve.qualitySpinFlip;
+        regStatus.txBasket = solve.txBasket;
+        regStatus.txOperation = push.txOperation;
+        regStatus.latencyUpdateMin = push.latencyMin[PE_LATENCY_UPDATE];
+        regStatus.latencyUpdateMax = push.latencyMax[PE_LATENCY_UPDATE];
+        regStatus.latencyUpdateMean = push.latencyMean[PE_LATENCY_UPDATE];
+        regStatus.latencySolveMin = push.latencyMin[PE_LATENCY_SOLVE];
+        regStatus.latencySolveMax = push.latencyMax[PE_LATENCY_SOLVE];
+        regStatus.latencySolveMean = push.latencyMean[PE_LATENCY_SOLVE];
+        regStatus.latencyEmitMin = push.latencyMin[PE_LATENCY_EMIT];
+        regStatus.latencyEmitMax = push.latencyMax[PE_LATENCY_EMIT];
+        regStatus.latencyEmitMean = push.latencyMean[PE_LATENCY_EMIT];
+        regStatus.latencyTotalMin = push.latencyMin[PE_LATENCY_TOTAL];
+        regStatus.latencyTotalMax = push.latencyMax[PE_LATENCY_TOTAL];
+        regStatus.latencyTotalMean = push.latencyMean[PE_LATENCY_TOTAL];
+        regStatus.traceCount = push.traceCount;
+        regStatus.traceTrigger = push.traceTrigger;
+        regStatus.recordDrop = push.recordDrop;
+        regStatus.snapshotCycle = cycle;
+    }
 
     return;
 }
@@ -418,50 +1318,11 @@ void PricingEngine::eventHandler(ap_uint<32> &regRxEvent,
  * *********************************************/
 
 // with local field h
-void PricingEngine::runERM(int index, float logged_price, float M1, float M2,
-                           float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN])
+void PricingEngine::runERM(int index, float logged_price, float M1, float M2, float M3,
+                           float h[NUM_SPIN])
 {
     if (!init_constraint) {
-        for (int k = 0; k < NUM_CURRENCIES; k++) {
-            // penalty 1 without diagnal part (+1 at j-for loop)
-            // penalty 2 has no diagnal part originally
-            // PHYSICAL_BITS - 1 for not changing the ancilla bit
-            // i is increasing in diagnal direction
-            for (int i = 0; i < PHYSICAL_BITS; i++) {
-#pragma HLS PIPELINE
-                // v1 vector's ith element value
-                float v1i = (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
-                float v2i = (k == exch_index2id[i][0]);
-
-                for (int j = i + 1; j < PHYSICAL_BITS; j++) {
-                    // v1 vector's jth element value
-                    float v1j = (exch_index2id[j][0] == k) - (exch_index2id[j][1] == k);
-                    float v2j = (k == exch_index2id[j][0]);
-                    // outer product
-                    // also convert to ising model by divided by 4
-                    float pen1 = v1i * v1j * M1 / 4;
-                    float pen2 = v2i * v2j * M2 / 4;
-                    float pen1_plus_pen2 = pen1 + pen2;
-                    J[i][j] += pen1_plus_pen2;
-                    J[j][i] += pen1_plus_pen2;
-                    // Tranforming to ising model will remove the diagnal part
-                    // and form local field h. The forming of local field h is
-                    // replaced with ancilla bit which is the sum of the
-                    // original row/col of matrix containing diagnal part
-                    // J[i][PHYSICAL_BITS - 1] += (pen1_plus_pen2);  // /2 /2 =
-                    // /4 J[j][PHYSICAL_BITS - 1] += (pen1_plus_pen2);
-                    // J[PHYSICAL_BITS - 1][i] += (pen1_plus_pen2);
-                    // J[PHYSICAL_BITS - 1][j] += (pen1_plus_pen2);
-                    h[i] += (pen1_plus_pen2)*2;
-                    h[j] += (pen1_plus_pen2)*2;
-                }
-                // Adding the original diagnal part back to ancilla bit
-                float v1i_square_pen = v1i * v1i * M1 / 2;
-                // J[PHYSICAL_BITS - 1][i] += v1i_square_pen;
-                // J[i][PHYSICAL_BITS - 1] += v1i_square_pen;
-                h[i] += v1i_square_pen;
-            }
-        }
+        initField(M1, M2, M3, h);
         init_constraint = true;
     }
 
@@ -471,6 +1332,85 @@ void PricingEngine::runERM(int index, float logged_price, float M1, float M2,
     exch_logged_rates[index] = logged_price;
 }
 
+// constraint part of the local field, independent of the exchange rates
+void PricingEngine::initField(float M1, float M2, float M3, float h[NUM_SPIN])
+{
+    // penalty 3, M3 * (sum of x)^2 couples every pair of edges with M3 and has
+    // M3 on the diagnal, so every edge sees (PHYSICAL_BITS - 1) * M3 / 2 from
+    // the pairs plus M3 / 2 from its diagnal
+    for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS UNROLL
+        h[i] += PHYSICAL_BITS * M3 / 2;
+    }
+
+    for (int k = 0; k < NUM_CURRENCIES; k++) {
+        // penalty 1 without diagnal part (+1 at j-for loop)
+        // penalty 2 has no diagnal part originally
+        // PHYSICAL_BITS - 1 for not changing the ancilla bit
+        // i is increasing in diagnal direction
+        for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS PIPELINE
+            // v1 vector's ith element value
+            float v1i = (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
+            float v2i = (k == exch_index2id[i][0]);
+
+            for (int j = i + 1; j < PHYSICAL_BITS; j++) {
+                // v1 vector's jth element value
+                float v1j = (exch_index2id[j][0] == k) - (exch_index2id[j][1] == k);
+                float v2j = (k == exch_index2id[j][0]);
+                // outer product
+                // also convert to ising model by divided by 4
+                float pen1 = v1i * v1j * M1 / 4;
+                float pen2 = v2i * v2j * M2 / 4;
+                float pen1_plus_pen2 = pen1 + pen2;
+                // Tranforming to ising model will remove the diagnal part
+                // and form local field h. The couplings themselves are
+                // built by initCoupling on the solver side
+                h[i] += (pen1_plus_pen2)*2;
+                h[j] += (pen1_plus_pen2)*2;
+            }
+            // Adding the original diagnal part back to ancilla bit
+            float v1i_square_pen = v1i * v1i * M1 / 2;
+            h[i] += v1i_square_pen;
+        }
+    }
+}
+
+// constraint couplings, independent of the exchange rates
+void PricingEngine::initCoupling(float M1, float M2, float M3, float J[NUM_SPIN][NUM_SPIN])
+{
+    // penalty 3, cycle length, the same weight between every pair of edges
+    for (int i = 0; i < PHYSICAL_BITS; i++) {
+        for (int j = i + 1; j < PHYSICAL_BITS; j++) {
+#pragma HLS PIPELINE
+            J[i][j] += M3 / 4;
+            J[j][i] += M3 / 4;
+        }
+    }
+
+    for (int k = 0; k < NUM_CURRENCIES; k++) {
+        for (int i = 0; i < PHYSICAL_BITS; i++) {
+#pragma HLS PIPELINE
+            // v1 vector's ith element value
+            float v1i = (exch_index2id[i][0] == k) - (exch_index2id[i][1] == k);
+            float v2i = (k == exch_index2id[i][0]);
+
+            for (int j = i + 1; j < PHYSICAL_BITS; j++) {
+                // v1 vector's jth element value
+                float v1j = (exch_index2id[j][0] == k) - (exch_index2id[j][1] == k);
+                float v2j = (k == exch_index2id[j][0]);
+                // outer product
+                // also convert to ising model by divided by 4
+                float pen1 = v1i * v1j * M1 / 4;
+                float pen2 = v2i * v2j * M2 / 4;
+                float pen1_plus_pen2 = pen1 + pen2;
+                J[i][j] += pen1_plus_pen2;
+                J[j][i] += pen1_plus_pen2;
+            }
+        }
+    }
+}
+
 /*
  * Following are SQA Related Code
  */
@@ -491,9 +1431,9 @@ Y88b.Y8b88P 888   "   888 Y88b  d88P
  * Run Multiple Runs of QMC
  * Return spins of first trotter
  */
-void PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN],
-                           pricingEngineRegStatus_t &regStatus,
-                           pricingEngineRegControl_t &regControl)
+ap_uint<32> PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
+                                  float h[NUM_SPIN], pricingEngineSolveStatus_t &status,
+                                  pricingEngineRegControl_t &regControl)
 {
     // Internal Trotters
     static spin_t trotters[NUM_TROT][NUM_SPIN];
@@ -510,9 +1450,21 @@ void PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
     }
 
     // Iteration Parameters
-    const int iter = 10;  // default 500
     // const int iter = 25;  // default 500
     fp_t gamma_start, T, beta;
+    // iteration after which the read out trotter last changed
+    ap_uint<PHYSICAL_BITS> readout = 0, lastReadout = 0;
+    ap_uint<32> settle = 0;
+
+    // Anytime solving, the budget caps the iterations, the lowest energy readout is kept
+    ap_uint<32> budget = regControl.solveBudget;
+    ap_uint<32> converge = regControl.convergeSweeps;
+    bool anytime = (budget != 0 || converge != 0);
+    int iter = (budget == 0) ? ANNEAL_ITER : (budget > ANNEAL_MAX_ITER) ? ANNEAL_MAX_ITER : (int)budget;
+    ap_uint<32> quiet = 0;
+    ap_uint<32> executed = 0;
+    ap_uint<PHYSICAL_BITS> best = 0;
+    fp_t energy, bestEnergy = 0;
     convertByte2Float(gamma_start, regControl.reserved04);
     convertByte2Float(T, regControl.reserved05);
     beta = 1.0f / T;
@@ -525,8 +1477,9 @@ void PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
 #endif
 
     // Iteration
-    for (int i = 0; i < iter; i++) {
+    for (int i = 0; i < ANNEAL_MAX_ITER; i++) {
 #pragma HLS PIPELINE off
+        if (i >= iter) break;
 
         // Get Jperp
         fp_t gamma = gamma_start;
@@ -535,8 +1488,36 @@ void PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
         // gamma_start *= 0.57435;  // Use geometric instead of Arithmatic
 
         // Run QMC
+#if QMC_COLORING
+        this->runQMCColor(trotters, J, h, Jperp, beta);
+#else
         this->runQMC(trotters, J, h, Jperp, beta);
+#endif
+
+        for (int s = 0; s < PHYSICAL_BITS; s++) {
+#pragma HLS UNROLL
+            readout[s] = trotters[1][s];
+        }
+        if (i == 0 || readout != lastReadout) {
+            settle = i + 1;
+            quiet = 0;
+        } else {
+            ++quiet;
+        }
+        lastReadout = readout;
+        executed = i + 1;
+
+        if (anytime) {
+            energy = isingEnergy(trotters[1], J, h);
+            if (i == 0 || energy < bestEnergy) {
+                bestEnergy = energy;
+                best = readout;
+            }
+            if (converge != 0 && quiet >= converge) break;
+        }
     }
+    status.debug = settle;
+    status.annealIter = executed;
 
 #if !__SYNTHESIS__ && DEBUG
     std::cout << "final gamma  = " << gamma_start << std::endl;
@@ -554,23 +1535,25 @@ void PricingEngine::runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
     std::cout << std::endl;
 #endif
 
-    // Write back the first trotter
+    // Write back the first trotter, or the best readout of an anytime solve
     for (int i = 0; i < PHYSICAL_BITS; i++) {
-        spins[i] = trotters[1][i];
+        spins[i] = anytime ? (spin_t)best[i] : trotters[1][i];
     }
 
-    // Debug Info
+    // Debug Info, latched with the rest of the status block by statusLatch
+    run_count++;
     for (int i = 0; i < PHYSICAL_BITS; i++) {
-        regStatus.reserved10[i] = trotters[0][i];
-        regStatus.reserved11[i] = trotters[1][i];
-        regStatus.reserved12[i] = trotters[2][i];
-        regStatus.reserved13[i] = trotters[3][i];
+        status.reserved10[i] = trotters[0][i];
+        status.reserved11[i] = trotters[1][i];
+        status.reserved12[i] = trotters[2][i];
+        status.reserved13[i] = trotters[3][i];
     }
 
     // More Debug Info
-    run_count++;
-    regStatus.reserved14 = run_count;
-    regStatus.reserved15 = 0xdeadbeef;
+    status.reserved14 = run_count;
+    status.reserved15 = 0xdeadbeef;
+
+    return executed;
 }
 
 /*
@@ -662,6 +1645,39 @@ FILL_BUFFER:
     return fp_buffer[0];
 }
 
+/*
+ * FlipOfTrotters
+ * - Metropolis decision on one spin given the coupling sum de
+ */
+inline bool FlipOfTrotters(const info_t info, const state_t state, const fp_t de,
+                           const spin_t this_spin)
+{
+#pragma HLS INLINE
+    // Cache
+    fp_t de_tmp = de;
+
+    // Add de_qefct
+    bool same_dir = (state.up_spin == state.down_spin);
+    if (same_dir) {
+        de_tmp += (state.up_spin) ? info.neg_de_qefct : info.de_qefct;
+    }
+
+    // Times 2.0f then Add h_local
+    de_tmp *= 2.0f;
+    de_tmp += state.h_local;
+
+    /*
+     * Formula: - (-2) * spin(i) * deTmp > lrn / beta
+     * EqualTo:          spin(i) * deTmp > lrn / Beta / 2
+     */
+    // Times this_spin
+    if (!this_spin) {
+        de_tmp = Negate(de_tmp);
+    }
+
+    return (de_tmp) > state.log_rand_local / info.beta * 0.5f;
+}
+
 void UpdateOfTrottersFinal(const u32_t stage, const info_t info, const state_t state, const fp_t de,
                            spin_t trotters_local[NUM_SPIN])
 {
@@ -669,31 +1685,10 @@ void UpdateOfTrottersFinal(const u32_t stage, const info_t info, const state_t s
 
     bool inside = (stage >= info.m && stage < NUM_SPIN + info.m);
     if (inside) {
-        // Cache
-        fp_t de_tmp = de;
         spin_t this_spin = trotters_local[state.i_spin];
 
-        // Add de_qefct
-        bool same_dir = (state.up_spin == state.down_spin);
-        if (same_dir) {
-            de_tmp += (state.up_spin) ? info.neg_de_qefct : info.de_qefct;
-        }
-
-        // Times 2.0f then Add h_local
-        de_tmp *= 2.0f;
-        de_tmp += state.h_local;
-
-        /*
-         * Formula: - (-2) * spin(i) * deTmp > lrn / beta
-         * EqualTo:          spin(i) * deTmp > lrn / Beta / 2
-         */
-        // Times this_spin
-        if (!this_spin) {
-            de_tmp = Negate(de_tmp);
-        }
-
         // Flip and Return
-        if ((de_tmp) > state.log_rand_local / info.beta * 0.5f) {
+        if (FlipOfTrotters(info, state, de, this_spin)) {
             trotters_local[state.i_spin] = (~this_spin);
         }
     }
@@ -826,6 +1821,123 @@ LOOP_STAGE:
     }
 }
 
+/*
+ * QMC with the colour schedule
+ * - Stage s updates colour (s - m) on trotter m, every spin of the colour flips in parallel since
+ *   the spins of a colour have no J between them. A sweep takes NUM_COLOR + NUM_TROT - 1 stages
+ */
+void PricingEngine::runQMCColor(spin_t trotters[NUM_TROT][NUM_SPIN], fp_t jcoup[NUM_SPIN][NUM_SPIN],
+                                fp_t h[NUM_SPIN], fp_t jperp, fp_t beta)
+{
+    // Force pipeline off
+#pragma HLS INLINE off
+#pragma HLS PIPELINE off
+
+    // input state and de and fix info of every slot of the trotter units
+    state_t state[NUM_TROT][COLOR_WIDTH];
+    fp_t de[NUM_TROT][COLOR_WIDTH];
+    info_t info[NUM_TROT][COLOR_WIDTH];
+    bool flip[NUM_TROT][COLOR_WIDTH];
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = state
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = de
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = info
+#pragma HLS ARRAY_PARTITION dim = 0 type = complete variable = flip
+
+    // Local jcoup, the rows of the colour each trotter is on
+    fp_t jcoup_local[NUM_TROT][COLOR_WIDTH][NUM_SPIN];
+    fp_t jcoup_prefetch[COLOR_WIDTH][NUM_SPIN];
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = jcoup_local
+#pragma HLS ARRAY_PARTITION dim = 2 type = complete variable = jcoup_local
+#pragma HLS ARRAY_RESHAPE dim = 3 type = complete variable = jcoup_local
+#pragma HLS ARRAY_PARTITION dim = 1 type = complete variable = jcoup_prefetch
+#pragma HLS ARRAY_RESHAPE dim = 2 type = complete variable = jcoup_prefetch
+
+    // qefct-Related Energy
+    const fp_t de_qefct = jperp * ((fp_t)NUM_TROT);
+    const fp_t neg_de_qefct = Negate(de_qefct);
+
+    // Initialize infos, every slot draws from its own seed
+INIT_INFO_COLOR:
+    for (u32_t m = 0; m < NUM_TROT; m++) {
+#pragma HLS UNROLL
+        for (u32_t w = 0; w < COLOR_WIDTH; w++) {
+#pragma HLS UNROLL
+            info[m][w].m = m;
+            info[m][w].beta = beta;
+            info[m][w].de_qefct = de_qefct;
+            info[m][w].neg_de_qefct = neg_de_qefct;
+            info[m][w].seed = m * COLOR_WIDTH + w + 1;
+        }
+    }
+
+    // Prefetch the rows of colour 0 before the loop of stages
+PREFETCH_JCOUP_COLOR:
+    for (u32_t w = 0; w < COLOR_WIDTH; w++) {
+#pragma HLS UNROLL
+        int i_spin = (COLOR_TABLE.spin[0][w] < 0) ? 0 : COLOR_TABLE.spin[0][w];
+        for (u32_t ofst = 0; ofst < NUM_SPIN; ofst++) {
+#pragma HLS UNROLL
+            jcoup_prefetch[w][ofst] = jcoup[i_spin][ofst];
+        }
+    }
+
+    // Loop of stage
+LOOP_STAGE_COLOR:
+    for (u32_t stage = 0; stage < (u32_t)(NUM_COLOR + NUM_TROT - 1); stage++) {
+#pragma HLS PIPELINE
+
+        // Shift down jcoup_local and read the rows of the next colour
+    SHIFT_JCOUP_COLOR:
+        for (u32_t w = 0; w < COLOR_WIDTH; w++) {
+#pragma HLS UNROLL
+            int next = (stage + 1 < (u32_t)NUM_COLOR) ? COLOR_TABLE.spin[stage + 1][w] : -1;
+            for (u32_t ofst = 0; ofst < NUM_SPIN; ofst++) {
+#pragma HLS UNROLL
+                for (i32_t m = NUM_TROT - 2; m >= 0; m--) {
+#pragma HLS UNROLL
+                    jcoup_local[m + 1][w][ofst] = jcoup_local[m][w][ofst];
+                }
+                jcoup_local[0][w][ofst] = jcoup_prefetch[w][ofst];
+                jcoup_prefetch[w][ofst] = jcoup[(next < 0) ? 0 : next][ofst];
+            }
+        }
+
+        // Update input state and sum up the couplings of every slot
+    UPDATE_OF_TROTTERS_COLOR:
+        for (u32_t m = 0; m < NUM_TROT; m++) {
+#pragma HLS UNROLL
+            u32_t up = (m == 0) ? (NUM_TROT - 1) : (m - 1);
+            u32_t down = (m == NUM_TROT - 1) ? (0) : (m + 1);
+            int color = (int)stage - (int)m;
+            for (u32_t w = 0; w < COLOR_WIDTH; w++) {
+#pragma HLS UNROLL
+                int i_spin = (color >= 0 && color < NUM_COLOR) ? COLOR_TABLE.spin[color][w] : -1;
+                state[m][w].i_spin = (i_spin < 0) ? 0 : i_spin;
+                state[m][w].up_spin = trotters[up][state[m][w].i_spin];
+                state[m][w].down_spin = trotters[down][state[m][w].i_spin];
+                state[m][w].h_local = h[state[m][w].i_spin];
+                state[m][w].log_rand_local = this->generateRandomNumber(info[m][w].seed);
+                de[m][w] = UpdateOfTrotters(trotters[m], jcoup_local[m][w]);
+                flip[m][w] = (i_spin >= 0) &&
+                             FlipOfTrotters(info[m][w], state[m][w], de[m][w],
+                                            trotters[m][state[m][w].i_spin]);
+            }
+        }
+
+        // Flip every spin of the colour at once
+    FLIP_OF_TROTTERS_COLOR:
+        for (u32_t m = 0; m < NUM_TROT; m++) {
+#pragma HLS UNROLL
+            for (u32_t w = 0; w < COLOR_WIDTH; w++) {
+#pragma HLS UNROLL
+                if (flip[m][w]) {
+                    trotters[m][state[m][w].i_spin] = ~trotters[m][state[m][w].i_spin];
+                }
+            }
+        }
+    }
+}
+
 /*
  * Generate Random Number
  */
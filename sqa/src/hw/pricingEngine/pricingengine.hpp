@@ -23,7 +23,24 @@
 #include "exch2ising.hpp"
 #include "hls_stream.h"
 
+#if !__SYNTHESIS__
+#include <chrono>
+#endif
+
 #define PE_CAPTURE_FREEZE (1 << 31)
+/* capture bit 30 is reserved. The order timestamp goes out as SendingTime (tag 52) and is never
+ * rewritten, tick to trade cycle stamps are carried by the solution records instead */
+/* Decision trace controls, the ring stops while TRACE_FREEZE is set. With TRACE_ARM set the first
+ * solve whose verdict is selected by capture[3:0] (bit v for verdict v) triggers it, the ring then
+ * records PE_TRACE_DEPTH / 2 more solves and stops until TRACE_ARM is cleared */
+#define PE_CAPTURE_TRACE_FREEZE (1 << 29)
+#define PE_CAPTURE_TRACE_ARM (1 << 28)
+#define PE_CAPTURE_TRACE_VERDICT(capture) ((capture).range(3, 0))
+/* Statistics snapshot, the stages send their counters to statusLatch, the one process that writes
+ * the status block. While set statusLatch holds the whole block and snapshotCycle at the values of
+ * the first cycle it saw the bit and the counters run on underneath, so every register of the block
+ * is latched on the same clock edge */
+#define PE_CAPTURE_SNAPSHOT (1 << 27)
 
 /* Macro for Debugging */
 #define DEBUG 0
@@ -62,6 +79,284 @@ struct info_t {
 
 /* SQA - realted macro END */
 
+/* Currency pairs (symbols) covered by the Ising model */
+#define NUM_PAIRS (PHYSICAL_BITS / 2)
+
+/* Fast log unit for price ingestion, mantissa bits indexing the LUT */
+#define LOG_LUT_BITS 6
+#define FAST_LOG_LN2 0.693147181f
+
+float fastLog(ap_uint<32> src);
+
+/* QUBO formulation penalty strengths */
+#define QUBO_M1 10  // 50
+#define QUBO_M2 10  // 25
+
+/* Cycle length penalty M3 * (number of legs)^2, set per deployment with -DQUBO_M3=<weight>,
+ * 0 leaves the formulation to flow balance (M1) and one outgoing edge per currency (M2) */
+#ifndef QUBO_M3
+#define QUBO_M3 0
+#endif
+
+/* QMC update schedule. With QMC_COLORING every stage flips all spins of one colour of the coupling
+ * graph in parallel (-DQMC_COLORING=1), 0 keeps the sequential schedule of one spin per stage */
+#ifndef QMC_COLORING
+#define QMC_COLORING 0
+#endif
+
+/* Two edges are coupled through M1 / M2 when they share a currency, so a colour is a matching of
+ * the currencies. M3 couples every pair of edges and leaves one spin per colour */
+#define COLOR_WIDTH ((QUBO_M3 == 0) ? NUM_CURRENCIES / 2 : 1)
+
+typedef struct colorTable_t {
+    int numColor;
+    int spin[PHYSICAL_BITS][COLOR_WIDTH];  // -1 marks an unused slot
+} colorTable_t;
+
+constexpr bool isCoupled(int i, int j)
+{
+    return (QUBO_M3 != 0) || exch_index2id[i][0] == exch_index2id[j][0] ||
+           exch_index2id[i][0] == exch_index2id[j][1] ||
+           exch_index2id[i][1] == exch_index2id[j][0] ||
+           exch_index2id[i][1] == exch_index2id[j][1];
+}
+
+/* Greedy colouring in spin order, evaluated by the compiler */
+constexpr colorTable_t buildColorTable()
+{
+    colorTable_t table = {};
+    for (int c = 0; c < PHYSICAL_BITS; c++) {
+        for (int w = 0; w < COLOR_WIDTH; w++) {
+            table.spin[c][w] = -1;
+        }
+    }
+    for (int i = 0; i < PHYSICAL_BITS; i++) {
+        for (int c = 0; c < PHYSICAL_BITS; c++) {
+            int slot = -1;
+            bool coupled = false;
+            for (int w = COLOR_WIDTH - 1; w >= 0; w--) {
+                if (table.spin[c][w] < 0) {
+                    slot = w;
+                } else if (isCoupled(i, table.spin[c][w])) {
+                    coupled = true;
+                }
+            }
+            if (slot >= 0 && !coupled) {
+                table.spin[c][slot] = i;
+                if (c + 1 > table.numColor) table.numColor = c + 1;
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+constexpr colorTable_t COLOR_TABLE = buildColorTable();
+#define NUM_COLOR (COLOR_TABLE.numColor)
+
+/* Order book depth of one symbol, five 32-bit levels per field */
+#define NUM_LEVEL 5
+
+typedef struct pricingEngineDepth_t {
+    ap_uint<160> bidPrice;
+    ap_uint<160> bidQuantity;
+    ap_uint<160> askPrice;
+    ap_uint<160> askQuantity;
+} pricingEngineDepth_t;
+
+typedef struct pricingEngineCacheEntry_t {
+    ap_uint<32> bidPrice;
+    ap_uint<32> askPrice;
+    ap_uint<32> valid;
+} pricingEngineCacheEntry_t;
+
+/* Ising problem snapshot handed over from ERM to the solver */
+typedef struct isingProblem_t {
+    orderBookResponse_t response;          // latest response folded into h
+    ap_uint<64> ingress;                   // cycle the oldest response folded in was pulled, 0 if none
+    fp_t h[NUM_SPIN];                      // local field at the time of hand over
+    pricingEngineCacheEntry_t book[NUM_PAIRS];  // top of book per symbol for pricing the legs
+    pricingEngineDepth_t depth[NUM_PAIRS];  // book depth for sizing the legs
+    fp_t cost[PHYSICAL_BITS];               // log domain trading cost per edge
+} isingProblem_t;
+
+typedef hls::stream<isingProblem_t> isingProblemStream_t;
+
+/* Order baskets, all legs of one cycle leave back to back. The orderId of a leg is the count of
+ * orders sent ahead of it, so it never repeats before 2^32 orders, and its basket travels on the
+ * order tag, see PE_TAG_BITS */
+#define BASKET_LEG_BITS 5
+
+/* Duplicate basket suppression, the last DEDUP_DEPTH baskets sent keyed by their legs. A cycle
+ * found again within regControl.dedupAge of being sent is dropped unless a leg price moved by more
+ * than regControl.repriceThreshold (relative, float bits), a zero age disables suppression */
+#define DEDUP_DEPTH 4
+
+typedef struct pricingEngineDedupEntry_t {
+    ap_uint<PHYSICAL_BITS> legs;
+    ap_uint<64> timestamp;
+    ap_uint<32> price[PHYSICAL_BITS];
+    bool valid;
+} pricingEngineDedupEntry_t;
+
+/* Anytime solving, regControl.solveBudget bounds the anneal to that many QMC iterations (at most
+ * ANNEAL_MAX_ITER), and regControl.convergeSweeps stops it after that many iterations without a
+ * flip of the read out trotter. With either set the lowest energy readout is returned, with both 0
+ * the fixed ANNEAL_ITER iterations run as before. The budget is counted in iterations, not clock
+ * cycles, the cycles of an iteration follow from the csynth report of runQMC */
+#define ANNEAL_ITER 10
+#define ANNEAL_MAX_ITER 64
+
+/* Solve scheduling, regControl.schedule */
+#define PE_SCHEDULE_TIMER (1 << 0)  // solve on clock tick instead of on every market update
+#define PE_SCHEDULE_MEMO (1 << 1)   // reuse a cached solution instead of annealing when valid
+#define SOLVE_RATE_TICKS (16)       // clock ticks per regStatus.solveRate window
+
+/* Solution memo, the last MEMO_DEPTH solutions keyed by the sign pattern of h. A cached solution
+ * stands in for the anneal while none of its 1-flip neighbours is lower in energy under the
+ * current h */
+#define MEMO_DEPTH 4
+
+typedef struct pricingEngineMemoEntry_t {
+    ap_uint<PHYSICAL_BITS> signature;
+    ap_uint<PHYSICAL_BITS> spins;
+    bool valid;
+} pricingEngineMemoEntry_t;
+
+/* Solution quality, every solve is counted in regStatus by the class of its spins before
+ * duplicate suppression: qualityAllZero no edge selected, qualityNoCycle edges that are not flow
+ * balanced, qualityCycle a cycle and qualityProfitable a cycle that sizeCycle can fill at a profit.
+ * qualitySpinFlip sums the spins that differ from the previous solution */
+
+/* Field added to the spin of an edge whose quote is older than regControl.staleAge, counted in
+ * cycles of the kernel clock of cycleCounter (ns of the host clock in csim) from the cycle the quote
+ * was pulled to the clock tick that sweeps it */
+#define STALE_CLAMP (4 * (QUBO_M1 + QUBO_M2))
+
+/* Edge updates between background rebuilds of h when regControl.rebuildPeriod is 0 */
+#define FIELD_REBUILD_PERIOD (1 << 16)
+
+/* Clock tick timestamps forwarded from eventHandler to problemUpdate */
+typedef hls::stream<ap_uint<64> > solveTriggerStream_t;
+
+/* Latency instrumentation. cycleCounter is the one clock of every stamp, a free running II = 1
+ * process that counts kernel clock cycles from reset and offers the count to every stage that
+ * stamps on a depth 1 clock stream of its own. A stage reads the clock with sampleCycle whenever it
+ * needs a stamp, whatever its own II, so all stamps share the free running count give or take a
+ * cycle (csim runs the processes one after the other and reads the host clock in ns from the first
+ * sample instead).
+ * responsePull stamps every response on a sideband and the snapshot carries the oldest stamp folded
+ * in, pricingProcess stamps the solver start and end into the pricingEngineSolveStamp_t it sends
+ * ahead of the legs of every solve and operationPush stamps the legs as they are written.
+ * operationPush keeps min / max / mean in regStatus and a log2 histogram per stage in
+ * regLatency[stage * PE_LATENCY_BUCKETS + bucket], bucket b holds latencies of b significant
+ * bits (0 for 0 cycles), the last bucket everything longer */
+#define PE_LATENCY_UPDATE 0  // response pulled to solver start, ERM plus the wait for the solver
+#define PE_LATENCY_SOLVE 1   // solver start to solver end
+#define PE_LATENCY_EMIT 2    // solver end to the last leg of the basket written
+#define PE_LATENCY_TOTAL 3   // response pulled to the last leg of the basket written
+#define PE_LATENCY_STAGES 4
+#define PE_LATENCY_BUCKETS 32
+
+typedef hls::stream<ap_uint<64> > cycleStream_t;
+
+/* Offers the count to a stage, a stage that has not taken the previous count yet keeps it */
+inline void offerCycle(cycleStream_t &clockStream, ap_uint<64> cycle)
+{
+#pragma HLS INLINE
+#if !__SYNTHESIS__
+    // csim streams are never full, one pending count is all a stage drops
+    if (!clockStream.empty()) return;
+#endif
+    if (!clockStream.full()) clockStream.write(cycle);
+}
+
+/* Current count of the kernel clock, a pending count went stale while the stage was busy so it is
+ * dropped and the next one offered is taken */
+inline ap_uint<64> sampleCycle(cycleStream_t &clockStream)
+{
+#pragma HLS INLINE
+    if (!clockStream.empty()) clockStream.read();
+#if !__SYNTHESIS__
+    static const auto reset = std::chrono::steady_clock::now();
+    return (ap_uint<64>)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - reset)
+        .count();
+#else
+    return clockStream.read();
+#endif
+}
+
+/* Outcome of a solve */
+#define PE_VERDICT_NONE 0      // all spins zero, no cycle
+#define PE_VERDICT_REJECT 1    // not a cycle or not profitable at the top of book
+#define PE_VERDICT_SUPPRESS 2  // duplicate of a basket in flight
+#define PE_VERDICT_SEND 3      // basket sent
+#define PE_VERDICT_MEMO (1 << 2)  // flag, the solution was taken over from the memo
+
+/* Decision trace ring, operationPush writes one entry per solve to
+ * regTrace[regStatus.traceCount % PE_TRACE_DEPTH] and regStatus.traceTrigger holds bit 31
+ * triggered, bit 30 stopped and [29:0] the traceCount of the trigger entry. The host reads an entry
+ * from the trace AXI-lite bundle, apart from the control bundle, as eight 32-bit words:
+ *   0-1  exchange timestamp of the response behind the solve
+ *   2    symbol [7:0], verdict [15:8], legs [20:16]
+ *   3-4  h of the bid / ask edge of the symbol (float bits)
+ *   5    spin bitmask
+ *   6    energy (float bits)
+ *   7    response pulled to the last leg written, to the solver end without legs */
+#define PE_TRACE_DEPTH 2048
+#define PE_TRACE_BITS 256
+
+typedef struct pricingEngineSolveStamp_t {
+    ap_uint<64> ingress;
+    ap_uint<64> solveStart;
+    ap_uint<64> solveEnd;
+    ap_uint<BASKET_LEG_BITS> legs;  // legs that follow on the operation stream
+    ap_uint<64> timestamp;          // the rest is only carried for the decision trace
+    ap_uint<8> symbol;
+    ap_uint<8> verdict;
+    ap_uint<32> hBid;
+    ap_uint<32> hAsk;
+    ap_uint<32> spins;
+    ap_uint<32> energy;
+    ap_uint<16> iterations;
+} pricingEngineSolveStamp_t;
+
+typedef hls::stream<pricingEngineSolveStamp_t> solveStampStream_t;
+
+/* Solution records, operationPush writes one PE_RECORD_BITS record per solve to the recordStream
+ * AXI-stream of pricingEngineTop for a data mover to the host, a record that finds the stream full
+ * is counted in regStatus.recordDrop instead. Eight little endian 32-bit words:
+ *   0-1  exchange timestamp of the response behind the solve
+ *   2    ingress cycle [31:0], response pulled
+ *   3    solver end cycle [31:0]
+ *   4    egress cycle [31:0], last leg written, the solver end without legs
+ *   5    spin bitmask
+ *   6    energy (float bits)
+ *   7    iterations [15:0], verdict [18:16], legs [23:19], symbol [31:24] */
+#define PE_RECORD_BITS 256
+
+typedef hls::stream<ap_uint<PE_RECORD_BITS> > solveRecordStream_t;
+
+/* Order tags, operationPush writes one PE_TAG_BITS tag per order to the orderTagStream AXI-stream
+ * of pricingEngineTop right behind the order, a tag that finds the stream full is counted in
+ * regStatus.recordDrop with the records. Eight little endian 32-bit words:
+ *   0    orderId of the order
+ *   1    basket ID, the count of baskets sent ahead of its basket
+ *   2    leg index [7:0], leg count [15:8]
+ *   3    reserved
+ *   4-5  ingress cycle, response pulled
+ *   6-7  egress cycle, order written */
+#define PE_TAG_BITS 256
+#define ORDER_TAG_ID(tag) ((tag).range(31, 0))
+#define ORDER_TAG_BASKET(tag) ((tag).range(63, 32))
+#define ORDER_TAG_LEG_INDEX(tag) ((tag).range(71, 64))
+#define ORDER_TAG_LEG_COUNT(tag) ((tag).range(79, 72))
+#define ORDER_TAG_INGRESS(tag) ((tag).range(191, 128))
+#define ORDER_TAG_EGRESS(tag) ((tag).range(255, 192))
+
+typedef hls::stream<ap_uint<PE_TAG_BITS> > orderTagStream_t;
+
 typedef struct pricingEngineRegControl_t {
     ap_uint<32> control;
     ap_uint<32> config;
@@ -71,18 +366,26 @@ typedef struct pricingEngineRegControl_t {
     ap_uint<32> reserved05;
     ap_uint<32> reserved06;
     ap_uint<32> reserved07;
+    ap_uint<32> schedule;
+    ap_uint<32> solveInterval;
+    ap_uint<32> staleAge;
+    ap_uint<32> rebuildPeriod;
+    ap_uint<32> dedupAge;
+    ap_uint<32> repriceThreshold;
+    ap_uint<32> solveBudget;
+    ap_uint<32> convergeSweeps;
 } pricingEngineRegControl_t;
 
 typedef struct pricingEngineRegStatus_t {
     ap_uint<32> status;
-    ap_uint<32> rxResponse;
-    ap_uint<32> processResponse;
-    ap_uint<32> txOperation;
+    ap_uint<64> rxResponse;
+    ap_uint<64> processResponse;
+    ap_uint<64> txOperation;
     ap_uint<32> strategyNone;
     ap_uint<32> strategyPeg;
     ap_uint<32> strategyLimit;
     ap_uint<32> strategyUnknown;
-    ap_uint<32> rxEvent;
+    ap_uint<64> rxEvent;
     ap_uint<32> debug;
     ap_uint<32> reserved10;
     ap_uint<32> reserved11;
@@ -90,8 +393,107 @@ typedef struct pricingEngineRegStatus_t {
     ap_uint<32> reserved13;
     ap_uint<32> reserved14;
     ap_uint<32> reserved15;
+    ap_uint<64> conflateResponse;
+    ap_uint<64> solveProblem;
+    ap_uint<32> solveRate;
+    ap_uint<32> staleEdge;
+    ap_uint<32> fieldDrift;
+    ap_uint<32> suppressBasket;
+    ap_uint<32> repriceBasket;
+    ap_uint<32> memoHit;
+    ap_uint<32> memoReject;
+    ap_uint<32> annealIter;
+    ap_uint<32> latencyUpdateMin;
+    ap_uint<32> latencyUpdateMax;
+    ap_uint<32> latencyUpdateMean;
+    ap_uint<32> latencySolveMin;
+    ap_uint<32> latencySolveMax;
+    ap_uint<32> latencySolveMean;
+    ap_uint<32> latencyEmitMin;
+    ap_uint<32> latencyEmitMax;
+    ap_uint<32> latencyEmitMean;
+    ap_uint<32> latencyTotalMin;
+    ap_uint<32> latencyTotalMax;
+    ap_uint<32> latencyTotalMean;
+    ap_uint<32> traceCount;
+    ap_uint<32> traceTrigger;
+    ap_uint<32> recordDrop;
+    ap_uint<64> qualityAllZero;
+    ap_uint<64> qualityNoCycle;
+    ap_uint<64> qualityCycle;
+    ap_uint<64> qualityProfitable;
+    ap_uint<64> qualitySpinFlip;
+    ap_uint<64> txBasket;
+    ap_uint<64> snapshotCycle;
 } pricingEngineRegStatus_t;
 
+/* Counters of a stage, sent to statusLatch at the end of every pass of the stage. responsePull and
+ * eventHandler send their one counter on a counterStream_t */
+typedef hls::stream<ap_uint<64> > counterStream_t;
+
+typedef struct pricingEngineUpdateStatus_t {
+    ap_uint<64> processResponse;
+    ap_uint<64> conflateResponse;
+    ap_uint<32> solveRate;
+    ap_uint<32> staleEdge;
+    ap_uint<32> fieldDrift;
+} pricingEngineUpdateStatus_t;
+
+typedef hls::stream<pricingEngineUpdateStatus_t> updateStatusStream_t;
+
+typedef struct pricingEngineSolveStatus_t {
+    ap_uint<64> solveProblem;
+    ap_uint<32> strategyNone;
+    ap_uint<32> strategyPeg;
+    ap_uint<32> strategyLimit;
+    ap_uint<32> strategyUnknown;
+    ap_uint<32> debug;
+    ap_uint<32> reserved10;
+    ap_uint<32> reserved11;
+    ap_uint<32> reserved12;
+    ap_uint<32> reserved13;
+    ap_uint<32> reserved14;
+    ap_uint<32> reserved15;
+    ap_uint<32> suppressBasket;
+    ap_uint<32> repriceBasket;
+    ap_uint<32> memoHit;
+    ap_uint<32> memoReject;
+    ap_uint<32> annealIter;
+    ap_uint<64> qualityAllZero;
+    ap_uint<64> qualityNoCycle;
+    ap_uint<64> qualityCycle;
+    ap_uint<64> qualityProfitable;
+    ap_uint<64> qualitySpinFlip;
+    ap_uint<64> txBasket;
+} pricingEngineSolveStatus_t;
+
+typedef hls::stream<pricingEngineSolveStatus_t> solveStatusStream_t;
+
+typedef struct pricingEnginePushStatus_t {
+    ap_uint<64> txOperation;
+    ap_uint<32> latencyMin[PE_LATENCY_STAGES];
+    ap_uint<32> latencyMax[PE_LATENCY_STAGES];
+    ap_uint<32> latencyMean[PE_LATENCY_STAGES];
+    ap_uint<32> traceCount;
+    ap_uint<32> traceTrigger;
+    ap_uint<32> recordDrop;
+} pricingEnginePushStatus_t;
+
+typedef hls::stream<pricingEnginePushStatus_t> pushStatusStream_t;
+
+/* Last status a stage sent, csim runs the stages ahead of statusLatch so it takes the last of the
+ * call, the kernel takes at most one a cycle */
+template <typename T>
+inline void latestStatus(hls::stream<T> &statusStream, T &status)
+{
+#pragma HLS INLINE
+#if !__SYNTHESIS__
+    while (!statusStream.empty()) status = statusStream.read();
+#else
+    if (!statusStream.empty()) status = statusStream.read();
+#endif
+}
+
 typedef struct pricingEngineRegStrategy_t {
     // 32b registers are wider than required here for some fields (e.g. select
     // and enable) but not sure what XRT does in terms of packing, potential to
@@ -115,11 +517,12 @@ typedef struct pricingEngineRegThresholds_t {
     ap_uint<32> threshold7;
 } pricingEngineRegThresholds_t;
 
-typedef struct pricingEngineCacheEntry_t {
-    ap_uint<32> bidPrice;
-    ap_uint<32> askPrice;
-    ap_uint<32> valid;
-} pricingEngineCacheEntry_t;
+/* Per symbol trading cost loaded by the host, log domain fee plus expected slippage as float
+ * bit patterns, subtracted from the logged rate of the edge before it enters h */
+typedef struct pricingEngineRegCost_t {
+    ap_uint<32> bidCost;
+    ap_uint<32> askCost;
+} pricingEngineRegCost_t;
 
 /**
  * PricingEngine Core
@@ -127,16 +530,37 @@ typedef struct pricingEngineCacheEntry_t {
 class PricingEngine
 {
    public:
-    void responsePull(ap_uint<32> &regRxResponse, orderBookResponseStreamPack_t &responseStreamPack,
-                      orderBookResponseStream_t &responseStream);
+    void cycleCounter(cycleStream_t &pullClock, cycleStream_t &updateClock,
+                      cycleStream_t &solveClock, cycleStream_t &pushClock,
+                      cycleStream_t &latchClock);
 
-    void pricingProcess(ap_uint<32> &regStrategyControl, ap_uint<32> &regProcessResponse,
-                        ap_uint<32> &regStrategyNone, ap_uint<32> &regStrategyPeg,
-                        ap_uint<32> &regStrategyLimit, ap_uint<32> &regStrategyUnknown,
-                        pricingEngineRegStatus_t &regStatus, pricingEngineRegControl_t &regControl,
+    void responsePull(orderBookResponseStreamPack_t &responseStreamPack,
+                      orderBookResponseStream_t &responseStream, cycleStream_t &ingressStream,
+                      counterStream_t &statusStream, cycleStream_t &clockStream);
+
+    void problemUpdate(ap_uint<32> &regSchedule, ap_uint<32> &regSolveInterval,
+                       ap_uint<32> &regStaleAge, ap_uint<32> &regRebuildPeriod,
+                       pricingEngineRegCost_t *regCosts,
+                       orderBookResponseStream_t &responseStream, cycleStream_t &ingressStream,
+                       solveTriggerStream_t &triggerStream, isingProblemStream_t &problemStream,
+                       updateStatusStream_t &statusStream, cycleStream_t &clockStream);
+
+    void pricingProcess(ap_uint<32> &regStrategyControl, pricingEngineRegControl_t &regControl,
                         pricingEngineRegStrategy_t *regStrategies,
-                        orderBookResponseStream_t &responseStream,
-                        orderEntryOperationStream_t &operationStream);
+                        isingProblemStream_t &problemStream,
+                        orderEntryOperationStream_t &operationStream,
+                        solveStampStream_t &stampStream, solveStatusStream_t &statusStream,
+                        cycleStream_t &clockStream);
+
+    /* sizes every leg of the cycles of the spins in legQuantity, 0 for the legs of a cycle that is
+     * not fillable and profitable, and returns the count of legs sized */
+    ap_uint<BASKET_LEG_BITS> sizeCycle(spin_t spin[NUM_SPIN], pricingEngineDepth_t depth[NUM_PAIRS],
+                                       fp_t cost[PHYSICAL_BITS],
+                                       ap_uint<32> legQuantity[PHYSICAL_BITS]);
+
+    bool dedupBasket(ap_uint<PHYSICAL_BITS> legs, ap_uint<32> price[PHYSICAL_BITS],
+                     ap_uint<64> timestamp, ap_uint<32> &regDedupAge,
+                     ap_uint<32> &regRepriceThreshold);
 
     bool pricingStrategyPeg(ap_uint<8> thresholdEnable, ap_uint<32> thresholdPosition,
                             orderBookResponse_t &response, orderEntryOperation_t &operation);
@@ -144,35 +568,79 @@ class PricingEngine
     bool pricingStrategyLimit(ap_uint<8> thresholdEnable, ap_uint<32> thresholdPosition,
                               orderBookResponse_t &response, orderEntryOperation_t &operation);
 
-    void operationPush(ap_uint<32> &regCaptureControl, ap_uint<32> &regTxOperation,
-                       ap_uint<1024> &regCaptureBuffer,
+    void operationPush(ap_uint<32> &regCaptureControl, ap_uint<1024> &regCaptureBuffer,
+                       ap_uint<32> *regLatency, ap_uint<PE_TRACE_BITS> *regTrace,
                        orderEntryOperationStream_t &operationStream,
-                       orderEntryOperationStreamPack_t &operationStreamPack);
+                       solveStampStream_t &stampStream,
+                       orderEntryOperationStreamPack_t &operationStreamPack,
+                       solveRecordStream_t &recordStream, orderTagStream_t &tagStream,
+                       pushStatusStream_t &statusStream, cycleStream_t &clockStream);
+
+    void eventHandler(clockTickGeneratorEventStream_t &eventStream,
+                      solveTriggerStream_t &triggerStream, counterStream_t &statusStream);
 
-    void eventHandler(ap_uint<32> &regRxEvent, clockTickGeneratorEventStream_t &eventStream);
+    void statusLatch(ap_uint<32> &regCaptureControl, pricingEngineRegStatus_t &regStatus,
+                     counterStream_t &pullStatus, counterStream_t &eventStatus,
+                     updateStatusStream_t &updateStatus, solveStatusStream_t &solveStatus,
+                     pushStatusStream_t &pushStatus, cycleStream_t &clockStream);
 
    private:
     pricingEngineCacheEntry_t cache[NUM_SYMBOL];
 
+    /* Latency statistics, owned by operationPush */
+    ap_uint<32> latencyMin[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyMax[PE_LATENCY_STAGES] = {0};
+    ap_uint<64> latencySum[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyCount[PE_LATENCY_STAGES] = {0};
+    ap_uint<32> latencyHist[PE_LATENCY_STAGES][PE_LATENCY_BUCKETS] = {{0}};
+
+    void recordLatency(int stage, ap_uint<64> latency, ap_uint<32> *regLatency);
+    ap_uint<32> meanLatency(int stage);
+
+    /* Duplicate suppression counts, owned by pricingProcess */
+    ap_uint<32> countSuppressBasket = 0;
+    ap_uint<32> countRepriceBasket = 0;
+
+    /* Decision trace state, owned by operationPush */
+    ap_uint<32> traceCount = 0;
+    ap_uint<32> traceTrigger = 0;
+    ap_uint<32> tracePost = 0;
+
+    void recordTrace(pricingEngineSolveStamp_t &stamp, ap_uint<64> latency,
+                     ap_uint<32> &regCaptureControl, ap_uint<PE_TRACE_BITS> *regTrace);
+
     /* SQA - related operations */
-    void runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN],
-                pricingEngineRegStatus_t &regStatus, pricingEngineRegControl_t &regControl);
+    /* returns the iterations executed */
+    ap_uint<32> runSQA(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN],
+                       pricingEngineSolveStatus_t &status, pricingEngineRegControl_t &regControl);
 
     void runQMC(spin_t trotters[NUM_TROT][NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN],
                 float Jperp, float beta);
 
+    void runQMCColor(spin_t trotters[NUM_TROT][NUM_SPIN], float J[NUM_SPIN][NUM_SPIN],
+                     float h[NUM_SPIN], float Jperp, float beta);
+
     float generateRandomNumber(int &seed);
 
+    bool isLocalMinimum(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN]);
+
+    fp_t isingEnergy(spin_t spins[NUM_SPIN], float J[NUM_SPIN][NUM_SPIN], float h[NUM_SPIN]);
+
     /* ERM - related operations */
     float exch_logged_rates[NUM_SPIN] = {0};
     bool init_constraint = false;
 
-    void runERM(int index, float logged_price, float M1, float M2, float J[NUM_SPIN][NUM_SPIN],
-                float h[NUM_SPIN]);
+    void runERM(int index, float logged_price, float M1, float M2, float M3, float h[NUM_SPIN]);
+
+    void initField(float M1, float M2, float M3, float h[NUM_SPIN]);
+
+    void initCoupling(float M1, float M2, float M3, float J[NUM_SPIN][NUM_SPIN]);
+
+    /* Flow balance of the selected edges, also counted in hardware by the solution quality */
+    bool checkExchCycle(spin_t spin[NUM_SPIN]);
 
 /* DEBUG - Check Profitable or Not */
 #if !__SYNTHESIS__
-    bool checkExchCycle(spin_t spin[NUM_SPIN]);
     bool checkProfitable(spin_t spin[NUM_SPIN]);
     bool checkIsAllZero(spin_t spin[NUM_SPIN]);
     void checkSolution(spin_t spin[NUM_SPIN]);
@@ -23,8 +23,13 @@ extern "C" void pricingEngineTop(pricingEngineRegControl_t &regControl,
                                  pricingEngineRegStatus_t &regStatus,
                                  ap_uint<1024> &regCapture,
                                  pricingEngineRegStrategy_t regStrategies[NUM_SYMBOL],
+                                 pricingEngineRegCost_t regCosts[NUM_SYMBOL],
+                                 ap_uint<32> regLatency[PE_LATENCY_STAGES * PE_LATENCY_BUCKETS],
+                                 ap_uint<PE_TRACE_BITS> regTrace[PE_TRACE_DEPTH],
                                  orderBookResponseStreamPack_t &responseStreamPack,
                                  orderEntryOperationStreamPack_t &operationStreamPack,
-                                 clockTickGeneratorEventStream_t &eventStream);
+                                 clockTickGeneratorEventStream_t &eventStream,
+                                 solveRecordStream_t &recordStream,
+                                 orderTagStream_t &orderTagStream);
 
 #endif
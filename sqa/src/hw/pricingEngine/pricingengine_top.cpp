@@ -20,56 +20,133 @@ extern "C" void pricingEngineTop(pricingEngineRegControl_t &regControl,
                                  pricingEngineRegStatus_t &regStatus,
                                  ap_uint<1024> &regCapture,
                                  pricingEngineRegStrategy_t regStrategies[NUM_SYMBOL],
+                                 pricingEngineRegCost_t regCosts[NUM_SYMBOL],
+                                 ap_uint<32> regLatency[PE_LATENCY_STAGES * PE_LATENCY_BUCKETS],
+                                 ap_uint<PE_TRACE_BITS> regTrace[PE_TRACE_DEPTH],
                                  orderBookResponseStreamPack_t &responseStreamPack,
                                  orderEntryOperationStreamPack_t &operationStreamPack,
-                                 clockTickGeneratorEventStream_t &eventStream)
+                                 clockTickGeneratorEventStream_t &eventStream,
+                                 solveRecordStream_t &recordStream,
+                                 orderTagStream_t &orderTagStream)
 {
 #pragma HLS INTERFACE s_axilite port=regControl bundle=control
 #pragma HLS INTERFACE s_axilite port=regStatus bundle=control
 #pragma HLS INTERFACE s_axilite port=regCapture bundle=control
 #pragma HLS INTERFACE s_axilite port=regStrategies bundle=control
+#pragma HLS INTERFACE s_axilite port=regCosts bundle=control
+#pragma HLS INTERFACE s_axilite port=regLatency bundle=control
+// the 64KB decision trace ring gets its own AXI-lite window, so its reads
+// never stall the control and status registers behind it
+#pragma HLS INTERFACE s_axilite port=regTrace bundle=trace
 #pragma HLS INTERFACE ap_none port=regControl
 #pragma HLS INTERFACE ap_none port=regStatus
 #pragma HLS INTERFACE ap_memory port=regCapture
 #pragma HLS INTERFACE ap_memory port=regStrategies
+#pragma HLS INTERFACE ap_memory port=regCosts
+#pragma HLS INTERFACE ap_memory port=regLatency
+#pragma HLS INTERFACE ap_memory port=regTrace
 #pragma HLS INTERFACE axis port=responseStreamPack
 #pragma HLS INTERFACE axis port=operationStreamPack
 #pragma HLS INTERFACE axis port=eventStream
+#pragma HLS INTERFACE axis port=recordStream
+#pragma HLS INTERFACE axis port=orderTagStream
 #pragma HLS INTERFACE ap_ctrl_none port=return
 
     static orderBookResponseStream_t responseStreamFIFO("responseStreamFIFO");
+    static cycleStream_t ingressStreamFIFO("ingressStreamFIFO");
+    static isingProblemStream_t problemStreamFIFO("problemStreamFIFO");
+    static solveTriggerStream_t triggerStreamFIFO("triggerStreamFIFO");
     static orderEntryOperationStream_t operationStreamFIFO("operationStreamFIFO");
+    static solveStampStream_t stampStreamFIFO("stampStreamFIFO");
+    static cycleStream_t pullClockFIFO("pullClockFIFO");
+    static cycleStream_t updateClockFIFO("updateClockFIFO");
+    static cycleStream_t solveClockFIFO("solveClockFIFO");
+    static cycleStream_t pushClockFIFO("pushClockFIFO");
+    static cycleStream_t latchClockFIFO("latchClockFIFO");
+    static counterStream_t pullStatusFIFO("pullStatusFIFO");
+    static counterStream_t eventStatusFIFO("eventStatusFIFO");
+    static updateStatusStream_t updateStatusFIFO("updateStatusFIFO");
+    static solveStatusStream_t solveStatusFIFO("solveStatusFIFO");
+    static pushStatusStream_t pushStatusFIFO("pushStatusFIFO");
     static PricingEngine kernel;
     static mmInterface intf;
 
 #pragma HLS DISAGGREGATE variable=regControl
 #pragma HLS DISAGGREGATE variable=regStatus
 #pragma HLS STABLE variable=regStrategies
+#pragma HLS STABLE variable=regCosts
+#pragma HLS STREAM variable=problemStreamFIFO depth=1
+#pragma HLS STREAM variable=triggerStreamFIFO depth=2
+#pragma HLS STREAM variable=stampStreamFIFO depth=2
+#pragma HLS STREAM variable=pullClockFIFO depth=1
+#pragma HLS STREAM variable=updateClockFIFO depth=1
+#pragma HLS STREAM variable=solveClockFIFO depth=1
+#pragma HLS STREAM variable=pushClockFIFO depth=1
+#pragma HLS STREAM variable=latchClockFIFO depth=1
+#pragma HLS STREAM variable=pullStatusFIFO depth=1
+#pragma HLS STREAM variable=eventStatusFIFO depth=1
+#pragma HLS STREAM variable=updateStatusFIFO depth=1
+#pragma HLS STREAM variable=solveStatusFIFO depth=1
+#pragma HLS STREAM variable=pushStatusFIFO depth=1
+    CTX_PRAGMA(HLS STREAM variable=operationStreamFIFO depth=PHYSICAL_BITS)
 #pragma HLS DATAFLOW disable_start_propagation
 
-    kernel.responsePull(regStatus.rxResponse,
-                        responseStreamPack,
-                        responseStreamFIFO);
+    kernel.cycleCounter(pullClockFIFO,
+                        updateClockFIFO,
+                        solveClockFIFO,
+                        pushClockFIFO,
+                        latchClockFIFO);
+
+    kernel.responsePull(responseStreamPack,
+                        responseStreamFIFO,
+                        ingressStreamFIFO,
+                        pullStatusFIFO,
+                        pullClockFIFO);
+
+    kernel.eventHandler(eventStream,
+                        triggerStreamFIFO,
+                        eventStatusFIFO);
+
+    kernel.problemUpdate(regControl.schedule,
+                         regControl.solveInterval,
+                         regControl.staleAge,
+                         regControl.rebuildPeriod,
+                         regCosts,
+                         responseStreamFIFO,
+                         ingressStreamFIFO,
+                         triggerStreamFIFO,
+                         problemStreamFIFO,
+                         updateStatusFIFO,
+                         updateClockFIFO);
 
     kernel.pricingProcess(regControl.strategy,
-                          regStatus.processResponse,
-                          regStatus.strategyNone,
-                          regStatus.strategyPeg,
-                          regStatus.strategyLimit,
-                          regStatus.strategyUnknown,
-                          regStatus,
                           regControl,
                           regStrategies,
-                          responseStreamFIFO,
-                          operationStreamFIFO);
+                          problemStreamFIFO,
+                          operationStreamFIFO,
+                          stampStreamFIFO,
+                          solveStatusFIFO,
+                          solveClockFIFO);
 
     kernel.operationPush(regControl.capture,
-                         regStatus.txOperation,
                          regCapture,
+                         regLatency,
+                         regTrace,
                          operationStreamFIFO,
-                         operationStreamPack);
+                         stampStreamFIFO,
+                         operationStreamPack,
+                         recordStream,
+                         orderTagStream,
+                         pushStatusFIFO,
+                         pushClockFIFO);
 
-    kernel.eventHandler(regStatus.rxEvent,
-                        eventStream);
+    kernel.statusLatch(regControl.capture,
+                       regStatus,
+                       pullStatusFIFO,
+                       eventStatusFIFO,
+                       updateStatusFIFO,
+                       solveStatusFIFO,
+                       pushStatusFIFO,
+                       latchClockFIFO);
 
 }
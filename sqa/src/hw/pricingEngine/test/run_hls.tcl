@@ -21,7 +21,7 @@ set SOLN "sol"
 set CLKP 300MHz
 set CASE_ROOT [pwd]
 set KERNEL_ROOT "${CASE_ROOT}/../"
-set CFLAGS "-I${CASE_ROOT}/../../common/include -std=c++14"
+set CFLAGS "-I${CASE_ROOT}/../../common/include -std=c++14 -DQUBO_M3=${QUBO_M3} -DQMC_COLORING=${QMC_COLORING}"
 
 open_project -reset $PROJ
 
@@ -39,6 +39,11 @@ create_clock -period $CLKP -name default
 
 if {$CSIM == 1} {
   csim_design
+  if {[info exists CSIM_MODES]} {
+    foreach mode $CSIM_MODES {
+      csim_design -argv "${CASE_ROOT}/data/data0.txt $mode"
+    }
+  }
 }
 
 if {$CSYNTH == 1} {
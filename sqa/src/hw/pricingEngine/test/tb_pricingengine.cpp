@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
@@ -29,36 +33,315 @@ float Uint2Float(ap_uint<32> n) { return (float)(*(float *)&n); }
 
 #define exchCast(x) (float2Uint(x))
 
+/* Top of book quantity of the replayed responses, deep enough that a cycle across rates of very
+ * different magnitude still sizes every leg to at least a unit */
+#define BOOK_QUANTITY (1000000)
+
+/* Burst replay, rounds of jittered updates for every symbol arriving back to back */
+#define NUM_BURST_ROUND (10)
+#define BURST_JITTER (0.001f)
+
+/* Timer replay, one round of updates per clock tick, solve at most every other tick */
+#define NUM_TIMER_TICK (32)
+#define TIMER_SOLVE_INTERVAL (2)
+
+/* Stale replay, one symbol stops quoting and has to expire after STALE_AGE ticks, the age is
+ * programmed in kernel clock cycles so the ticks are converted at the duration of the first one */
+#define NUM_STALE_TICK (16)
+#define STALE_AGE (4)
+#define STALE_SYMBOL (5)
+
+/* Soak replay, market updates without solves to measure the drift of h */
+#define NUM_SOAK_TICK (10000000)
+#define SOAK_MAX_DRIFT (1e-3f)
+
+/* Fast log accuracy sweep over the rate range of pcap_gen.py, 10^[-4, 4] */
+#define NUM_LOG_SAMPLE (1000000)
+#define LOG_RANGE_DECADE (4)
+#define LOG_MAX_ERR (1e-5)
+
+/* Depth replay, every level is DEPTH_DECAY times thicker and worse than the one above */
+#define DEPTH_QUANTITY (100)
+#define DEPTH_DECAY (10)
+
+/* Backtest replay of a pcap_gen.py csv, once without and once with trading costs */
+#define BACKTEST_FEE (0.0002f)        // log domain venue fee per leg
+#define BACKTEST_SLIPPAGE (0.0003f)   // log domain expected slippage per leg
+#define BACKTEST_IDLE_RATE (0.9f)     // rate of edges the csv never quotes, slightly lossy
+#define BACKTEST_PRICE_SCALE (10000000.0f)
+#define BACKTEST_SECURITY_STEP (1024)
+
+/* Legs replay, jittered rounds to measure basket length and annealer settling against QUBO_M3 */
+#define NUM_LEGS_ROUND (32)
+
+/* Dedup replay, jittered requotes of the same book once with a reprice threshold above the jitter
+ * and once below it, a basket repeated within DEDUP_AGE rounds is suppressed or repriced */
+#define NUM_DEDUP_ROUND (32)
+#define DEDUP_AGE (8)
+#define DEDUP_REPRICE_HIGH (0.01f)
+#define DEDUP_REPRICE_LOW (0.0001f)
+
+/* Memo replay, 10,000 jittered ticks once annealing every solve and once with the solution memo,
+ * baskets of the two runs are compared solve by solve */
+#define NUM_MEMO_ROUND (500)
+
+/* Anytime replay, jittered rounds solved under budgets of 1 to ANNEAL_MAX_ITER iterations
+ * and with early convergence after ANYTIME_CONVERGE quiet iterations */
+#define NUM_ANYTIME_ROUND (32)
+#define ANYTIME_CONVERGE (2)
+
+/* Colour replay, jittered rounds to measure the gain of the baskets of the QMC schedule built with
+ * QMC_COLORING against the sequential reference of a default build */
+#define NUM_COLOR_ROUND (128)
+
+/* Latency replay, jittered rounds with the kernel called once per response so that ingress is
+ * spread over the calls, csim reports the stages in ns of the host clock */
+#define NUM_LATENCY_ROUND (32)
+
+/* Trace replay, enough jittered rounds for the ring to fill half a ring past its trigger */
+#define NUM_TRACE_ROUND (160)
+#define NUM_TRACE_SHOW (4)
+
+/* Record replay, jittered rounds whose solution records are written as a host capture file */
+#define NUM_RECORD_ROUND (32)
+
+/* Quality replay, jittered rounds per iteration budget with the quality counters read back */
+#define NUM_QUALITY_ROUND (32)
+
+/* Snapshot replay, jittered rounds run with the statistics block latched */
+#define NUM_SNAPSHOT_ROUND (8)
+
+/* Latest top of book written per symbol, {bid, ask}, every leg has to be priced from its own */
+ap_uint<32> lastQuote[NUM_SYMBOL][2];
+
+void responseWrite(mmInterface &intf, orderBookResponseVerify_t &responseVerify,
+                   orderBookResponseStreamPack_t &responseStreamPackFIFO,
+                   ap_uint<64> timestamp = 0)
+{
+    orderBookResponse_t response;
+    orderBookResponsePack_t responsePack;
+
+    response.symbolIndex = responseVerify.symbolIndex;
+    response.timestamp = timestamp;
+    lastQuote[responseVerify.symbolIndex][0] = responseVerify.bidPrice[0];
+    lastQuote[responseVerify.symbolIndex][1] = responseVerify.askPrice[0];
+
+    response.bidCount =
+        (responseVerify.bidCount[4], responseVerify.bidCount[3], responseVerify.bidCount[2],
+         responseVerify.bidCount[1], responseVerify.bidCount[0]);
+
+    response.bidPrice =
+        (responseVerify.bidPrice[4], responseVerify.bidPrice[3], responseVerify.bidPrice[2],
+         responseVerify.bidPrice[1], responseVerify.bidPrice[0]);
+
+    response.bidQuantity = (responseVerify.bidQuantity[4], responseVerify.bidQuantity[3],
+                            responseVerify.bidQuantity[2], responseVerify.bidQuantity[1],
+                            responseVerify.bidQuantity[0]);
+
+    response.askCount =
+        (responseVerify.askCount[4], responseVerify.askCount[3], responseVerify.askCount[2],
+         responseVerify.askCount[1], responseVerify.askCount[0]);
+
+    response.askPrice =
+        (responseVerify.askPrice[4], responseVerify.askPrice[3], responseVerify.askPrice[2],
+         responseVerify.askPrice[1], responseVerify.askPrice[0]);
+
+    response.askQuantity = (responseVerify.askQuantity[4], responseVerify.askQuantity[3],
+                            responseVerify.askQuantity[2], responseVerify.askQuantity[1],
+                            responseVerify.askQuantity[0]);
+
+    intf.orderBookResponsePack(&response, &responsePack);
+    responseStreamPackFIFO.write(responsePack);
+}
+
+void roundWrite(mmInterface &intf, std::vector<orderBookResponseVerify_t> &orderBookResponses,
+                orderBookResponseStreamPack_t &responseStreamPackFIFO, ap_uint<64> timestamp = 0,
+                int skipSymbol = -1)
+{
+    orderBookResponseVerify_t responseVerify;
+
+    for (unsigned int i = 0; i < orderBookResponses.size(); ++i) {
+        if ((int)i == skipSymbol) continue;
+        float jitter = 1.0f + BURST_JITTER * (2.0f * rand() / RAND_MAX - 1.0f);
+        responseVerify = orderBookResponses[i];
+        responseVerify.bidPrice[0] = exchCast(Uint2Float(responseVerify.bidPrice[0]) * jitter);
+        responseVerify.askPrice[0] = exchCast(Uint2Float(responseVerify.askPrice[0]) * jitter);
+        responseWrite(intf, responseVerify, responseStreamPackFIFO, timestamp);
+    }
+}
+
+/* min / percentiles / max of latency samples, the samples are sorted in place */
+void printDistribution(const std::string &label, std::vector<unsigned int> &samples)
+{
+    std::cout << label << ": n=" << samples.size();
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        std::cout << " min=" << samples.front()
+                  << " p50=" << samples[samples.size() * 50 / 100]
+                  << " p90=" << samples[samples.size() * 90 / 100]
+                  << " p99=" << samples[samples.size() * 99 / 100] << " max=" << samples.back();
+    }
+    std::cout << std::endl;
+}
+
+/* Reference sizing of the legs of one basket on the synthetic depth book, level k of an edge quotes
+ * its top of book rate / DEPTH_DECAY^k for DEPTH_QUANTITY * DEPTH_DECAY^k. The legs are walked into
+ * closed trails as the kernel does, and each trail takes the largest notional from a level boundary
+ * that every leg fills at a positive summed logged VWAP, carried leg to leg. Costs are 0 */
+std::vector<unsigned long> depthExpect(const std::vector<int> &legs)
+{
+    std::vector<unsigned long> expect(legs.size(), 0);
+    std::vector<bool> walked(legs.size(), false);
+
+    for (;;) {
+        int first = -1;
+        for (int i = 0; i < (int)legs.size(); ++i) {
+            if (!walked[i] && (first < 0 || legs[i] < legs[first])) first = i;
+        }
+        if (first < 0) break;
+
+        int start = exch_index2id[legs[first]][0];
+        int currency = start;
+        std::vector<int> trail;
+        std::vector<double> reach;
+        double rate = 1;
+        do {
+            int next = -1;
+            for (int i = 0; i < (int)legs.size(); ++i) {
+                if (!walked[i] && exch_index2id[legs[i]][0] == currency &&
+                    (next < 0 || legs[i] < legs[next]))
+                    next = i;
+            }
+            if (next < 0) break;
+            walked[next] = true;
+            trail.push_back(next);
+            reach.push_back(rate);
+            rate *= Uint2Float(lastQuote[legs[next] / 2][legs[next] & 1]);
+            currency = exch_index2id[legs[next]][1];
+        } while (currency != start);
+        if (currency != start) continue;
+
+        double bestNotional = 0;
+        for (unsigned int cp = 0; cp < trail.size(); ++cp) {
+            unsigned long boundary = 0;
+            for (unsigned long ck = 0, decay = 1; ck < 5; ++ck, decay *= DEPTH_DECAY) {
+                boundary += DEPTH_QUANTITY * decay;
+                double notional = boundary / reach[cp];
+                if (notional < 1 || notional <= bestNotional) continue;
+
+                std::vector<unsigned long> size(trail.size());
+                double amount = notional, gain = 0;
+                bool fillable = true;
+                for (unsigned int p = 0; p < trail.size(); ++p) {
+                    int e = legs[trail[p]];
+                    double top = Uint2Float(lastQuote[e / 2][e & 1]);
+                    double value = 0;
+                    unsigned long filled = 0;
+                    size[p] = (unsigned long)(amount + 0.5);
+                    if (p == cp && size[p] > boundary) size[p] = boundary;
+                    for (unsigned long k = 0, d = 1; k < 5; ++k, d *= DEPTH_DECAY) {
+                        if (filled >= size[p]) break;
+                        unsigned long fill = std::min(size[p] - filled, DEPTH_QUANTITY * d);
+                        filled += fill;
+                        value += fill * top / d;
+                    }
+                    fillable = fillable && size[p] != 0 && filled == size[p];
+                    if (size[p] != 0) gain += std::log(value / size[p]);
+                    amount = value;
+                }
+                if (fillable && gain > 0) {
+                    bestNotional = notional;
+                    for (unsigned int p = 0; p < trail.size(); ++p) expect[trail[p]] = size[p];
+                }
+            }
+        }
+    }
+    return expect;
+}
+
+/* failed invariants of the replay, any failure fails the exit code of the run */
+int countFail = 0;
+
+void check(bool pass, const std::string &what)
+{
+    if (!pass) {
+        std::cout << "FAIL: " << what << std::endl;
+        ++countFail;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     pricingEngineRegControl_t regControl = {0};
     pricingEngineRegStatus_t regStatus = {0};
     ap_uint<1024> regCapture = 0x0;
     pricingEngineRegStrategy_t regStrategies[NUM_SYMBOL];
+    pricingEngineRegCost_t regCosts[NUM_SYMBOL];
+    ap_uint<32> regLatency[PE_LATENCY_STAGES * PE_LATENCY_BUCKETS];
+    ap_uint<PE_TRACE_BITS> regTrace[PE_TRACE_DEPTH];
 
     mmInterface intf;
-    orderBookResponseVerify_t responseVerify;
-    orderBookResponse_t response;
-    orderBookResponsePack_t responsePack;
     orderEntryOperation_t operation;
     orderEntryOperationPack_t operationPack;
+    ap_uint<PE_TAG_BITS> orderTag;
 
     orderBookResponseStreamPack_t responseStreamPackFIFO("responseStreamPackFIFO");
     orderEntryOperationStreamPack_t operationStreamPackFIFO("operationStreamPackFIFO");
     clockTickGeneratorEventStream_t eventStreamFIFO("eventStreamFIFO");
+    solveRecordStream_t recordStreamFIFO("recordStreamFIFO");
+    orderTagStream_t orderTagStreamFIFO("orderTagStreamFIFO");
 
     std::cout << "PricingEngine Test" << std::endl;
     std::cout << "------------------" << std::endl;
 
     memset(&regStrategies, 0, sizeof(regStrategies));
+    memset(&regCosts, 0, sizeof(regCosts));
+    memset(&regLatency, 0, sizeof(regLatency));
+    memset(&regTrace, 0, sizeof(regTrace));
 
     // Read exchange rates
     std::string priceFilePath = "../../../../data/data0.txt";
     if (argc >= 2) priceFilePath = std::string(argv[1]);
+    // "burst" replays the file as a market data burst after the warm up
+    bool burstMode = (argc >= 3) && (std::string(argv[2]) == "burst");
+    // "timer" replays it one round per clock tick with timer driven solves
+    bool timerMode = (argc >= 3) && (std::string(argv[2]) == "timer");
+    // "stale" stops quoting one symbol and checks it is expired from the Ising field
+    bool staleMode = (argc >= 3) && (std::string(argv[2]) == "stale");
+    // "soak" replays NUM_SOAK_TICK updates and reports the drift of h, argv[3] sets the
+    // rebuild period (0xffffffff practically disables the rebuild)
+    bool soakMode = (argc >= 3) && (std::string(argv[2]) == "soak");
+    // "log" reports the fast log accuracy against std::log
+    bool logMode = (argc >= 3) && (std::string(argv[2]) == "log");
+    // "depth" replays the file with a five level book and sized legs
+    bool depthMode = (argc >= 3) && (std::string(argv[2]) == "depth");
+    // "backtest" replays the csv in argv[3] without and with trading costs, argv[4] overrides
+    // the log domain cost per leg
+    bool backtestMode = (argc >= 3) && (std::string(argv[2]) == "backtest");
+    // "legs" reports legs per basket and the annealing iteration the solution settled at
+    bool legsMode = (argc >= 3) && (std::string(argv[2]) == "legs");
+    // "dedup" reports baskets sent, suppressed and repriced when a cycle persists over rounds
+    bool dedupMode = (argc >= 3) && (std::string(argv[2]) == "dedup");
+    // "memo" reports the hit rate of the solution memo and the solve time it saves
+    bool memoMode = (argc >= 3) && (std::string(argv[2]) == "memo");
+    // "anytime" reports iterations executed and baskets found per iteration budget
+    bool anytimeMode = (argc >= 3) && (std::string(argv[2]) == "anytime");
+    // "color" reports the QMC stages per sweep and the log gain of the baskets found
+    bool colorMode = (argc >= 3) && (std::string(argv[2]) == "color");
+    // "latency" reports the per stage latency statistics and histograms
+    bool latencyMode = (argc >= 3) && (std::string(argv[2]) == "latency");
+    // "trace" arms the decision trace on the first basket sent and decodes the ring around it
+    bool traceMode = (argc >= 3) && (std::string(argv[2]) == "trace");
+    // "record" writes the solution records of a replay to the capture file argv[3]
+    bool recordMode = (argc >= 3) && (std::string(argv[2]) == "record");
+    // "quality" reports the solution quality counters per iteration budget
+    bool qualityMode = (argc >= 3) && (std::string(argv[2]) == "quality");
+    // "snapshot" latches the statistics block and checks it holds while the replay runs on
+    bool snapshotMode = (argc >= 3) && (std::string(argv[2]) == "snapshot");
     std::ifstream ifs(priceFilePath.c_str());
     if (!ifs) {
         std::cerr << "Error: \"" << priceFilePath << "\" does not exist!!\n";
-        return false;
+        return 1;
     }
 
     // '#' indicates that the line is a comment
@@ -93,44 +376,15 @@ int main(int argc, char *argv[])
         orderBookResponses.push_back({i,
                                       {1, 0, 0, 0, 0},
                                       {exchCast(1 / bidPrice), 0, 0, 0, 0},
-                                      {1, 0, 0, 0, 0},
+                                      {BOOK_QUANTITY, 0, 0, 0, 0},
                                       {1, 0, 0, 0, 0},
                                       {exchCast(askPrice), 0, 0, 0, 0},
-                                      {1, 0, 0, 0, 0}});
+                                      {BOOK_QUANTITY, 0, 0, 0, 0}});
     }
     // End of file reading
 
     for (int i = 0; i < responseCount; ++i) {
-        responseVerify = orderBookResponses[i];
-
-        response.symbolIndex = responseVerify.symbolIndex;
-
-        response.bidCount =
-            (responseVerify.bidCount[4], responseVerify.bidCount[3], responseVerify.bidCount[2],
-             responseVerify.bidCount[1], responseVerify.bidCount[0]);
-
-        response.bidPrice =
-            (responseVerify.bidPrice[4], responseVerify.bidPrice[3], responseVerify.bidPrice[2],
-             responseVerify.bidPrice[1], responseVerify.bidPrice[0]);
-
-        response.bidQuantity = (responseVerify.bidQuantity[4], responseVerify.bidQuantity[3],
-                                responseVerify.bidQuantity[2], responseVerify.bidQuantity[1],
-                                responseVerify.bidQuantity[0]);
-
-        response.askCount =
-            (responseVerify.askCount[4], responseVerify.askCount[3], responseVerify.askCount[2],
-             responseVerify.askCount[1], responseVerify.askCount[0]);
-
-        response.askPrice =
-            (responseVerify.askPrice[4], responseVerify.askPrice[3], responseVerify.askPrice[2],
-             responseVerify.askPrice[1], responseVerify.askPrice[0]);
-
-        response.askQuantity = (responseVerify.askQuantity[4], responseVerify.askQuantity[3],
-                                responseVerify.askQuantity[2], responseVerify.askQuantity[1],
-                                responseVerify.askQuantity[0]);
-
-        intf.orderBookResponsePack(&response, &responsePack);
-        responseStreamPackFIFO.write(responsePack);
+        responseWrite(intf, orderBookResponses[i], responseStreamPackFIFO);
     }
 
     // configure
@@ -151,15 +405,902 @@ int main(int argc, char *argv[])
 
     // kernel call to process operations
     while (!responseStreamPackFIFO.empty()) {
-        pricingEngineTop(regControl, regStatus, regCapture, regStrategies, responseStreamPackFIFO,
-                         operationStreamPackFIFO, eventStreamFIFO);
+        pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                         regTrace, responseStreamPackFIFO, operationStreamPackFIFO, eventStreamFIFO,
+                         recordStreamFIFO, orderTagStreamFIFO);
+    }
+
+    if (burstMode) {
+        ap_uint<32> processResponse = regStatus.processResponse;
+        ap_uint<32> conflateResponse = regStatus.conflateResponse;
+        ap_uint<32> solveProblem = regStatus.solveProblem;
+        int burstCount = NUM_BURST_ROUND * responseCount;
+
+        // whole burst lands in the FIFO before the kernel gets to run
+        srand(1);
+        for (int r = 0; r < NUM_BURST_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+        }
+
+        while (!responseStreamPackFIFO.empty()) {
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+        }
+
+        // without conflation every update is a solve, the last one queues behind all others
+        int burstSolve = regStatus.solveProblem - solveProblem;
+        std::cout << "BURST: updates=" << regStatus.processResponse - processResponse
+                  << " conflated=" << regStatus.conflateResponse - conflateResponse
+                  << " solves=" << burstSolve << std::endl;
+        std::cout << "BURST: queued solves ahead of last update=" << burstSolve - 1
+                  << " (unconflated=" << burstCount - 1 << ")" << std::endl;
+        check(burstSolve < burstCount, "BURST: conflation has to merge updates into fewer solves");
+    }
+
+    if (timerMode) {
+        ap_uint<32> processResponse = regStatus.processResponse;
+        ap_uint<32> solveProblem = regStatus.solveProblem;
+        clockTickGeneratorEvent_t tickEvent;
+
+        // market updates only refresh h, solves follow the clock tick
+        regControl.schedule = PE_SCHEDULE_TIMER;
+        regControl.solveInterval = TIMER_SOLVE_INTERVAL;
+
+        srand(1);
+        for (int t = 1; t <= NUM_TIMER_TICK; ++t) {
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+
+            tickEvent.timestamp = t;
+            eventStreamFIFO.write(tickEvent);
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+        }
+
+        std::cout << "TIMER: updates=" << regStatus.processResponse - processResponse
+                  << " ticks=" << NUM_TIMER_TICK
+                  << " solves=" << regStatus.solveProblem - solveProblem
+                  << " solve rate=" << regStatus.solveRate << "/" << SOLVE_RATE_TICKS
+                  << " ticks" << std::endl;
+        check(regStatus.solveProblem - solveProblem <= NUM_TIMER_TICK / TIMER_SOLVE_INTERVAL,
+              "TIMER: at most one solve per solve interval");
+    }
+
+    if (staleMode) {
+        clockTickGeneratorEvent_t tickEvent;
+        int countOrder[2] = {0, 0};
+        int countStaleOrder[2] = {0, 0};
+
+        // expiry is held back over the first tick, which gives the length of a tick in ns
+        regControl.staleAge = 0;
+
+        srand(1);
+        for (int t = 1; t <= NUM_STALE_TICK; ++t) {
+            auto start = std::chrono::steady_clock::now();
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO, t, STALE_SYMBOL);
+            tickEvent.timestamp = t;
+            eventStreamFIFO.write(tickEvent);
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+            if (t == 1) {
+                auto stop = std::chrono::steady_clock::now();
+                unsigned long long tickNs =
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+                regControl.staleAge = std::min(STALE_AGE * tickNs, 0xffffffffULL);
+            }
+
+            // [0] before, [1] after the stale symbol expired
+            bool expired = (regStatus.staleEdge >> (STALE_SYMBOL * 2)) & 0x3;
+            while (!operationStreamPackFIFO.empty()) {
+                operationPack = operationStreamPackFIFO.read();
+                orderTag = orderTagStreamFIFO.read();
+                intf.orderEntryOperationUnpack(&operationPack, &operation);
+                ++countOrder[expired];
+                if (operation.symbolIndex == STALE_SYMBOL) ++countStaleOrder[expired];
+            }
+        }
+
+        std::cout << "STALE: symbol=" << STALE_SYMBOL << " age=" << STALE_AGE << " ticks ("
+                  << regControl.staleAge << " ns)"
+                  << " stale edges=0x" << std::hex << regStatus.staleEdge << std::dec
+                  << std::endl;
+        std::cout << "STALE: orders before expiry=" << countOrder[0]
+                  << " (stale symbol " << countStaleOrder[0] << ")"
+                  << " after expiry=" << countOrder[1] << " (stale symbol "
+                  << countStaleOrder[1] << ")" << std::endl;
+        check(((regStatus.staleEdge >> (STALE_SYMBOL * 2)) & 0x3) != 0,
+              "STALE: edges of the stale symbol have to expire");
+        check(countStaleOrder[1] == 0, "STALE: no leg on the stale symbol after expiry");
+    }
+
+    if (soakMode) {
+        orderBookResponseVerify_t responseVerify;
+        float fieldDrift;
+
+        // solves are held back, only the h maintenance is exercised
+        regControl.schedule = PE_SCHEDULE_TIMER;
+        regControl.solveInterval = 0xffffffff;
+        if (argc >= 4) regControl.rebuildPeriod = std::stoul(argv[3], nullptr, 0);
+
+        srand(1);
+        for (int t = 0; t < NUM_SOAK_TICK; ++t) {
+            float jitter = 1.0f + BURST_JITTER * (2.0f * rand() / RAND_MAX - 1.0f);
+            responseVerify = orderBookResponses[t % responseCount];
+            responseVerify.bidPrice[0] = exchCast(Uint2Float(responseVerify.bidPrice[0]) * jitter);
+            responseVerify.askPrice[0] = exchCast(Uint2Float(responseVerify.askPrice[0]) * jitter);
+            responseWrite(intf, responseVerify, responseStreamPackFIFO, t);
+
+            // update followed by an idle cycle
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+        }
+
+        // final rebuild against the current rates measures the remaining drift
+        regControl.rebuildPeriod = 1;
+        pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                         regTrace, responseStreamPackFIFO, operationStreamPackFIFO, eventStreamFIFO,
+                         recordStreamFIFO, orderTagStreamFIFO);
+
+        fieldDrift = Uint2Float(regStatus.fieldDrift);
+        std::cout << "SOAK: ticks=" << NUM_SOAK_TICK << " rebuild period="
+                  << (argc >= 4 ? std::string(argv[3]) : std::string("default"))
+                  << " max drift=" << std::scientific << fieldDrift << std::defaultfloat
+                  << std::endl;
+        // an overridden rebuild period is an experiment, only the default one is checked
+        if (argc < 4) check(fieldDrift < SOAK_MAX_DRIFT, "SOAK: drift of h above SOAK_MAX_DRIFT");
+    }
+
+    if (logMode) {
+        double maxErr = 0, sumErr = 0, maxErrPrice = 0;
+
+        // bid prices enter as reciprocals, both directions share the same range
+        for (int n = 0; n < NUM_LOG_SAMPLE; ++n) {
+            float price = std::pow(10.0, LOG_RANGE_DECADE * (2.0 * n / (NUM_LOG_SAMPLE - 1) - 1));
+            double err = std::fabs((double)fastLog(float2Uint(price)) - std::log((double)price));
+            sumErr += err;
+            if (err > maxErr) {
+                maxErr = err;
+                maxErrPrice = price;
+            }
+        }
+
+        std::cout << "FASTLOG: samples=" << NUM_LOG_SAMPLE << " range=[1e-" << LOG_RANGE_DECADE
+                  << ",1e" << LOG_RANGE_DECADE << "] lut=" << (1 << LOG_LUT_BITS) << std::scientific
+                  << " max abs err=" << maxErr << " at " << maxErrPrice
+                  << " mean abs err=" << sumErr / NUM_LOG_SAMPLE << std::defaultfloat << std::endl;
+        check(maxErr < LOG_MAX_ERR, "FASTLOG: error above LOG_MAX_ERR");
+    }
+
+    if (depthMode) {
+        orderBookResponseVerify_t responseVerify;
+
+        // legs of the warm up are sized against the default book
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        // full five level book for every symbol, the legs are sized against it
+        for (int i = 0; i < responseCount; ++i) {
+            responseVerify = orderBookResponses[i];
+            for (int k = 0, decay = 1; k < 5; ++k, decay *= DEPTH_DECAY) {
+                responseVerify.bidPrice[k] =
+                    exchCast(Uint2Float(orderBookResponses[i].bidPrice[0]) / decay);
+                responseVerify.askPrice[k] =
+                    exchCast(Uint2Float(orderBookResponses[i].askPrice[0]) / decay);
+                responseVerify.bidQuantity[k] = DEPTH_QUANTITY * decay;
+                responseVerify.askQuantity[k] = DEPTH_QUANTITY * decay;
+            }
+            responseWrite(intf, responseVerify, responseStreamPackFIFO);
+        }
+
+        while (!responseStreamPackFIFO.empty()) {
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+        }
+
+        // every leg of a basket sent has the size of the reference within float rounding
+        int countBasket = 0, countMissized = 0;
+        std::vector<int> legs;
+        std::vector<unsigned long> quantity;
+        while (!operationStreamPackFIFO.empty()) {
+            operationPack = operationStreamPackFIFO.read();
+            orderTag = orderTagStreamFIFO.read();
+            intf.orderEntryOperationUnpack(&operationPack, &operation);
+            legs.push_back(operation.symbolIndex * 2 + operation.direction);
+            quantity.push_back(operation.quantity);
+            if (ORDER_TAG_LEG_INDEX(orderTag) + 1 < ORDER_TAG_LEG_COUNT(orderTag)) {
+                continue;
+            }
+
+            std::vector<unsigned long> expect = depthExpect(legs);
+            std::cout << "DEPTH: basket=" << ORDER_TAG_BASKET(orderTag);
+            for (unsigned int i = 0; i < legs.size(); ++i) {
+                std::cout << " {" << exch_index2id[legs[i]][0] << "," << exch_index2id[legs[i]][1]
+                          << "}=" << quantity[i] << "/" << expect[i];
+                if (quantity[i] + 1 < expect[i] || quantity[i] > expect[i] + 1) ++countMissized;
+            }
+            std::cout << std::endl;
+            ++countBasket;
+            legs.clear();
+            quantity.clear();
+        }
+        std::cout << "DEPTH: levels=5 top quantity=" << DEPTH_QUANTITY
+                  << " decay/level=" << DEPTH_DECAY << " baskets=" << countBasket
+                  << " missized legs=" << countMissized << std::endl;
+        check(countBasket > 0, "DEPTH: no basket sent on the depth book");
+        check(countMissized == 0, "DEPTH: leg size off the reference sizing");
+    }
+
+    if (backtestMode) {
+        std::string csvFilePath = "../../../../../../../../../test_toolkit/data/data.csv";
+        if (argc >= 4) csvFilePath = std::string(argv[3]);
+        float cost = (argc >= 5) ? std::stof(argv[4]) : BACKTEST_FEE + BACKTEST_SLIPPAGE;
+        std::ifstream csv(csvFilePath.c_str());
+        if (!csv) {
+            std::cerr << "Error: \"" << csvFilePath << "\" does not exist!!\n";
+            return 1;
+        }
+
+        // Timestamp,MDEntryType,SecurityID,MDEntryPx, see test_toolkit/doc/README_generator.md
+        std::vector<std::vector<unsigned long long> > rows;
+        std::string line;
+        std::getline(csv, line);
+        while (std::getline(csv, line)) {
+            std::vector<unsigned long long> row;
+            size_t pos = 0, next;
+            while ((next = line.find(',', pos)) != std::string::npos) {
+                row.push_back(std::stoull(line.substr(pos, next - pos)));
+                pos = next + 1;
+            }
+            row.push_back(std::stoull(line.substr(pos)));
+            if (row.size() == 4) rows.push_back(row);
+        }
+
+        // orders of the warm up are not part of the backtest
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        int countOrder[2] = {0, 0};
+        for (int pass = 0; pass < 2; ++pass) {
+            orderBookResponseVerify_t responseVerify;
+
+            // [0] raw, [1] cost adjusted
+            for (int i = 0; i < NUM_SYMBOL; ++i) {
+                regCosts[i].bidCost = float2Uint(pass ? cost : 0.0f);
+                regCosts[i].askCost = float2Uint(pass ? cost : 0.0f);
+            }
+
+            // start every pass from a book without any cycle
+            std::vector<orderBookResponseVerify_t> book = orderBookResponses;
+            for (int i = 0; i < responseCount; ++i) {
+                book[i].bidPrice[0] = exchCast(BACKTEST_IDLE_RATE);
+                book[i].askPrice[0] = exchCast(BACKTEST_IDLE_RATE);
+                responseWrite(intf, book[i], responseStreamPackFIFO);
+            }
+            while (!responseStreamPackFIFO.empty()) {
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+            }
+            while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+            while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+            for (unsigned int r = 0; r < rows.size(); ++r) {
+                int symbol = rows[r][2] / BACKTEST_SECURITY_STEP - 1;
+                if (symbol < 0 || symbol >= responseCount) continue;
+                // rates of the csv are edge rates, bid as well as ask
+                ap_uint<32> price = exchCast(rows[r][3] / BACKTEST_PRICE_SCALE);
+                if (rows[r][1] == 48) {
+                    book[symbol].bidPrice[0] = price;
+                } else {
+                    book[symbol].askPrice[0] = price;
+                }
+                responseWrite(intf, book[symbol], responseStreamPackFIFO, rows[r][0]);
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+            }
+
+            while (!operationStreamPackFIFO.empty()) {
+                operationPack = operationStreamPackFIFO.read();
+                orderTag = orderTagStreamFIFO.read();
+                intf.orderEntryOperationUnpack(&operationPack, &operation);
+                std::cout << "BACKTEST: " << (pass ? "net" : "raw") << " order {"
+                          << exch_index2id[operation.symbolIndex * 2 + operation.direction][0]
+                          << ","
+                          << exch_index2id[operation.symbolIndex * 2 + operation.direction][1]
+                          << "} quantity=" << operation.quantity << std::endl;
+                ++countOrder[pass];
+            }
+        }
+
+        std::cout << "BACKTEST: rows=" << rows.size() << " cost/leg=" << cost
+                  << " raw orders=" << countOrder[0] << " net orders=" << countOrder[1]
+                  << " dropped=" << countOrder[0] - countOrder[1] << std::endl;
+        check(countOrder[0] > 0, "BACKTEST: no order sent without costs");
+        check(countOrder[1] <= countOrder[0], "BACKTEST: costs can only drop orders");
+    }
+
+    if (legsMode) {
+        int countSolve = 0, countBasket = 0, countLeg = 0, countLate = 0;
+        double sumSettle = 0;
+
+        // orders of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        srand(1);
+        for (int r = 0; r < NUM_LEGS_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+            // one extra call hands over the last update of the round
+            for (int n = 0; n <= responseCount; ++n) {
+                ap_uint<32> solveProblem = regStatus.solveProblem;
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+                if (regStatus.solveProblem == solveProblem) continue;
+
+                // the legs of a solve leave in the same call
+                int legs = 0;
+                while (!operationStreamPackFIFO.empty()) {
+                    operationStreamPackFIFO.read();
+                    orderTagStreamFIFO.read();
+                    ++legs;
+                }
+                ++countSolve;
+                sumSettle += regStatus.debug;
+                if (regStatus.debug > regStatus.annealIter) ++countLate;
+                if (legs != 0) {
+                    ++countBasket;
+                    countLeg += legs;
+                }
+            }
+        }
+
+        std::cout << "LEGS: M3=" << QUBO_M3 << " solves=" << countSolve
+                  << " baskets=" << countBasket << " legs/basket="
+                  << (countBasket ? (double)countLeg / countBasket : 0.0)
+                  << " mean settle=" << (countSolve ? sumSettle / countSolve : 0.0)
+                  << " iterations" << std::endl;
+        check(countBasket > 0, "LEGS: no basket sent on the replay");
+        check(countLate == 0, "LEGS: solution settled after the last iteration run");
+    }
+
+    if (dedupMode) {
+        float reprice[2] = {DEDUP_REPRICE_HIGH, DEDUP_REPRICE_LOW};
+
+        // orders of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        srand(1);
+        regControl.dedupAge = DEDUP_AGE;
+        for (int p = 0; p < 2; ++p) {
+            int countSolve = 0, countBasket = 0;
+            ap_uint<32> suppressBasket = regStatus.suppressBasket;
+            ap_uint<32> repriceBasket = regStatus.repriceBasket;
+            regControl.repriceThreshold = float2Uint(reprice[p]);
+
+            for (int r = 0; r < NUM_DEDUP_ROUND; ++r) {
+                // one round per timestamp, the age counts in rounds
+                roundWrite(intf, orderBookResponses, responseStreamPackFIFO,
+                           p * NUM_DEDUP_ROUND + r + 1);
+                for (int n = 0; n <= responseCount; ++n) {
+                    ap_uint<32> solveProblem = regStatus.solveProblem;
+                    pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                     regLatency, regTrace, responseStreamPackFIFO,
+                                     operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                     orderTagStreamFIFO);
+                    if (regStatus.solveProblem == solveProblem) continue;
+
+                    ++countSolve;
+                    if (!operationStreamPackFIFO.empty()) ++countBasket;
+                    while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+                    while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+                }
+            }
+
+            std::cout << "DEDUP: age=" << DEDUP_AGE << " reprice=" << reprice[p]
+                      << " solves=" << countSolve << " baskets=" << countBasket
+                      << " suppressed=" << regStatus.suppressBasket - suppressBasket
+                      << " repriced=" << regStatus.repriceBasket - repriceBasket << std::endl;
+            // a suppressed basket is not sent, a repriced one is, above the jitter none is repriced
+            check(countBasket > 0, "DEDUP: no basket sent on the replay");
+            check(countBasket + (regStatus.suppressBasket - suppressBasket) <= countSolve,
+                  "DEDUP: suppressed basket sent");
+            check(regStatus.repriceBasket - repriceBasket <= countBasket,
+                  "DEDUP: repriced basket not sent");
+            if (p == 0) {
+                check(regStatus.repriceBasket == repriceBasket, "DEDUP: repriced above the jitter");
+            }
+        }
+        regControl.dedupAge = 0;
+    }
+
+    if (memoMode) {
+        std::vector<unsigned int> annealLegs;
+        double annealTime = 0;
+
+        // orders of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        for (int p = 0; p < 2; ++p) {
+            int countSolve = 0, countAgree = 0, countLoss = 0;
+            double solveTime = 0;
+            ap_uint<32> memoHit = regStatus.memoHit;
+            ap_uint<32> memoReject = regStatus.memoReject;
+            regControl.schedule = p ? PE_SCHEDULE_MEMO : 0;
+
+            // both runs replay the same ticks
+            srand(1);
+            for (int r = 0; r < NUM_MEMO_ROUND; ++r) {
+                roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+                for (int n = 0; n <= responseCount; ++n) {
+                    ap_uint<32> solveProblem = regStatus.solveProblem;
+                    ap_uint<32> hit = regStatus.memoHit;
+                    auto start = std::chrono::steady_clock::now();
+                    pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                     regLatency, regTrace, responseStreamPackFIFO,
+                                     operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                     orderTagStreamFIFO);
+                    auto stop = std::chrono::steady_clock::now();
+                    if (regStatus.solveProblem == solveProblem) continue;
+
+                    // legs of the basket as an edge bitmask, gain as the sum of the logged rates
+                    unsigned int legs = 0;
+                    double gain = 0;
+                    while (!operationStreamPackFIFO.empty()) {
+                        operationPack = operationStreamPackFIFO.read();
+                        orderTag = orderTagStreamFIFO.read();
+                        intf.orderEntryOperationUnpack(&operationPack, &operation);
+                        legs |= 1u << (operation.symbolIndex * 2 + operation.direction);
+                        gain += std::log(Uint2Float(operation.price));
+                    }
+                    // a memo hit is only reused as long as it still is a profitable cycle
+                    if (regStatus.memoHit != hit && legs != 0 && gain <= 0) ++countLoss;
+                    if (p == 0) {
+                        annealLegs.push_back(legs);
+                    } else if (countSolve < (int)annealLegs.size() &&
+                               annealLegs[countSolve] == legs) {
+                        ++countAgree;
+                    }
+                    solveTime += std::chrono::duration<double, std::micro>(stop - start).count();
+                    ++countSolve;
+                }
+            }
+
+            double meanTime = countSolve ? solveTime / countSolve : 0.0;
+            int hits = regStatus.memoHit - memoHit;
+            if (p == 0) {
+                annealTime = meanTime;
+                std::cout << "MEMO: off solves=" << countSolve << " mean solve=" << meanTime
+                          << "us" << std::endl;
+            } else {
+                std::cout << "MEMO: on solves=" << countSolve << " hits=" << hits
+                          << " rejects=" << regStatus.memoReject - memoReject << " hit rate="
+                          << (countSolve ? (double)hits / countSolve : 0.0)
+                          << " mean solve=" << meanTime << "us saved="
+                          << annealTime - meanTime << "us same basket=" << countAgree << "/"
+                          << countSolve << std::endl;
+            }
+            check(countLoss == 0, "MEMO: a memo hit sent a losing basket");
+        }
+        regControl.schedule = 0;
+    }
+
+    if (anytimeMode) {
+        // {budget in iterations, quiet iterations to converge}, 0 budget is the fixed anneal
+        const int setting[][2] = {{0, 0}, {1, 0}, {2, 0}, {5, 0}, {10, 0}, {ANNEAL_MAX_ITER, 0},
+                                  {ANNEAL_MAX_ITER, ANYTIME_CONVERGE}};
+
+        // orders of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        for (unsigned int k = 0; k < sizeof(setting) / sizeof(setting[0]); ++k) {
+            int countSolve = 0, countBasket = 0, countOver = 0;
+            double sumIter = 0;
+            regControl.solveBudget = setting[k][0];
+            regControl.convergeSweeps = setting[k][1];
+
+            // every setting replays the same ticks
+            srand(1);
+            for (int r = 0; r < NUM_ANYTIME_ROUND; ++r) {
+                roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+                for (int n = 0; n <= responseCount; ++n) {
+                    ap_uint<32> solveProblem = regStatus.solveProblem;
+                    pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                     regLatency, regTrace, responseStreamPackFIFO,
+                                     operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                     orderTagStreamFIFO);
+                    if (regStatus.solveProblem == solveProblem) continue;
+
+                    ++countSolve;
+                    sumIter += regStatus.annealIter;
+                    if (regStatus.annealIter > (setting[k][0] ? setting[k][0] : ANNEAL_ITER)) {
+                        ++countOver;
+                    }
+                    if (!operationStreamPackFIFO.empty()) ++countBasket;
+                    while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+                    while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+                }
+            }
+
+            std::cout << "ANYTIME: budget=" << regControl.solveBudget
+                      << " converge=" << regControl.convergeSweeps << " solves=" << countSolve
+                      << " mean iterations=" << (countSolve ? sumIter / countSolve : 0.0)
+                      << " baskets=" << countBasket << std::endl;
+            check(countOver == 0, "ANYTIME: a solve ran past its iteration budget");
+        }
+        regControl.solveBudget = 0;
+        regControl.convergeSweeps = 0;
+    }
+
+    if (qualityMode) {
+        // budget in iterations, 0 is the fixed anneal
+        const int setting[] = {0, 1, 2, 5};
+
+        for (unsigned int k = 0; k < sizeof(setting) / sizeof(setting[0]); ++k) {
+            ap_uint<64> solve = regStatus.qualityAllZero + regStatus.qualityNoCycle +
+                                regStatus.qualityCycle;
+            ap_uint<64> allZero = regStatus.qualityAllZero;
+            ap_uint<64> noCycle = regStatus.qualityNoCycle;
+            ap_uint<64> cycle = regStatus.qualityCycle;
+            ap_uint<64> profitable = regStatus.qualityProfitable;
+            ap_uint<64> spinFlip = regStatus.qualitySpinFlip;
+            regControl.solveBudget = setting[k];
+
+            // every setting replays the same ticks
+            srand(1);
+            for (int r = 0; r < NUM_QUALITY_ROUND; ++r) {
+                roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+                for (int n = 0; n <= responseCount; ++n) {
+                    pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                     regLatency, regTrace, responseStreamPackFIFO,
+                                     operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                     orderTagStreamFIFO);
+                }
+                while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+                while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+            }
+
+            solve = regStatus.qualityAllZero + regStatus.qualityNoCycle + regStatus.qualityCycle -
+                    solve;
+            double scale = solve ? 1.0 / (double)solve : 0.0;
+            std::cout << "QUALITY: budget=" << regControl.solveBudget << " solves=" << solve
+                      << " all zero=" << (regStatus.qualityAllZero - allZero) * scale
+                      << " no cycle=" << (regStatus.qualityNoCycle - noCycle) * scale
+                      << " cycle=" << (regStatus.qualityCycle - cycle) * scale
+                      << " profitable=" << (regStatus.qualityProfitable - profitable) * scale
+                      << " spins flipped/solve=" << (regStatus.qualitySpinFlip - spinFlip) * scale
+                      << std::endl;
+            check(regStatus.qualityProfitable - profitable <= regStatus.qualityCycle - cycle,
+                  "QUALITY: profitable solutions have to be cycles");
+        }
+        regControl.solveBudget = 0;
+    }
+
+    if (snapshotMode) {
+        pricingEngineRegStatus_t held;
+        int countMoved = 0;
+
+        // statusLatch latches the whole block on the first cycle it sees the bit
+        regControl.capture |= PE_CAPTURE_SNAPSHOT;
+        pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                         regTrace, responseStreamPackFIFO, operationStreamPackFIFO, eventStreamFIFO,
+                         recordStreamFIFO, orderTagStreamFIFO);
+        held = regStatus;
+
+        srand(1);
+        for (int r = 0; r < NUM_SNAPSHOT_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+            for (int n = 0; n <= responseCount; ++n) {
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+                if (regStatus.rxResponse != held.rxResponse ||
+                    regStatus.processResponse != held.processResponse ||
+                    regStatus.solveProblem != held.solveProblem ||
+                    regStatus.txOperation != held.txOperation ||
+                    regStatus.txBasket != held.txBasket ||
+                    regStatus.snapshotCycle != held.snapshotCycle) {
+                    ++countMoved;
+                }
+            }
+            while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+            while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+        }
+
+        // released, the block catches up with the counters on the next pass
+        regControl.capture &= ~PE_CAPTURE_SNAPSHOT;
+        pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                         regTrace, responseStreamPackFIFO, operationStreamPackFIFO, eventStreamFIFO,
+                         recordStreamFIFO, orderTagStreamFIFO);
+
+        std::cout << "SNAPSHOT: moved while held=" << countMoved
+                  << " responses=" << regStatus.rxResponse - held.rxResponse
+                  << " solves=" << regStatus.solveProblem - held.solveProblem
+                  << " orders=" << regStatus.txOperation - held.txOperation
+                  << " baskets=" << regStatus.txBasket - held.txBasket
+                  << " elapsed=" << regStatus.snapshotCycle - held.snapshotCycle << std::endl;
+        check(countMoved == 0, "SNAPSHOT: statistics moved while held");
+        check(regStatus.rxResponse != held.rxResponse, "SNAPSHOT: statistics stuck after release");
+        // csim drains every stage per call, a block latched as a whole has processed all it pulled
+        check(regStatus.processResponse == regStatus.rxResponse,
+              "SNAPSHOT: counters of the block latched apart");
+    }
+
+    if (colorMode) {
+        int countSolve = 0, countBasket = 0, countProfit = 0;
+        double sumGain = 0, solveTime = 0;
+
+        // orders of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        srand(1);
+        for (int r = 0; r < NUM_COLOR_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, responseStreamPackFIFO);
+            for (int n = 0; n <= responseCount; ++n) {
+                ap_uint<32> solveProblem = regStatus.solveProblem;
+                auto start = std::chrono::steady_clock::now();
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+                auto stop = std::chrono::steady_clock::now();
+                if (regStatus.solveProblem == solveProblem) continue;
+
+                // gain of the cycle is the sum of the logged rates of its legs
+                double gain = 0;
+                int legs = 0;
+                while (!operationStreamPackFIFO.empty()) {
+                    operationPack = operationStreamPackFIFO.read();
+                    orderTag = orderTagStreamFIFO.read();
+                    intf.orderEntryOperationUnpack(&operationPack, &operation);
+                    gain += std::log(Uint2Float(operation.price));
+                    ++legs;
+                }
+                ++countSolve;
+                solveTime += std::chrono::duration<double, std::micro>(stop - start).count();
+                if (legs != 0) {
+                    ++countBasket;
+                    sumGain += gain;
+                    if (gain > 0) ++countProfit;
+                }
+            }
+        }
+
+        std::cout << "COLOR: coloring=" << QMC_COLORING << " colors=" << NUM_COLOR
+                  << " stages/sweep="
+                  << (QMC_COLORING ? NUM_COLOR : NUM_SPIN) + NUM_TROT - 1
+                  << " solves=" << countSolve << " baskets=" << countBasket
+                  << " profitable=" << countProfit << " mean gain="
+                  << (countBasket ? sumGain / countBasket : 0.0)
+                  << " mean solve=" << (countSolve ? solveTime / countSolve : 0.0) << "us"
+                  << std::endl;
+        check(countProfit == countBasket, "COLOR: a basket sent is not a profitable cycle");
     }
 
-    // drain response stream
+    if (latencyMode) {
+        const char *stage[PE_LATENCY_STAGES] = {"update", "solve", "emit", "total"};
+        orderBookResponseStreamPack_t roundFIFO("roundFIFO");
+        std::vector<unsigned int> basketLatency, orderLatency;
+
+        // solves of the warm up are not part of the measurement
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+        while (!recordStreamFIFO.empty()) recordStreamFIFO.read();
+
+        srand(1);
+        for (int r = 0; r < NUM_LATENCY_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, roundFIFO);
+            while (!roundFIFO.empty()) {
+                responseStreamPackFIFO.write(roundFIFO.read());
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+            }
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+
+            // tick to trade of a basket is ingress to its last leg, taken from its solution
+            // record, the one of every order from its tag
+            while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+            while (!orderTagStreamFIFO.empty()) {
+                orderTag = orderTagStreamFIFO.read();
+                orderLatency.push_back(ORDER_TAG_EGRESS(orderTag) - ORDER_TAG_INGRESS(orderTag));
+            }
+            while (!recordStreamFIFO.empty()) {
+                ap_uint<PE_RECORD_BITS> record = recordStreamFIFO.read();
+                if (record.range(247, 243) != 0) {
+                    basketLatency.push_back(record.range(159, 128) - record.range(95, 64));
+                }
+            }
+        }
+
+        const ap_uint<32> *stat[PE_LATENCY_STAGES] = {
+            &regStatus.latencyUpdateMin, &regStatus.latencySolveMin, &regStatus.latencyEmitMin,
+            &regStatus.latencyTotalMin};
+        for (int s = 0; s < PE_LATENCY_STAGES; ++s) {
+            unsigned int samples = 0;
+            std::cout << "LATENCY: " << stage[s] << " min=" << stat[s][0] << " max=" << stat[s][1]
+                      << " mean=" << stat[s][2] << " histogram=";
+            for (int b = 0; b < PE_LATENCY_BUCKETS; ++b) {
+                samples += regLatency[s * PE_LATENCY_BUCKETS + b];
+                std::cout << (b ? "," : "") << regLatency[s * PE_LATENCY_BUCKETS + b];
+            }
+            std::cout << " samples=" << samples << std::endl;
+            if (samples != 0) {
+                check(stat[s][0] <= stat[s][2] && stat[s][2] <= stat[s][1],
+                      std::string("LATENCY: ") + stage[s] + " mean outside [min, max]");
+            }
+        }
+        printDistribution("TICK_TO_TRADE: basket", basketLatency);
+        printDistribution("TICK_TO_TRADE: order", orderLatency);
+    }
+
+    if (traceMode) {
+        const char *verdict[4] = {"none", "reject", "suppress", "send"};
+        orderBookResponseStreamPack_t roundFIFO("roundFIFO");
+        unsigned int countVerdict[4] = {0};
+
+        regControl.capture |= PE_CAPTURE_TRACE_ARM | (1 << PE_VERDICT_SEND);
+        srand(1);
+        for (int r = 0; r < NUM_TRACE_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, roundFIFO);
+            while (!roundFIFO.empty()) {
+                responseStreamPackFIFO.write(roundFIFO.read());
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+            }
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+            while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+            while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+        }
+
+        // a stopped ring holds the trigger entry and half a ring on either side of it
+        ap_uint<32> trigger = regStatus.traceTrigger;
+        unsigned int count = regStatus.traceCount;
+        unsigned int first = (count > PE_TRACE_DEPTH) ? count - PE_TRACE_DEPTH : 0;
+        for (unsigned int n = first; n < count; ++n) {
+            ++countVerdict[regTrace[n % PE_TRACE_DEPTH].range(73, 72)];
+        }
+        std::cout << "TRACE: entries=" << count << " triggered=" << trigger[31]
+                  << " stopped=" << trigger[30] << " trigger=" << trigger.range(29, 0)
+                  << " ring=" << count - first;
+        for (int v = 0; v < 4; ++v) std::cout << " " << verdict[v] << "=" << countVerdict[v];
+        std::cout << std::endl;
+
+        unsigned int at = trigger[31] ? (unsigned int)trigger.range(29, 0) : count;
+        for (unsigned int n = (at > first + NUM_TRACE_SHOW) ? at - NUM_TRACE_SHOW : first;
+             n <= at && n < count; ++n) {
+            ap_uint<PE_TRACE_BITS> entry = regTrace[n % PE_TRACE_DEPTH];
+            std::cout << "TRACE: #" << n << " timestamp=" << entry.range(63, 0)
+                      << " symbol=" << entry.range(71, 64)
+                      << " verdict=" << verdict[entry.range(73, 72)]
+                      << (entry[74] ? "+memo" : "") << " legs=" << entry.range(84, 80)
+                      << " h=" << Uint2Float(entry.range(127, 96)) << "/"
+                      << Uint2Float(entry.range(159, 128)) << " spins=0x" << std::hex
+                      << entry.range(191, 160) << std::dec
+                      << " energy=" << Uint2Float(entry.range(223, 192))
+                      << " latency=" << entry.range(255, 224) << std::endl;
+        }
+        // the ring is armed on a basket sent, it stops only after it triggered
+        check(!trigger[30] || trigger[31], "TRACE: ring stopped without a trigger");
+        if (trigger[31]) {
+            check(regTrace[trigger.range(29, 0) % PE_TRACE_DEPTH].range(73, 72) == PE_VERDICT_SEND,
+                  "TRACE: trigger entry is not a basket sent");
+        }
+        regControl.capture &= ~(PE_CAPTURE_TRACE_ARM | (1 << PE_VERDICT_SEND));
+    }
+
+    if (recordMode) {
+        const char *verdict[4] = {"none", "reject", "suppress", "send"};
+        std::string recordPath = (argc >= 4) ? std::string(argv[3]) : "solverecords.bin";
+        std::string tagPath = (argc >= 5) ? std::string(argv[4]) : "ordertags.bin";
+        std::ofstream ofs(recordPath.c_str(), std::ios::binary);
+        std::ofstream tagOfs(tagPath.c_str(), std::ios::binary);
+        orderBookResponseStreamPack_t roundFIFO("roundFIFO");
+        unsigned int countRecord = 0, countTag = 0, countVerdict[4] = {0}, countMismatch = 0;
+
+        // records and orders of the warm up are not part of the capture
+        while (!recordStreamFIFO.empty()) recordStreamFIFO.read();
+        while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+        while (!orderTagStreamFIFO.empty()) orderTagStreamFIFO.read();
+
+        srand(1);
+        for (int r = 0; r < NUM_RECORD_ROUND; ++r) {
+            roundWrite(intf, orderBookResponses, roundFIFO);
+            while (!roundFIFO.empty()) {
+                responseStreamPackFIFO.write(roundFIFO.read());
+                pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts,
+                                 regLatency, regTrace, responseStreamPackFIFO,
+                                 operationStreamPackFIFO, eventStreamFIFO, recordStreamFIFO,
+                                 orderTagStreamFIFO);
+            }
+            pricingEngineTop(regControl, regStatus, regCapture, regStrategies, regCosts, regLatency,
+                             regTrace, responseStreamPackFIFO, operationStreamPackFIFO,
+                             eventStreamFIFO, recordStreamFIFO, orderTagStreamFIFO);
+            while (!operationStreamPackFIFO.empty()) operationStreamPackFIFO.read();
+
+            // little endian as a data mover lays the streams out in host memory
+            while (!orderTagStreamFIFO.empty()) {
+                orderTag = orderTagStreamFIFO.read();
+                for (int b = 0; b < PE_TAG_BITS / 8; ++b) {
+                    tagOfs.put((char)(unsigned int)orderTag.range(b * 8 + 7, b * 8));
+                }
+                ++countTag;
+            }
+            while (!recordStreamFIFO.empty()) {
+                ap_uint<PE_RECORD_BITS> record = recordStreamFIFO.read();
+                for (int b = 0; b < PE_RECORD_BITS / 8; ++b) {
+                    ofs.put((char)(unsigned int)record.range(b * 8 + 7, b * 8));
+                }
+                ++countRecord;
+                ++countVerdict[record.range(241, 240)];
+                // a basket sent carries its legs, an empty solution none
+                unsigned int verdict = record.range(241, 240), legs = record.range(247, 243);
+                if ((verdict == PE_VERDICT_SEND && legs == 0) ||
+                    (verdict == PE_VERDICT_NONE && legs != 0)) {
+                    ++countMismatch;
+                }
+            }
+        }
+
+        std::cout << "RECORD: file=" << recordPath << " records=" << countRecord;
+        for (int v = 0; v < 4; ++v) std::cout << " " << verdict[v] << "=" << countVerdict[v];
+        std::cout << " dropped=" << regStatus.recordDrop << " tags=" << tagPath << " orders="
+                  << countTag << std::endl;
+        check(countMismatch == 0, "RECORD: legs do not match the verdict");
+    }
+
+    // drain response stream, legs of a basket have to arrive complete and back to back
+    int countBasket = 0, countBrokenBasket = 0, countLeg = 0, countMispriced = 0, countOrderId = 0;
+    unsigned int nextLeg = 0, lastOrderId = 0;
     while (!operationStreamPackFIFO.empty()) {
         operationPack = operationStreamPackFIFO.read();
+        orderTag = orderTagStreamFIFO.read();
         intf.orderEntryOperationUnpack(&operationPack, &operation);
 
+        // orderId counts the orders sent, so it never repeats, and the tag names the same order
+        if (countLeg != 0 && operation.orderId != lastOrderId + 1) ++countOrderId;
+        if (ORDER_TAG_ID(orderTag) != operation.orderId) ++countOrderId;
+        lastOrderId = operation.orderId;
+
+        unsigned int legIndex = ORDER_TAG_LEG_INDEX(orderTag);
+        unsigned int legCount = ORDER_TAG_LEG_COUNT(orderTag);
+        if (legIndex != nextLeg) ++countBrokenBasket;
+        nextLeg = (legIndex + 1 < legCount) ? legIndex + 1 : 0;
+        if (nextLeg == 0) ++countBasket;
+        ++countLeg;
+        if (operation.price != lastQuote[operation.symbolIndex][operation.direction]) {
+            ++countMispriced;
+        }
+
         std::cout << "ORDER_ENTRY_OPERATION: {" << operation.opCode << "," << operation.symbolIndex
                   << "," << operation.orderId << "," << operation.quantity << ","
                   << reinterpret_cast<float &>(operation.price) << "," << operation.direction
@@ -167,7 +1308,19 @@ int main(int argc, char *argv[])
 
         std::cout << " {" << exch_index2id[operation.symbolIndex * 2 + operation.direction][0]
                   << "," << exch_index2id[operation.symbolIndex * 2 + operation.direction][1] << "}"
-                  << std::endl;
+                  << " basket=" << ORDER_TAG_BASKET(orderTag) << " leg=" << legIndex + 1
+                  << "/" << legCount << std::endl;
+    }
+    if (nextLeg != 0) ++countBrokenBasket;
+    std::cout << "BASKET: baskets=" << countBasket << " broken=" << countBrokenBasket << std::endl;
+    std::cout << "PRICE: legs=" << countLeg << " off own symbol quote=" << countMispriced
+              << std::endl;
+    std::cout << "ORDER_ID: out of sequence or off the tag=" << countOrderId << std::endl;
+    check(countBrokenBasket == 0, "BASKET: legs of a basket interleaved or incomplete");
+    check(countOrderId == 0, "ORDER_ID: orderId repeated or off its tag");
+    // burst, timer and soak quote the book again before the legs of the warm up are drained
+    if (!burstMode && !timerMode && !soakMode) {
+        check(countMispriced == 0, "PRICE: leg priced off its own symbol quote");
     }
 
     // log final status
@@ -187,6 +1340,39 @@ int main(int argc, char *argv[])
     std::cout << "PE_RX_EVENT=" << regStatus.rxEvent << " ";
     std::cout << "PE_DEBUG=" << regStatus.debug << " ";
     std::cout << std::endl;
+    std::cout << "PE_CONFLATE_RESP=" << regStatus.conflateResponse << " ";
+    std::cout << "PE_SOLVE=" << regStatus.solveProblem << " ";
+    std::cout << "PE_SOLVE_RATE=" << regStatus.solveRate << " ";
+    std::cout << "PE_STALE_EDGE=" << regStatus.staleEdge << " ";
+    std::cout << "PE_FIELD_DRIFT=" << regStatus.fieldDrift << " ";
+    std::cout << std::endl;
+    std::cout << "PE_SUPPRESS_BASKET=" << regStatus.suppressBasket << " ";
+    std::cout << "PE_REPRICE_BASKET=" << regStatus.repriceBasket << " ";
+    std::cout << "PE_MEMO_HIT=" << regStatus.memoHit << " ";
+    std::cout << "PE_MEMO_REJECT=" << regStatus.memoReject << " ";
+    std::cout << "PE_ANNEAL_ITER=" << regStatus.annealIter << " ";
+    std::cout << std::endl;
+    std::cout << "PE_LAT_UPDATE=" << regStatus.latencyUpdateMin << "/"
+              << regStatus.latencyUpdateMax << "/" << regStatus.latencyUpdateMean << " ";
+    std::cout << "PE_LAT_SOLVE=" << regStatus.latencySolveMin << "/" << regStatus.latencySolveMax
+              << "/" << regStatus.latencySolveMean << " ";
+    std::cout << "PE_LAT_EMIT=" << regStatus.latencyEmitMin << "/" << regStatus.latencyEmitMax
+              << "/" << regStatus.latencyEmitMean << " ";
+    std::cout << "PE_LAT_TOTAL=" << regStatus.latencyTotalMin << "/" << regStatus.latencyTotalMax
+              << "/" << regStatus.latencyTotalMean << " ";
+    std::cout << "PE_TRACE_COUNT=" << regStatus.traceCount << " ";
+    std::cout << "PE_TRACE_TRIGGER=0x" << std::hex << regStatus.traceTrigger << std::dec << " ";
+    std::cout << "PE_RECORD_DROP=" << regStatus.recordDrop << " ";
+    std::cout << std::endl;
+    std::cout << "PE_QUALITY_ALL_ZERO=" << regStatus.qualityAllZero << " ";
+    std::cout << "PE_QUALITY_NO_CYCLE=" << regStatus.qualityNoCycle << " ";
+    std::cout << "PE_QUALITY_CYCLE=" << regStatus.qualityCycle << " ";
+    std::cout << "PE_QUALITY_PROFITABLE=" << regStatus.qualityProfitable << " ";
+    std::cout << "PE_QUALITY_SPIN_FLIP=" << regStatus.qualitySpinFlip << " ";
+    std::cout << std::endl;
+    std::cout << "PE_TX_BASKET=" << regStatus.txBasket << " ";
+    std::cout << "PE_SNAPSHOT_CYCLE=" << regStatus.snapshotCycle << " ";
+    std::cout << std::endl;
     std::cout << "PE_RESV0=" << regStatus.reserved10 << " ";
     std::cout << "PE_RESV1=" << regStatus.reserved11 << " ";
     std::cout << "PE_RESV2=" << regStatus.reserved12 << " ";
@@ -200,5 +1386,6 @@ int main(int argc, char *argv[])
     std::cout << std::endl;
     std::cout << "Done!" << std::endl;
 
-    return 0;
+    if (countFail) std::cout << "FAILED: " << countFail << " checks" << std::endl;
+    return countFail ? 1 : 0;
 }
@@ -9,6 +9,16 @@ rate2pair = {}
 
 symbols = ["USD", "EUR", "JPY", "GBP", "CHF"]
 
+# orderId of a leg is the count of orders sent ahead of it, its basket and tick to trade
+# come with the order tag of the same orderId, see PE_TAG_BITS in pricingengine.hpp
+TAG_BYTES = 32
+# the order entry writes "^" where FIX uses SOH, both are accepted
+FIX_SEPARATORS = (b"\x01", b"^")
+FIX_CLORDID = b"11"
+# SendingTime is "20190828-" followed by the 8 raw bytes of the order timestamp
+FIX_SENDINGTIME = b"52="
+FIX_SENDINGTIME_DATE = 9
+
 def print_orders(raw):
     # input is a binary string
     pkt_num = len(raw) // 256 # 256 bytes per order entry
@@ -22,6 +32,126 @@ def print_orders(raw):
     # print(exch_index_start, exch_index_to)
 
 
+def fix_fields(order):
+    # tag=value pairs separated by SOH, padding and malformed fields are skipped
+    fields = {}
+    for sep in FIX_SEPARATORS[1:]:
+        order = order.replace(sep, FIX_SEPARATORS[0])
+    for field in order.split(FIX_SEPARATORS[0]):
+        tag, sep, value = field.partition(b"=")
+        if sep:
+            fields[tag.strip()] = value.strip()
+    return fields
+
+
+def fix_timestamp(order):
+    # the raw timestamp may contain separator bytes, so tag 52 is read by position
+    for sep in FIX_SEPARATORS:
+        pos = order.find(sep + FIX_SENDINGTIME)
+        if pos >= 0:
+            pos += len(sep + FIX_SENDINGTIME) + FIX_SENDINGTIME_DATE
+            return int.from_bytes(order[pos:pos+8], "big")
+    return None
+
+
+def read_tags(path):
+    # little endian 32 byte tags as a data mover writes the orderTagStream, keyed by orderId
+    tags = {}
+    with open(path, "rb") as f:
+        raw = f.read()
+    for i in range(len(raw) // TAG_BYTES):
+        tag = int.from_bytes(raw[i*TAG_BYTES:(i+1)*TAG_BYTES], "little")
+        order_id = tag & 0xffffffff
+        tags[order_id] = {"basket": (tag >> 32) & 0xffffffff,
+                          "index": (tag >> 64) & 0xff,
+                          "count": (tag >> 72) & 0xff,
+                          "ingress": (tag >> 128) & 0xffffffffffffffff,
+                          "egress": (tag >> 192) & 0xffffffffffffffff}
+    return tags
+
+
+def order_ids(raw):
+    # (position, orderId) of every order that carries a ClOrdID
+    pkt_num = len(raw) // 256 # 256 bytes per order entry
+    for i in range(pkt_num):
+        fields = fix_fields(raw[i*256:(i+1)*256])
+        if FIX_CLORDID in fields:
+            yield i, int(fields[FIX_CLORDID].decode())
+
+
+def print_baskets(raw, tags):
+    # reconstruct the baskets of the pricing engine from the tag of every leg
+    baskets = {}
+    order = []
+    untagged = 0
+    for i, order_id in order_ids(raw):
+        if order_id not in tags:
+            untagged += 1
+            continue
+        tag = tags[order_id]
+        basket_id = tag["basket"]
+        leg_index = tag["index"]
+        leg_count = tag["count"]
+        rate = int(raw[i*256+157:i*256+167].decode())
+        if basket_id not in baskets:
+            baskets[basket_id] = {"count": leg_count, "legs": {}, "first": i, "last": i,
+                                  "time": []}
+            order.append(basket_id)
+        basket = baskets[basket_id]
+        basket["legs"][leg_index] = rate
+        basket["last"] = i
+        timestamp = fix_timestamp(raw[i*256:(i+1)*256])
+        if timestamp is not None:
+            basket["time"].append(f"0x{timestamp:016x}")
+
+    for basket_id in order:
+        basket = baskets[basket_id]
+        complete = len(basket["legs"]) == basket["count"]
+        # legs of a basket have to be back to back in the output
+        atomic = basket["last"] - basket["first"] + 1 == len(basket["legs"])
+        pairs = []
+        for leg_index in sorted(basket["legs"]):
+            rate = basket["legs"][leg_index]
+            if rate in rate2pair:
+                src, dst = exch_index2id[rate2pair[rate]]
+                pairs.append(f"{symbols[src]}->{symbols[dst]}")
+            else:
+                pairs.append(str(rate))
+        print(f"basket{basket_id}: legs {len(basket['legs'])}/{basket['count']}"
+              f" {'complete' if complete else 'incomplete'}"
+              f" {'atomic' if atomic else 'interleaved'} [{', '.join(pairs)}]")
+        if basket["time"]:
+            print(f"basket{basket_id}: first leg {basket['time'][0]} last leg {basket['time'][-1]}")
+    if untagged:
+        print(f"orders without a tag: {untagged}")
+
+
+def print_distribution(label, samples):
+    samples = sorted(samples)
+    line = f"{label}: n={len(samples)}"
+    if samples:
+        line += (f" min={samples[0]:.1f} p50={samples[len(samples) * 50 // 100]:.1f}"
+                 f" p90={samples[len(samples) * 90 // 100]:.1f}"
+                 f" p99={samples[len(samples) * 99 // 100]:.1f} max={samples[-1]:.1f}")
+    print(line)
+
+
+def print_latency(raw, tags, clock):
+    # tick to trade is ingress to egress of the tag in kernel cycles, the one of a
+    # basket is the one of its last leg
+    orders, baskets = [], []
+    for _, order_id in order_ids(raw):
+        if order_id not in tags:
+            continue
+        tag = tags[order_id]
+        latency = (tag["egress"] - tag["ingress"]) * 1000.0 / clock
+        orders.append(latency)
+        if tag["index"] + 1 == tag["count"]:
+            baskets.append(latency)
+    print_distribution("tick to trade per order (ns)", orders)
+    print_distribution("tick to trade per basket (ns)", baskets)
+
+
 def construct_map(df):
     px = df["MDEntryPx"]
     exch_index = df["SecurityID"] // 1024 - 1  # get exch_index
@@ -36,7 +166,17 @@ def parse_arg():
         '-c', '--csv', help="path of csv file", required=True)
     parser.add_argument(
         '-e', '--orderentry', help="path of orderentry output", required=True)
+    parser.add_argument(
+        '-t', '--tags', help="path of the order tag capture (orderTagStream)")
+    parser.add_argument(
+        '-l', '--latency', help="print tick to trade per order and per basket from the tags",
+        action="store_true")
+    parser.add_argument(
+        '--clock', help="kernel clock in MHz for the tick to trade cycles", type=float,
+        default=300.0)
     args = parser.parse_args()
+    if args.latency and not args.tags:
+        parser.error("-l needs the order tags, -t")
     return args
 
 
@@ -48,4 +188,9 @@ if __name__ == '__main__':
     df = pd.read_csv(args.csv)
     construct_map(df)
     print_orders(raw)
+    if args.tags:
+        tags = read_tags(args.tags)
+        print_baskets(raw, tags)
+        if args.latency:
+            print_latency(raw, tags, args.clock)
 
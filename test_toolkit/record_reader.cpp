@@ -0,0 +1,405 @@
+/*
+ * Solution record reader
+ *
+ * Aggregates the solution records of the pricing engine recordStream, one 32 byte record per
+ * solve (PE_RECORD_BITS in pricingengine.hpp). The records are read in place from a memory mapped
+ * capture file or followed live in a shared memory ring, the stand-in for the data mover buffer.
+ *
+ *   record_reader -f solverecords.bin [-c MHz]         aggregate a capture file
+ *   record_reader -s name [-c MHz] [-i idle_ms]        follow the shared memory ring /dev/shm/name
+ *   record_reader -p name -f solverecords.bin [-d n]   publish a capture file into the ring
+ *
+ * Build: g++ -std=c++14 -O2 -o record_reader record_reader.cpp (-lrt on older glibc)
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#define RECORD_BYTES 32
+#define RECORD_WORDS (RECORD_BYTES / 4)
+#define NUM_VERDICT 4
+#define NUM_SYMBOL 256
+#define NUM_LEGS 32
+#define NUM_BUCKETS 33
+
+#define RING_MAGIC 0x5045524543524452ull  // "PERECRDR"
+#define RING_DEPTH 65536
+
+/* Shared memory ring, the producer writes the record and then advances head */
+struct ringHeader_t {
+    uint64_t magic;
+    uint32_t recordBytes;
+    uint32_t depth;
+    std::atomic<uint64_t> head;  // records written since the ring was created
+    uint64_t pad[5];
+};
+
+struct solveRecord_t {
+    uint64_t timestamp;
+    uint32_t ingress;
+    uint32_t solveEnd;
+    uint32_t egress;
+    uint32_t spins;
+    float energy;
+    uint32_t iterations;
+    uint32_t verdict;
+    bool memo;
+    uint32_t legs;
+    uint32_t symbol;
+};
+
+static const char *verdictName[NUM_VERDICT] = {"none", "reject", "suppress", "send"};
+
+static uint32_t loadWord(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static void decodeRecord(const uint8_t *p, solveRecord_t &record)
+{
+    uint32_t word[RECORD_WORDS];
+    for (int w = 0; w < RECORD_WORDS; w++) word[w] = loadWord(p + w * 4);
+    record.timestamp = ((uint64_t)word[1] << 32) | word[0];
+    record.ingress = word[2];
+    record.solveEnd = word[3];
+    record.egress = word[4];
+    record.spins = word[5];
+    std::memcpy(&record.energy, &word[6], sizeof(float));
+    record.iterations = word[7] & 0xffff;
+    record.verdict = (word[7] >> 16) & 0x3;
+    record.memo = (word[7] >> 18) & 0x1;
+    record.legs = (word[7] >> 19) & 0x1f;
+    record.symbol = word[7] >> 24;
+}
+
+/* Latency in cycles, a log2 histogram keeps the aggregation constant time per record */
+struct latencyStat_t {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint32_t min = 0;
+    uint32_t max = 0;
+    uint64_t hist[NUM_BUCKETS] = {0};
+
+    void add(uint32_t cycles)
+    {
+        int bucket = 0;
+        while (bucket < 32 && (cycles >> bucket) != 0) bucket++;
+        if (count == 0 || cycles < min) min = cycles;
+        if (cycles > max) max = cycles;
+        sum += cycles;
+        ++hist[bucket];
+        ++count;
+    }
+
+    /* upper bound of the bucket holding the given fraction of the samples */
+    uint64_t percentile(double fraction) const
+    {
+        uint64_t target = (uint64_t)(fraction * count), seen = 0;
+        for (int b = 0; b < NUM_BUCKETS; b++) {
+            seen += hist[b];
+            if (seen > target) return (b == 0) ? 0 : ((1ull << b) - 1);
+        }
+        return max;
+    }
+
+    void print(const char *label, double clock) const
+    {
+        std::cout << label << ": n=" << count;
+        if (count != 0) {
+            std::cout << std::fixed << std::setprecision(1) << " min=" << min * 1000.0 / clock
+                      << " mean=" << (double)sum / count * 1000.0 / clock
+                      << " p50<=" << percentile(0.50) * 1000.0 / clock
+                      << " p99<=" << percentile(0.99) * 1000.0 / clock
+                      << " max=" << max * 1000.0 / clock << " ns" << std::defaultfloat;
+        }
+        std::cout << std::endl;
+    }
+};
+
+struct recordStat_t {
+    uint64_t count = 0;
+    uint64_t verdict[NUM_VERDICT] = {0};
+    uint64_t memo = 0;
+    uint64_t symbol[NUM_SYMBOL] = {0};
+    uint64_t legs[NUM_LEGS] = {0};
+    uint64_t iterSum = 0;
+    uint32_t iterMax = 0;
+    double energySum = 0;
+    float energyMin = 0;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    latencyStat_t solve;   // ingress to solver end
+    latencyStat_t emit;    // solver end to the last leg
+    latencyStat_t total;   // ingress to the last leg
+
+    void add(const solveRecord_t &record)
+    {
+        if (count == 0 || record.energy < energyMin) energyMin = record.energy;
+        if (count == 0) firstTimestamp = record.timestamp;
+        lastTimestamp = record.timestamp;
+        ++count;
+        ++verdict[record.verdict];
+        memo += record.memo;
+        ++symbol[record.symbol];
+        ++legs[record.legs];
+        iterSum += record.iterations;
+        if (record.iterations > iterMax) iterMax = record.iterations;
+        energySum += record.energy;
+        // the cycle stamps wrap at 32 bits, differences stay valid
+        solve.add(record.solveEnd - record.ingress);
+        if (record.legs != 0) {
+            emit.add(record.egress - record.solveEnd);
+            total.add(record.egress - record.ingress);
+        }
+    }
+
+    void print(double clock) const
+    {
+        std::cout << "records=" << count << " timestamps=" << firstTimestamp << ".."
+                  << lastTimestamp << std::endl;
+        std::cout << "verdict:";
+        for (int v = 0; v < NUM_VERDICT; v++) {
+            std::cout << " " << verdictName[v] << "=" << verdict[v];
+        }
+        std::cout << " memo=" << memo << std::endl;
+        std::cout << "legs:";
+        for (int l = 0; l < NUM_LEGS; l++) {
+            if (legs[l] != 0) std::cout << " " << l << "=" << legs[l];
+        }
+        std::cout << std::endl;
+        std::cout << "symbol:";
+        for (int s = 0; s < NUM_SYMBOL; s++) {
+            if (symbol[s] != 0) std::cout << " " << s << "=" << symbol[s];
+        }
+        std::cout << std::endl;
+        if (count != 0) {
+            std::cout << "iterations: mean=" << (double)iterSum / count << " max=" << iterMax
+                      << std::endl;
+            std::cout << "energy: min=" << energyMin << " mean=" << energySum / count << std::endl;
+        }
+        solve.print("latency solve", clock);
+        emit.print("latency emit", clock);
+        total.print("latency total", clock);
+    }
+};
+
+static void usage(const char *name)
+{
+    std::cerr << "usage: " << name << " -f file [-c MHz]" << std::endl
+              << "       " << name << " -s name [-c MHz] [-i idle_ms]" << std::endl
+              << "       " << name << " -p name -f file [-d depth]" << std::endl;
+}
+
+/* Maps the whole capture file read only, the records are decoded where they lie */
+static int readFile(const std::string &path, recordStat_t &stat)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t records = st.st_size / RECORD_BYTES;
+    if (records == 0) {
+        close(fd);
+        return 0;
+    }
+    const uint8_t *base =
+        (const uint8_t *)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        std::cerr << "Error: cannot map " << path << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    madvise((void *)base, st.st_size, MADV_SEQUENTIAL);
+
+    solveRecord_t record;
+    for (size_t n = 0; n < records; n++) {
+        decodeRecord(base + n * RECORD_BYTES, record);
+        stat.add(record);
+    }
+    munmap((void *)base, st.st_size);
+    return 0;
+}
+
+static ringHeader_t *mapRing(const std::string &name, uint32_t depth, bool create)
+{
+    int fd = shm_open(("/" + name).c_str(), create ? (O_RDWR | O_CREAT) : O_RDWR, 0600);
+    if (fd < 0) return nullptr;
+    size_t size = sizeof(ringHeader_t);
+    if (create) {
+        size += (size_t)depth * RECORD_BYTES;
+        if (ftruncate(fd, size) != 0) {
+            close(fd);
+            return nullptr;
+        }
+    } else {
+        struct stat st;
+        fstat(fd, &st);
+        if ((size_t)st.st_size < size) {
+            close(fd);
+            return nullptr;
+        }
+        size = st.st_size;
+    }
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return nullptr;
+
+    ringHeader_t *ring = (ringHeader_t *)base;
+    if (create) {
+        ring->recordBytes = RECORD_BYTES;
+        ring->depth = depth;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->magic = RING_MAGIC;
+    } else if (ring->magic != RING_MAGIC || ring->recordBytes != RECORD_BYTES) {
+        munmap(base, size);
+        return nullptr;
+    }
+    return ring;
+}
+
+/* Takes what is still in the ring and follows head until it stops moving for idle ms, records
+ * overwritten before they were read are counted as lost */
+static int followRing(const std::string &name, int idleMs, recordStat_t &stat, uint64_t &lost)
+{
+    auto lastMove = std::chrono::steady_clock::now();
+    ringHeader_t *ring = nullptr;
+    // the producer may not have created the ring yet
+    while ((ring = mapRing(name, 0, false)) == nullptr) {
+        if (std::chrono::steady_clock::now() - lastMove > std::chrono::milliseconds(idleMs)) {
+            std::cerr << "Error: cannot open shared memory " << name << std::endl;
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const uint8_t *records = (const uint8_t *)(ring + 1);
+    uint64_t tail = 0;
+    solveRecord_t record;
+
+    while (true) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (std::chrono::steady_clock::now() - lastMove > std::chrono::milliseconds(idleMs)) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        if (head - tail > ring->depth) {
+            lost += head - tail - ring->depth;
+            tail = head - ring->depth;
+        }
+        for (; tail < head; tail++) {
+            uint8_t buffer[RECORD_BYTES];
+            std::memcpy(buffer, records + (tail % ring->depth) * RECORD_BYTES, RECORD_BYTES);
+            // the slot may have been reused while it was copied
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (ring->head.load(std::memory_order_relaxed) - tail >= ring->depth) {
+                ++lost;
+                continue;
+            }
+            decodeRecord(buffer, record);
+            stat.add(record);
+        }
+        lastMove = std::chrono::steady_clock::now();
+    }
+    return 0;
+}
+
+/* Data mover stand-in, copies a capture file into the ring as fast as it can */
+static int publishRing(const std::string &name, const std::string &path, uint32_t depth)
+{
+    ringHeader_t *ring = mapRing(name, depth, true);
+    if (ring == nullptr) {
+        std::cerr << "Error: cannot create shared memory " << name << std::endl;
+        return -1;
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    uint8_t *records = (uint8_t *)(ring + 1);
+    uint8_t buffer[RECORD_BYTES];
+    uint64_t head = 0;
+    while (read(fd, buffer, RECORD_BYTES) == RECORD_BYTES) {
+        std::memcpy(records + (head % depth) * RECORD_BYTES, buffer, RECORD_BYTES);
+        ring->head.store(++head, std::memory_order_release);
+    }
+    close(fd);
+    std::cout << "published=" << head << std::endl;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string path, shmName, publishName;
+    double clock = 300.0;
+    int idleMs = 1000;
+    uint32_t depth = RING_DEPTH;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (arg == "-f") {
+            path = argv[++i];
+        } else if (arg == "-s") {
+            shmName = argv[++i];
+        } else if (arg == "-p") {
+            publishName = argv[++i];
+        } else if (arg == "-c") {
+            clock = std::atof(argv[++i]);
+        } else if (arg == "-i") {
+            idleMs = std::atoi(argv[++i]);
+        } else if (arg == "-d") {
+            depth = std::strtoul(argv[++i], nullptr, 0);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!publishName.empty() && !path.empty() && depth != 0) {
+        return publishRing(publishName, path, depth) ? 1 : 0;
+    }
+
+    recordStat_t stat;
+    uint64_t lost = 0;
+    auto start = std::chrono::steady_clock::now();
+    if (!path.empty()) {
+        if (readFile(path, stat)) return 1;
+    } else if (!shmName.empty()) {
+        if (followRing(shmName, idleMs, stat, lost)) return 1;
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stat.print(clock);
+    if (!shmName.empty()) std::cout << "lost=" << lost << std::endl;
+    if (!path.empty()) {
+        std::cout << "rate=" << (seconds > 0 ? stat.count / seconds : 0) << " records/s"
+                  << std::endl;
+    }
+    return 0;
+}